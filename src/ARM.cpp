@@ -22,6 +22,7 @@
 #include "DSi.h"
 #include "ARM.h"
 #include "ARMInterpreter.h"
+#include "ARMInterpreter_Cache.h"
 #include "Config.h"
 #include "AREngine.h"
 #include "ARMJIT.h"
@@ -159,6 +160,7 @@ void ARMv4::Reset()
         BusWrite8 = DSi::ARM7Write8;
         BusWrite16 = DSi::ARM7Write16;
         BusWrite32 = DSi::ARM7Write32;
+        GetMemRegion = DSi::ARM7GetMemRegion;
     }
     else
     {
@@ -168,6 +170,7 @@ void ARMv4::Reset()
         BusWrite8 = NDS::ARM7Write8;
         BusWrite16 = NDS::ARM7Write16;
         BusWrite32 = NDS::ARM7Write32;
+        GetMemRegion = NDS::ARM7GetMemRegion;
     }
 
     ARM::Reset();
@@ -615,6 +618,203 @@ void ARMv5::Execute()
         Halted = 0;
 }
 
+void ARMv5::ExecuteCached()
+{
+    if (Halted)
+    {
+        if (Halted == 2)
+        {
+            Halted = 0;
+        }
+        else if (NDS::HaltInterrupted(0))
+        {
+            Halted = 0;
+            if (NDS::IME[0] & 0x1)
+                TriggerIRQ();
+        }
+        else
+        {
+            NDS::ARM9Timestamp = NDS::ARM9Target;
+            return;
+        }
+    }
+
+    ARMInterpreter::CachedBlock* block = NULL;
+    u32 blockpos = 0;
+    u32 blockpc, blockthumb;
+    u8* codemem;
+    u32 codemask;
+
+    while (NDS::ARM9Timestamp < NDS::ARM9Target)
+    {
+        if (!block)
+        {
+            // only code which is fetched straight from memory can be cached
+            // the fetches made while running the block have to stay on the same side of the ITCM boundary
+            u32 thumb = CPSR & 0x20;
+            u32 instrAddr = R[15] - (thumb ? 2 : 4);
+            if (instrAddr < ITCMSize)
+            {
+                codemem = ITCM;
+                codemask = ITCMPhysicalSize - 1;
+            }
+            else
+            {
+                codemem = CodeMem.Mem;
+                codemask = CodeMem.Mask;
+            }
+
+            if (codemem)
+            {
+                block = ARMInterpreter::GetCachedBlock(0, instrAddr, thumb, codemem, codemask);
+                blockpos = 0;
+                blockpc = R[15];
+                blockthumb = thumb;
+
+                u32 lastFetch = R[15] + block->NumInstrs * (thumb ? 2 : 4);
+                if (lastFetch < R[15] || (instrAddr < ITCMSize) != (lastFetch < ITCMSize))
+                    block = NULL;
+            }
+        }
+
+        if (block)
+        {
+            ARMInterpreter::CachedInstr& instr = block->Instrs[blockpos++];
+            u32 pc;
+
+            if (CPSR & 0x20) // THUMB
+            {
+                // prefetch
+                R[15] += 2;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
+                else
+                {
+                    NextInstr[1] = *(u32*)&codemem[R[15] & codemask];
+                    if (codemem == ITCM)                CodeCycles = 1;
+                    else if (RegionCodeCycles == 0xFF)  CodeCycles = (R[15] & 0x1F) ? 1 : kCodeCacheTiming;
+                    else                                CodeCycles = RegionCodeCycles;
+                }
+
+                // actually execute
+                pc = R[15];
+                if ((CurInstr & 0xFFFF) == instr.Instr)
+                {
+                    instr.Handler(this);
+                }
+                else
+                {
+                    // the code was changed since the block was decoded
+                    block->Key = 0xFFFFFFFF;
+                    u32 icode = (CurInstr >> 6) & 0x3FF;
+                    ARMInterpreter::THUMBInstrTable[icode](this);
+                    blockpos = block->NumInstrs;
+                }
+            }
+            else
+            {
+                // prefetch
+                R[15] += 4;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = *(u32*)&codemem[R[15] & codemask];
+                if (codemem == ITCM)                CodeCycles = 1;
+                else if (RegionCodeCycles == 0xFF)  CodeCycles = (R[15] & 0x1F) ? 1 : kCodeCacheTiming;
+                else                                CodeCycles = RegionCodeCycles;
+
+                // actually execute
+                pc = R[15];
+                if (CurInstr == instr.Instr)
+                {
+                    if (CheckCondition(instr.Cond))
+                        instr.Handler(this);
+                    else
+                        AddCycles_C();
+                }
+                else
+                {
+                    block->Key = 0xFFFFFFFF;
+                    if (CheckCondition(CurInstr >> 28))
+                    {
+                        u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                        ARMInterpreter::ARMInstrTable[icode](this);
+                    }
+                    else if ((CurInstr & 0xFE000000) == 0xFA000000)
+                    {
+                        ARMInterpreter::A_BLX_IMM(this);
+                    }
+                    else
+                        AddCycles_C();
+                    blockpos = block->NumInstrs;
+                }
+            }
+
+            if (R[15] != pc || blockpos == block->NumInstrs)
+            {
+                // loops which are a single block go around without looking it up again
+                if (R[15] == blockpc && (CPSR & 0x20) == blockthumb && block->Key != 0xFFFFFFFF)
+                    blockpos = 0;
+                else
+                    block = NULL;
+            }
+        }
+        else
+        {
+            if (CPSR & 0x20) // THUMB
+            {
+                R[15] += 2;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
+                else             NextInstr[1] = CodeRead32(R[15], false);
+
+                u32 icode = (CurInstr >> 6) & 0x3FF;
+                ARMInterpreter::THUMBInstrTable[icode](this);
+            }
+            else
+            {
+                R[15] += 4;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = CodeRead32(R[15], false);
+
+                if (CheckCondition(CurInstr >> 28))
+                {
+                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                    ARMInterpreter::ARMInstrTable[icode](this);
+                }
+                else if ((CurInstr & 0xFE000000) == 0xFA000000)
+                {
+                    ARMInterpreter::A_BLX_IMM(this);
+                }
+                else
+                    AddCycles_C();
+            }
+        }
+
+        if (Halted)
+        {
+            if (Halted == 1 && NDS::ARM9Timestamp < NDS::ARM9Target)
+            {
+                NDS::ARM9Timestamp = NDS::ARM9Target;
+            }
+            break;
+        }
+        if (IRQ)
+        {
+            TriggerIRQ();
+            block = NULL;
+        }
+
+        NDS::ARM9Timestamp += Cycles;
+        Cycles = 0;
+    }
+
+    if (Halted == 2)
+        Halted = 0;
+}
+
 #ifdef JIT_ENABLED
 void ARMv5::ExecuteJIT()
 {
@@ -766,6 +966,177 @@ void ARMv4::Execute()
     }
 }
 
+void ARMv4::ExecuteCached()
+{
+    if (Halted)
+    {
+        if (Halted == 2)
+        {
+            Halted = 0;
+        }
+        else if (NDS::HaltInterrupted(1))
+        {
+            Halted = 0;
+            if (NDS::IME[1] & 0x1)
+                TriggerIRQ();
+        }
+        else
+        {
+            NDS::ARM7Timestamp = NDS::ARM7Target;
+            return;
+        }
+    }
+
+    ARMInterpreter::CachedBlock* block = NULL;
+    u32 blockpos = 0;
+    u32 blockpc, blockthumb;
+    NDS::MemRegion region;
+
+    while (NDS::ARM7Timestamp < NDS::ARM7Target)
+    {
+        if (!block)
+        {
+            // the BIOS is left out, reading it depends on where the PC is
+            u32 thumb = CPSR & 0x20;
+            u32 instrAddr = R[15] - (thumb ? 2 : 4);
+            if (instrAddr >= 0x4000 && GetMemRegion(instrAddr, false, &region))
+            {
+                block = ARMInterpreter::GetCachedBlock(1, instrAddr, thumb, region.Mem, region.Mask);
+                blockpos = 0;
+                blockpc = R[15];
+                blockthumb = thumb;
+
+                u32 lastFetch = R[15] + block->NumInstrs * (thumb ? 2 : 4);
+                if (lastFetch < R[15] || (lastFetch >> 23) != (instrAddr >> 23))
+                    block = NULL;
+            }
+        }
+
+        if (block)
+        {
+            ARMInterpreter::CachedInstr& instr = block->Instrs[blockpos++];
+            u32 pc;
+
+            if (CPSR & 0x20) // THUMB
+            {
+                // prefetch
+                R[15] += 2;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = *(u16*)&region.Mem[R[15] & region.Mask];
+
+                // actually execute
+                pc = R[15];
+                if (CurInstr == instr.Instr)
+                {
+                    instr.Handler(this);
+                }
+                else
+                {
+                    // the code was changed since the block was decoded
+                    block->Key = 0xFFFFFFFF;
+                    u32 icode = (CurInstr >> 6);
+                    ARMInterpreter::THUMBInstrTable[icode](this);
+                    blockpos = block->NumInstrs;
+                }
+            }
+            else
+            {
+                // prefetch
+                R[15] += 4;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = *(u32*)&region.Mem[R[15] & region.Mask];
+
+                // actually execute
+                pc = R[15];
+                if (CurInstr == instr.Instr)
+                {
+                    if (CheckCondition(instr.Cond))
+                        instr.Handler(this);
+                    else
+                        AddCycles_C();
+                }
+                else
+                {
+                    block->Key = 0xFFFFFFFF;
+                    if (CheckCondition(CurInstr >> 28))
+                    {
+                        u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                        ARMInterpreter::ARMInstrTable[icode](this);
+                    }
+                    else
+                        AddCycles_C();
+                    blockpos = block->NumInstrs;
+                }
+            }
+
+            if (R[15] != pc || blockpos == block->NumInstrs)
+            {
+                // loops which are a single block go around without looking it up again
+                if (R[15] == blockpc && (CPSR & 0x20) == blockthumb && block->Key != 0xFFFFFFFF)
+                    blockpos = 0;
+                else
+                    block = NULL;
+            }
+        }
+        else
+        {
+            if (CPSR & 0x20) // THUMB
+            {
+                R[15] += 2;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = CodeRead16(R[15]);
+
+                u32 icode = (CurInstr >> 6);
+                ARMInterpreter::THUMBInstrTable[icode](this);
+            }
+            else
+            {
+                R[15] += 4;
+                CurInstr = NextInstr[0];
+                NextInstr[0] = NextInstr[1];
+                NextInstr[1] = CodeRead32(R[15]);
+
+                if (CheckCondition(CurInstr >> 28))
+                {
+                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                    ARMInterpreter::ARMInstrTable[icode](this);
+                }
+                else
+                    AddCycles_C();
+            }
+        }
+
+        if (Halted)
+        {
+            if (Halted == 1 && NDS::ARM7Timestamp < NDS::ARM7Target)
+            {
+                NDS::ARM7Timestamp = NDS::ARM7Target;
+            }
+            break;
+        }
+        if (IRQ)
+        {
+            TriggerIRQ();
+            block = NULL;
+        }
+
+        NDS::ARM7Timestamp += Cycles;
+        Cycles = 0;
+    }
+
+    if (Halted == 2)
+        Halted = 0;
+
+    if (Halted == 4)
+    {
+        DSi::SoftReset();
+        Halted = 2;
+    }
+}
+
 #ifdef JIT_ENABLED
 void ARMv4::ExecuteJIT()
 {
@@ -35,6 +35,14 @@ enum
     RWFlags_ForceUser = (1<<21),
 };
 
+// access timing for cached regions
+// this would be an average between cache hits and cache misses
+// this was measured to be close to hardware average
+// a value of 1 would represent a perfect cache, but that causes
+// games to run too fast, causing a number of issues
+const int kDataCacheTiming = 3;//2;
+const int kCodeCacheTiming = 3;//5;
+
 const u32 ITCMPhysicalSize = 0x8000;
 const u32 DTCMPhysicalSize = 0x4000;
 
@@ -60,6 +68,7 @@ public:
     }
 
     virtual void Execute() = 0;
+    virtual void ExecuteCached() = 0;
 #ifdef JIT_ENABLED
     virtual void ExecuteJIT() = 0;
 #endif
@@ -185,12 +194,15 @@ public:
     void DataAbort();
 
     void Execute();
+    void ExecuteCached();
 #ifdef JIT_ENABLED
     void ExecuteJIT();
 #endif
 
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
+    // cycles CodeRead32() would take, if RegionCodeCycles were regionCodeCycles
+    s32 CodeReadCycles(u32 addr, bool branch, s32 regionCodeCycles);
 
     void DataRead8(u32 addr, u32* val);
     void DataRead16(u32 addr, u32* val);
@@ -315,6 +327,7 @@ public:
     void JumpTo(u32 addr, bool restorecpsr = false);
 
     void Execute();
+    void ExecuteCached();
 #ifdef JIT_ENABLED
     void ExecuteJIT();
 #endif
@@ -457,6 +470,8 @@ public:
             Cycles += numC + numD;
         }
     }
+
+    bool (*GetMemRegion)(u32 addr, bool write, NDS::MemRegion* region);
 };
 
 namespace ARMInterpreter
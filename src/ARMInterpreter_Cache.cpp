@@ -0,0 +1,105 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "ARMInterpreter_Cache.h"
+#include "ARMInterpreter.h"
+#include "ARM_InstrInfo.h"
+
+
+namespace ARMInterpreter
+{
+
+// direct mapped, per CPU
+const u32 NumCachedBlocks = 4096;
+
+CachedBlock Blocks[2][NumCachedBlocks];
+
+
+void ResetBlockCache()
+{
+    for (u32 num = 0; num < 2; num++)
+    {
+        for (u32 i = 0; i < NumCachedBlocks; i++)
+        {
+            Blocks[num][i].Key = 0xFFFFFFFF;
+            Blocks[num][i].NumInstrs = 0;
+        }
+    }
+}
+
+void DecodeBlock(CachedBlock* block, u32 num, u32 addr, bool thumb, u8* mem, u32 mask)
+{
+    u32 n = 0;
+    while (n < CachedBlockMaxInstrs)
+    {
+        CachedInstr& instr = block->Instrs[n++];
+        ARMInstrInfo::Info info;
+
+        if (thumb)
+        {
+            instr.Instr = *(u16*)&mem[addr & mask];
+            instr.Cond = 0xE;
+            instr.Handler = THUMBInstrTable[instr.Instr >> 6];
+
+            info = ARMInstrInfo::Decode(true, num, instr.Instr);
+            addr += 2;
+        }
+        else
+        {
+            instr.Instr = *(u32*)&mem[addr & mask];
+            if (num == 0 && (instr.Instr & 0xFE000000) == 0xFA000000)
+            {
+                instr.Cond = 0xE;
+                instr.Handler = A_BLX_IMM;
+            }
+            else
+            {
+                instr.Cond = instr.Instr >> 28;
+                instr.Handler = ARMInstrTable[((instr.Instr >> 4) & 0xF) | ((instr.Instr >> 16) & 0xFF0)];
+            }
+
+            info = ARMInstrInfo::Decode(false, num, instr.Instr);
+            addr += 4;
+
+            // CP15 writes can remap the ITCM under us
+            if (info.Kind == ARMInstrInfo::ak_MCR)
+                break;
+        }
+
+        if (info.EndBlock)
+            break;
+    }
+
+    block->NumInstrs = n;
+}
+
+CachedBlock* GetCachedBlock(u32 num, u32 addr, bool thumb, u8* mem, u32 mask)
+{
+    u32 key = addr | (thumb ? 1 : 0);
+    CachedBlock* block = &Blocks[num][((addr >> 1) ^ (addr >> 13)) & (NumCachedBlocks-1)];
+
+    if (block->Key != key)
+    {
+        DecodeBlock(block, num, addr, thumb, mem, mask);
+        block->Key = key;
+    }
+
+    return block;
+}
+
+}
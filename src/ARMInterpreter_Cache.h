@@ -0,0 +1,64 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMINTERPRETER_CACHE_H
+#define ARMINTERPRETER_CACHE_H
+
+#include "types.h"
+
+class ARM;
+
+// cached interpreter
+// the code is decoded into blocks once, so that running it again only has
+// to go through an array of handlers instead of fetching and decoding each
+// instruction from the bus
+//
+// blocks aren't invalidated when the memory behind them is written to.
+// instead each instruction is checked against the word the CPU actually
+// fetched right before running it, which keeps this exact without needing
+// the write tracking the JIT has
+namespace ARMInterpreter
+{
+
+const u32 CachedBlockMaxInstrs = 32;
+
+struct CachedInstr
+{
+    u32 Instr;
+    u32 Cond;
+    void (*Handler)(ARM* cpu);
+};
+
+struct CachedBlock
+{
+    // address of the first instruction, bit 0 set for THUMB
+    u32 Key;
+    u32 NumInstrs;
+
+    CachedInstr Instrs[CachedBlockMaxInstrs];
+};
+
+void ResetBlockCache();
+
+// returns the block starting at addr, decoding it first if needed
+// mem/mask is where the code is read from
+CachedBlock* GetCachedBlock(u32 num, u32 addr, bool thumb, u8* mem, u32 mask);
+
+}
+
+#endif // ARMINTERPRETER_CACHE_H
@@ -20,16 +20,22 @@
 
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #define XXH_STATIC_LINKING_ONLY
 #include "xxhash/xxhash.h"
 
 #include "Config.h"
+#include "Platform.h"
 
 #include "ARMJIT_Internal.h"
 #include "ARMJIT_Memory.h"
 #include "ARMJIT_Compiler.h"
+#include "ARMJIT_Cache.h"
 
 #include "ARMInterpreter_ALU.h"
 #include "ARMInterpreter_LoadStore.h"
@@ -65,6 +71,63 @@ std::unordered_map<u32, JitBlock*> RestoreCandidates;
 
 TinyVector<u32> InvalidLiterals;
 
+u32 NumCodeEvictions;
+u32 NumEvictedBlocks;
+u32 NumRecompiledBlocks;
+
+// blocks which were evicted and haven't been compiled again yet
+// (num << 32 | start address)
+std::unordered_set<u64> EvictedBlocks;
+
+// offsets of the jumps which lead to the block at a given address (num << 32 | addr),
+// they're pointed into it as long as it exists
+std::unordered_map<u64, std::vector<u32>> IncomingLinks;
+
+// (num << 32 | addr), the compiled code points directly at the counters
+// so entries are only removed together with all the code
+std::unordered_map<u64, BlockProfile> BlockProfiles;
+
+// with JIT_BackgroundCompile blocks are compiled on a separate thread,
+// one at a time. While it's busy, blocks which aren't compiled yet
+// are only interpreted (which happens anyway while they're fetched)
+// and are tried again the next time they're reached.
+// The compiler only works with what's in the job, everything it needs
+// to know about the memory map and timings is looked up beforehand
+// (see SnapshotMemoryState). If those change while the job is still
+// running, the block is thrown away (see MemoryMapChanged).
+enum
+{
+    compileJob_Idle = 0,
+    compileJob_Running,
+    compileJob_Done,
+};
+
+struct CompileJob
+{
+    ARM* CPU;
+    bool Thumb;
+    bool HasMemoryInstr;
+    int NumInstrs;
+    FetchedInstr Instrs[32];
+
+    JitBlockEntry EntryPoint;
+    std::vector<BlockLink> Links;
+};
+
+CompileJob Job;
+std::atomic_int JobState;
+
+// the block being compiled. It's already entered into the address
+// ranges so that writes to its code while it's compiled are noticed
+JitBlock* PendingBlock;
+bool PendingBlockInvalidated;
+
+Platform::Thread* CompileThread;
+std::atomic_bool CompileThreadRunning;
+Platform::Semaphore* Sema_JobStart;
+Platform::Semaphore* Sema_JobDone;
+Platform::Mutex* CompileLock;
+
 AddressRange CodeIndexITCM[ITCMPhysicalSize / 512];
 AddressRange CodeIndexMainRAM[NDS::MainRAMMaxSize / 512];
 AddressRange CodeIndexSWRAM[NDS::SharedWRAMSize / 512];
@@ -308,28 +371,55 @@ void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
 INSTANTIATE_SLOWMEM(0)
 INSTANTIATE_SLOWMEM(1)
 
+void DiscardCompileJob();
+void StopCompileThread();
+
 void Init()
 {
     JITCompiler = new Compiler();
 
+    Sema_JobStart = Platform::Semaphore_Create();
+    Sema_JobDone = Platform::Semaphore_Create();
+    CompileLock = Platform::Mutex_Create();
+    JobState = compileJob_Idle;
+    PendingBlock = NULL;
+    CompileThread = NULL;
+
     ARMJIT_Memory::Init();
 }
 
 void DeInit()
 {
+    DiscardCompileJob();
+    StopCompileThread();
+
+    ARMJIT_Cache::Close();
+
     JitEnableWrite();
     ResetBlockCache();
     ARMJIT_Memory::DeInit();
 
     delete JITCompiler;
+
+    Platform::Semaphore_Free(Sema_JobStart);
+    Platform::Semaphore_Free(Sema_JobDone);
+    Platform::Mutex_Free(CompileLock);
 }
 
 void Reset()
 {
+    DiscardCompileJob();
+
+    ARMJIT_Cache::Close();
+
     JitEnableWrite();
     ResetBlockCache();
 
     ARMJIT_Memory::Reset();
+
+    NumCodeEvictions = 0;
+    NumEvictedBlocks = 0;
+    NumRecompiledBlocks = 0;
 }
 
 void FloodFillSetFlags(FetchedInstr instrs[], int start, u8 flags)
@@ -438,6 +528,122 @@ bool DecodeBranch(bool thumb, const FetchedInstr& instr, u32& cond, bool hasLink
     return false;
 }
 
+// the target of a branch which is compiled as a jump to a constant address
+// (see Comp_JumpTo), with bit 0 set if it goes to THUMB code
+bool GetStaticJumpTarget(bool thumb, u32 num, const FetchedInstr& instr, u32& targetAddr)
+{
+    if (thumb)
+    {
+        u32 r15 = instr.Addr + 4;
+
+        switch (instr.Info.Kind)
+        {
+        case ARMInstrInfo::tk_BCOND:
+            targetAddr = r15 + ((s32)(instr.Instr << 24) >> 23) + 1;
+            return true;
+        case ARMInstrInfo::tk_B:
+            targetAddr = r15 + ((s32)((instr.Instr & 0x7FF) << 21) >> 20) + 1;
+            return true;
+        case ARMInstrInfo::tk_BL_LONG:
+            targetAddr = r15 + ((s32)((instr.Instr & 0x7FF) << 21) >> 9);
+            targetAddr += ((instr.Instr >> 16) & 0x7FF) << 1;
+            if (num == 1 || instr.Instr & (1 << 28))
+                targetAddr |= 1;
+            return true;
+        default:
+            return false;
+        }
+    }
+    else
+    {
+        switch (instr.Info.Kind)
+        {
+        case ARMInstrInfo::ak_B:
+        case ARMInstrInfo::ak_BL:
+        case ARMInstrInfo::ak_BLX_IMM:
+            targetAddr = instr.Addr + 8 + ((s32)(instr.Instr << 8) >> 6);
+            if (instr.Cond() == 0xF) // BLX_imm
+                targetAddr += (((instr.Instr >> 24) & 1) << 1) + 1;
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+void GetJumpTimings(ARM* cpu, u32 addr, u8& regionCodeCycles, u8& cycles)
+{
+    if (cpu->Num == 0)
+    {
+        ARMv5* cpu9 = (ARMv5*)cpu;
+
+        regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
+
+        if (addr & 0x1)
+        {
+            addr &= ~0x1;
+
+            // two-opcodes-at-once fetch
+            if (addr & 0x2)
+            {
+                cycles = cpu9->CodeReadCycles(addr-2, true, regionCodeCycles)
+                    + cpu9->CodeReadCycles(addr+2, false, regionCodeCycles);
+            }
+            else
+            {
+                cycles = cpu9->CodeReadCycles(addr, true, regionCodeCycles);
+            }
+        }
+        else
+        {
+            addr &= ~0x3;
+
+            cycles = cpu9->CodeReadCycles(addr, true, regionCodeCycles)
+                + cpu9->CodeReadCycles(addr+4, false, regionCodeCycles);
+        }
+    }
+    else
+    {
+        u32 codeCycles = addr >> 15; // cheato
+
+        regionCodeCycles = 0;
+        if (addr & 0x1)
+            cycles = NDS::ARM7MemTimings[codeCycles][0] + NDS::ARM7MemTimings[codeCycles][1];
+        else
+            cycles = NDS::ARM7MemTimings[codeCycles][2] + NDS::ARM7MemTimings[codeCycles][3];
+    }
+}
+
+// looks up everything about the memory map and timings the compiler needs.
+// This is done after the whole block was fetched, i.e. at the same point
+// where it would otherwise be compiled right away
+void SnapshotMemoryState(ARM* cpu, bool thumb, FetchedInstr instrs[], int numInstrs)
+{
+    for (int i = 0; i < numInstrs; i++)
+    {
+        FetchedInstr& instr = instrs[i];
+
+        if (cpu->Num == 0)
+        {
+            instr.DataRegionType = ARMJIT_Memory::ClassifyAddress9(instr.DataRegion);
+        }
+        else
+        {
+            instr.DataRegionType = ARMJIT_Memory::ClassifyAddress7(instr.DataRegion);
+            instr.NonSeqCodeCycles = NDS::ARM7MemTimings[instr.CodeCycles][thumb ? 0 : 2];
+            instr.SeqCodeCycles = NDS::ARM7MemTimings[instr.CodeCycles][thumb ? 1 : 3];
+        }
+
+        bool store = instr.Info.SpecialKind == ARMInstrInfo::special_WriteMem;
+        for (int j = 0; j < 3; j++)
+            instr.DataFuncs[j] = ARMJIT_Memory::GetFuncForAddr(cpu, instr.DataRegion, store, 8 << j);
+
+        u32 target;
+        if (GetStaticJumpTarget(thumb, cpu->Num, instr, target))
+            GetJumpTimings(cpu, target, instr.JumpRegionCodeCycles, instr.JumpCycles);
+    }
+}
+
 bool IsIdleLoop(bool thumb, FetchedInstr* instrs, int instrsCount)
 {
     // see https://github.com/dolphin-emu/dolphin/blob/master/Source/Core/Core/PowerPC/PPCAnalyst.cpp#L678
@@ -556,6 +762,312 @@ InterpreterFunc InterpretTHUMB[ARMInstrInfo::tk_Count] =
 };
 #undef F
 
+void LinkBlock(JitBlock* block)
+{
+    auto& map = block->Num == 0 ? JitBlocks9 : JitBlocks7;
+
+    for (int i = 0; i < block->Links.Length; i++)
+    {
+        BlockLink& link = block->Links[i];
+        IncomingLinks[((u64)block->Num << 32) | link.Target].push_back(link.Offset);
+
+        auto it = map.find(link.Target);
+        if (it != map.end())
+            JITCompiler->PatchBlockLink(link.Offset, it->second->EntryPoint);
+    }
+
+    auto it = IncomingLinks.find(((u64)block->Num << 32) | block->StartAddr);
+    if (it != IncomingLinks.end())
+    {
+        for (u32 offset : it->second)
+            JITCompiler->PatchBlockLink(offset, block->EntryPoint);
+    }
+}
+
+void UnlinkBlock(JitBlock* block)
+{
+    for (int i = 0; i < block->Links.Length; i++)
+    {
+        BlockLink& link = block->Links[i];
+        JITCompiler->PatchBlockLink(link.Offset, NULL);
+
+        auto it = IncomingLinks.find(((u64)block->Num << 32) | link.Target);
+        if (it != IncomingLinks.end())
+        {
+            std::vector<u32>& offsets = it->second;
+            for (size_t j = 0; j < offsets.size(); j++)
+            {
+                if (offsets[j] == link.Offset)
+                {
+                    offsets[j] = offsets.back();
+                    offsets.pop_back();
+                    break;
+                }
+            }
+            if (offsets.empty())
+                IncomingLinks.erase(it);
+        }
+    }
+
+    auto it = IncomingLinks.find(((u64)block->Num << 32) | block->StartAddr);
+    if (it != IncomingLinks.end())
+    {
+        for (u32 offset : it->second)
+            JITCompiler->PatchBlockLink(offset, NULL);
+    }
+}
+
+BlockProfile* GetBlockProfile(u32 num, u32 addr)
+{
+    auto it = BlockProfiles.find(((u64)num << 32) | addr);
+    return it != BlockProfiles.end() ? &it->second : NULL;
+}
+
+void ResetBlockProfile()
+{
+    for (auto& it : BlockProfiles)
+    {
+        it.second.Executions = 0;
+        it.second.Cycles = 0;
+    }
+}
+
+void DumpBlockProfile(int maxBlocks)
+{
+    std::vector<BlockProfile*> blocks;
+    u64 totalCycles = 0;
+    for (auto& it : BlockProfiles)
+    {
+        if (it.second.Executions)
+        {
+            blocks.push_back(&it.second);
+            totalCycles += it.second.Cycles;
+        }
+    }
+
+    std::sort(blocks.begin(), blocks.end(), [](BlockProfile* a, BlockProfile* b)
+    {
+        return a->Cycles > b->Cycles;
+    });
+
+    if (maxBlocks > (int)blocks.size())
+        maxBlocks = blocks.size();
+
+    printf("%d of %d executed blocks, sorted by cycles spent in them\n", maxBlocks, (int)blocks.size());
+    for (int i = 0; i < maxBlocks; i++)
+    {
+        BlockProfile* block = blocks[i];
+
+        printf("\nARM%d %08X (%s): %llu executions, %llu cycles (%.1f per execution, %.2f%%)\n",
+            block->Num ? 7 : 9, block->Addr, block->Thumb ? "THUMB" : "ARM",
+            (unsigned long long)block->Executions, (unsigned long long)block->Cycles,
+            (double)block->Cycles / block->Executions,
+            totalCycles ? block->Cycles * 100.0 / totalCycles : 0.0);
+
+        // there's no disassembler around, so it's just the raw instructions
+        for (size_t j = 0; j < block->Instrs.size(); j++)
+        {
+            if (block->Thumb)
+                printf("    %08X: %04X\n", block->Addr + (u32)j * 2, block->Instrs[j]);
+            else
+                printf("    %08X: %08X\n", block->Addr + (u32)j * 4, block->Instrs[j]);
+        }
+    }
+}
+
+void AddBlockToRanges(JitBlock* block)
+{
+    for (int j = 0; j < block->NumAddresses; j++)
+    {
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* region = CodeMemRegions[addr >> 27];
+
+        if (!PageContainsCode(&region[(addr & 0x7FFF000) / 512]))
+            ARMJIT_Memory::SetCodeProtection(addr >> 27, addr & 0x7FFFFFF, true);
+
+        AddressRange* range = &region[(addr & 0x7FFFFFF) / 512];
+        range->Code |= block->AddressMasks()[j];
+        range->Blocks.Add(block);
+    }
+}
+
+void RemoveBlockFromRanges(JitBlock* block)
+{
+    for (int j = 0; j < block->NumAddresses; j++)
+    {
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* region = CodeMemRegions[addr >> 27];
+        AddressRange* range = &region[(addr & 0x7FFFFFF) / 512];
+
+        bool removed = range->Blocks.RemoveByValue(block);
+        assert(removed);
+
+        // only keep the code bits of the blocks which are left
+        range->Code = 0;
+        for (int k = 0; k < range->Blocks.Length; k++)
+        {
+            JitBlock* other = range->Blocks[k];
+            for (int l = 0; l < other->NumAddresses; l++)
+            {
+                if (other->AddressRanges()[l] == addr)
+                    range->Code |= other->AddressMasks()[l];
+            }
+        }
+
+        if (range->Blocks.Length == 0
+            && !PageContainsCode(&region[(addr & 0x7FFF000) / 512]))
+        {
+            ARMJIT_Memory::SetCodeProtection(addr >> 27, addr & 0x7FFFFFF, false);
+        }
+    }
+}
+
+// makes a block which is already in the address ranges reachable
+void PublishBlock(JitBlock* block)
+{
+    if (block->Num == 0)
+        JitBlocks9[block->StartAddr] = block;
+    else
+        JitBlocks7[block->StartAddr] = block;
+
+    u32 localAddr = block->StartAddrLocal;
+    u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
+    *entry = ((u64)block->StartAddr | block->Num) << 32;
+    *entry |= JITCompiler->SubEntryOffset(block->EntryPoint);
+
+    JitEnableWrite();
+    LinkBlock(block);
+    JitEnableExecute();
+}
+
+void LockCompiler()
+{
+    Platform::Mutex_Lock(CompileLock);
+}
+
+void UnlockCompiler()
+{
+    Platform::Mutex_Unlock(CompileLock);
+}
+
+void CompileThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_JobStart);
+        if (!CompileThreadRunning)
+            break;
+
+        LockCompiler();
+        Job.EntryPoint = JITCompiler->CompileBlock(Job.CPU, Job.Thumb, Job.Instrs, Job.NumInstrs, Job.HasMemoryInstr);
+        Job.Links = JITCompiler->BlockLinks;
+        UnlockCompiler();
+
+        JobState = compileJob_Done;
+        Platform::Semaphore_Post(Sema_JobDone);
+    }
+}
+
+void StopCompileThread()
+{
+    if (!CompileThread)
+        return;
+
+    CompileThreadRunning = false;
+    Platform::Semaphore_Post(Sema_JobStart);
+    Platform::Thread_Wait(CompileThread);
+    Platform::Thread_Free(CompileThread);
+    CompileThread = NULL;
+}
+
+void StartCompileJob(ARM* cpu, JitBlock* block, bool thumb, FetchedInstr instrs[], int numInstrs, bool hasMemoryInstr)
+{
+    if (!CompileThread)
+    {
+        CompileThreadRunning = true;
+        CompileThread = Platform::Thread_Create(CompileThreadFunc);
+    }
+
+    // throwing out old code has to happen on this thread
+    JITCompiler->PrepareCodeSpace();
+
+    Job.CPU = cpu;
+    Job.Thumb = thumb;
+    Job.HasMemoryInstr = hasMemoryInstr;
+    Job.NumInstrs = numInstrs;
+    memcpy(Job.Instrs, instrs, numInstrs * sizeof(FetchedInstr));
+
+    AddBlockToRanges(block);
+    PendingBlock = block;
+    PendingBlockInvalidated = false;
+
+    JobState = compileJob_Running;
+    Platform::Semaphore_Post(Sema_JobStart);
+}
+
+// waits for the block which is compiled in the background
+// (if there is one) and makes it available
+void FinishCompileJob()
+{
+    if (JobState == compileJob_Idle)
+        return;
+
+    Platform::Semaphore_Wait(Sema_JobDone);
+    JobState = compileJob_Idle;
+
+    JitBlock* block = PendingBlock;
+    PendingBlock = NULL;
+
+    if (PendingBlockInvalidated)
+    {
+        // it was already taken out of the address ranges
+        delete block;
+        return;
+    }
+
+    auto& map = block->Num == 0 ? JitBlocks9 : JitBlocks7;
+    if (map.find(block->StartAddr) != map.end())
+    {
+        // a block for the same address was restored in the meantime
+        RemoveBlockFromRanges(block);
+        delete block;
+        return;
+    }
+
+    block->EntryPoint = Job.EntryPoint;
+    for (const BlockLink& link : Job.Links)
+        block->Links.Add(link);
+
+    JIT_DEBUGPRINT("block start %p (background)\n", block->EntryPoint);
+
+    PublishBlock(block);
+}
+
+void DiscardCompileJob()
+{
+    if (JobState == compileJob_Idle)
+        return;
+
+    Platform::Semaphore_Wait(Sema_JobDone);
+    JobState = compileJob_Idle;
+
+    if (!PendingBlockInvalidated)
+        RemoveBlockFromRanges(PendingBlock);
+    delete PendingBlock;
+    PendingBlock = NULL;
+}
+
+void MemoryMapChanged()
+{
+    // the block being compiled was fetched with the old memory map
+    // and timings, it's thrown away once the compiler is done with it
+    if (PendingBlock && !PendingBlockInvalidated)
+    {
+        RemoveBlockFromRanges(PendingBlock);
+        PendingBlockInvalidated = true;
+    }
+}
+
 void RetireJitBlock(JitBlock* block)
 {
     auto it = RestoreCandidates.find(block->InstrHash);
@@ -574,11 +1086,19 @@ void CompileBlock(ARM* cpu)
 {
     bool thumb = cpu->CPSR & 0x20;
 
+    bool background = Compiler::BackgroundCompile && Config::JIT_BackgroundCompile;
+    if (!background)
+        FinishCompileJob();
+    else if (JobState == compileJob_Done)
+        FinishCompileJob();
+
     if (Config::JIT_MaxBlockSize < 1)
         Config::JIT_MaxBlockSize = 1;
     if (Config::JIT_MaxBlockSize > 32)
         Config::JIT_MaxBlockSize = 32;
 
+    ARMJIT_Cache::Open();
+
     u32 blockAddr = cpu->R[15] - (thumb ? 2 : 4);
 
     u32 localAddr = LocaliseCodeAddress(cpu->Num, blockAddr);
@@ -607,7 +1127,10 @@ void CompileBlock(ARM* cpu)
         }
 
         // some memory has been remapped
-        RetireJitBlock(existingBlockIt->second);        
+        JitEnableWrite();
+        UnlinkBlock(existingBlockIt->second);
+        JitEnableExecute();
+        RetireJitBlock(existingBlockIt->second);
         map.erase(existingBlockIt);
     }
 
@@ -649,6 +1172,7 @@ void CompileBlock(ARM* cpu)
 
         instrs[i].BranchFlags = 0;
         instrs[i].SetFlags = 0;
+        instrs[i].HasLiteral = false;
         instrs[i].Instr = nextInstr[0];
         nextInstr[0] = nextInstr[1];
 
@@ -769,6 +1293,8 @@ void CompileBlock(ARM* cpu)
                 addressMasks[j] |= 1 << ((translatedAddr & 0x1FF) / 16);
                 JIT_DEBUGPRINT("literal loading %08x %08x %08x %08x\n", literalAddr, translatedAddr, addressMasks[j], addressRanges[j]);
                 cpu->DataRead32(literalAddr, &literalValues[numLiterals]);
+                instrs[i].HasLiteral = true;
+                instrs[i].LiteralValue = literalValues[numLiterals];
                 literalLoadAddrs[numLiterals++] = translatedAddr;
             }
         }
@@ -869,6 +1395,7 @@ void CompileBlock(ARM* cpu)
 
     if (numLiterals)
     {
+        bool literalsWritten = false;
         for (u32 j = 0; j < numWriteAddrs; j++)
         {
             u32 translatedAddr = LocaliseCodeAddress(cpu->Num, writeAddrs[j]);
@@ -880,11 +1407,24 @@ void CompileBlock(ARM* cpu)
                     {
                         if (InvalidLiterals.Find(translatedAddr) == -1)
                             InvalidLiterals.Add(translatedAddr);
+                        literalsWritten = true;
                         break;
                     }
                 }
             }
         }
+
+        // the block itself writes to some of its literals, those can't be inlined
+        if (literalsWritten)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                u32 literalAddr;
+                if (instrs[j].HasLiteral && DecodeLiteral(thumb, instrs[j], literalAddr)
+                    && InvalidLiterals.Find(LocaliseCodeAddress(cpu->Num, literalAddr)) != -1)
+                    instrs[j].HasLiteral = false;
+            }
+        }
     }
 
     u32 literalHash = (u32)XXH3_64bits(literalValues, numLiterals * 4);
@@ -898,7 +1438,8 @@ void CompileBlock(ARM* cpu)
         prevBlock = prevBlockIt->second;
         RestoreCandidates.erase(prevBlockIt);
 
-        mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash;
+        mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->StartAddrLocal == localAddr
+            && prevBlock->Num == cpu->Num && prevBlock->LiteralHash == literalHash;
 
         if (mayRestore && prevBlock->NumAddresses == numAddressRanges)
         {
@@ -926,6 +1467,10 @@ void CompileBlock(ARM* cpu)
         if (prevBlock)
             delete prevBlock;
 
+        // the compiler is still busy, for now this block was only interpreted
+        if (background && JobState != compileJob_Idle)
+            return;
+
         block = new JitBlock(cpu->Num, i, numAddressRanges, numLiterals);
         block->LiteralHash = literalHash;
         block->InstrHash = instrHash;
@@ -939,12 +1484,38 @@ void CompileBlock(ARM* cpu)
         block->StartAddr = blockAddr;
         block->StartAddrLocal = localAddr;
 
+        if (EvictedBlocks.erase(((u64)cpu->Num << 32) | blockAddr))
+            NumRecompiledBlocks++;
+
         FloodFillSetFlags(instrs, i - 1, 0xF);
-        
+
+        SnapshotMemoryState(cpu, thumb, instrs, i);
+
+        if (Config::JIT_ProfileBlocks)
+        {
+            BlockProfile& profile = BlockProfiles[((u64)cpu->Num << 32) | blockAddr];
+            profile.Num = cpu->Num;
+            profile.Addr = blockAddr;
+            profile.Thumb = thumb;
+            profile.Instrs.clear();
+            for (int j = 0; j < i; j++)
+                profile.Instrs.push_back(thumb ? (instrs[j].Instr & 0xFFFF) : instrs[j].Instr);
+        }
+
+        if (background)
+        {
+            StartCompileJob(cpu, block, thumb, instrs, i, hasMemoryInstr);
+            return;
+        }
+
         JitEnableWrite();
+        JITCompiler->PrepareCodeSpace();
         block->EntryPoint = JITCompiler->CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
         JitEnableExecute();
 
+        for (const BlockLink& link : JITCompiler->BlockLinks)
+            block->Links.Add(link);
+
         JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
     }
     else
@@ -959,25 +1530,10 @@ void CompileBlock(ARM* cpu)
         assert(addressRanges[j] == block->AddressRanges()[j]);
         assert(addressMasks[j] == block->AddressMasks()[j]);
         assert(addressMasks[j] != 0);
-
-        AddressRange* region = CodeMemRegions[addressRanges[j] >> 27];
-
-        if (!PageContainsCode(&region[(addressRanges[j] & 0x7FFF000) / 512]))
-            ARMJIT_Memory::SetCodeProtection(addressRanges[j] >> 27, addressRanges[j] & 0x7FFFFFF, true);
-
-        AddressRange* range = &region[(addressRanges[j] & 0x7FFFFFF) / 512];
-        range->Code |= addressMasks[j];
-        range->Blocks.Add(block);
     }
 
-    if (cpu->Num == 0)
-        JitBlocks9[blockAddr] = block;
-    else
-        JitBlocks7[blockAddr] = block;
-
-    u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
-    *entry = ((u64)blockAddr | cpu->Num) << 32;
-    *entry |= JITCompiler->SubEntryOffset(block->EntryPoint);
+    AddBlockToRanges(block);
+    PublishBlock(block);
 }
 
 void InvalidateByAddr(u32 localAddr)
@@ -1057,12 +1613,23 @@ void InvalidateByAddr(u32 localAddr)
             }
         }
 
+        if (block == PendingBlock)
+        {
+            // it's still being compiled, it's thrown away once that's done
+            PendingBlockInvalidated = true;
+            continue;
+        }
+
         FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
         if (block->Num == 0)
             JitBlocks9.erase(block->StartAddr);
         else
             JitBlocks7.erase(block->StartAddr);
 
+        JitEnableWrite();
+        UnlinkBlock(block);
+        JitEnableExecute();
+
         if (!literalInvalidation)
         {
             RetireJitBlock(block);
@@ -1074,6 +1641,56 @@ void InvalidateByAddr(u32 localAddr)
     }
 }
 
+void EvictBlocks(u8* start, u8* end)
+{
+    auto inRange = [=](JitBlock* block)
+    {
+        return (u8*)block->EntryPoint >= start && (u8*)block->EntryPoint < end;
+    };
+
+    NumCodeEvictions++;
+
+    for (auto it = RestoreCandidates.begin(); it != RestoreCandidates.end();)
+    {
+        if (inRange(it->second))
+        {
+            delete it->second;
+            it = RestoreCandidates.erase(it);
+        }
+        else
+            it++;
+    }
+
+    for (int num = 0; num < 2; num++)
+    {
+        auto& map = num == 0 ? JitBlocks9 : JitBlocks7;
+        for (auto it = map.begin(); it != map.end();)
+        {
+            JitBlock* block = it->second;
+            if (!inRange(block))
+            {
+                it++;
+                continue;
+            }
+
+            RemoveBlockFromRanges(block);
+
+            // another mirror might have taken over this entry in the meantime
+            u64* entry = &FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+            if ((u32)*entry == JITCompiler->SubEntryOffset(block->EntryPoint))
+                *entry = (u64)UINT32_MAX << 32;
+
+            UnlinkBlock(block);
+
+            EvictedBlocks.insert(((u64)block->Num << 32) | block->StartAddr);
+            NumEvictedBlocks++;
+
+            delete block;
+            it = map.erase(it);
+        }
+    }
+}
+
 void CheckAndInvalidateITCM()
 {
     for (u32 i = 0; i < ITCMPhysicalSize; i+=16)
@@ -1144,6 +1761,10 @@ void ResetBlockCache()
 {
     printf("Resetting JIT block cache...\n");
 
+    DiscardCompileJob();
+
+    ARMJIT_Cache::Stash();
+
     // could be replace through a function which only resets
     // the permissions but we're too lazy
     ARMJIT_Memory::Reset();
@@ -1183,8 +1804,13 @@ void ResetBlockCache()
     }
     JitBlocks9.clear();
     JitBlocks7.clear();
+    EvictedBlocks.clear();
+    IncomingLinks.clear();
+    BlockProfiles.clear();
 
     JITCompiler->Reset();
+
+    ARMJIT_Cache::Unstash();
 }
 
 void JitEnableWrite()
@@ -49,6 +49,22 @@ void CompileBlock(ARM* cpu);
 
 void ResetBlockCache();
 
+// to be called whenever the memory mappings or timings change
+void MemoryMapChanged();
+
+// how often a part of the code buffer had to be reclaimed, how many blocks
+// were thrown out by that and how many of those had to be compiled again
+// reset along with the JIT
+extern u32 NumCodeEvictions;
+extern u32 NumEvictedBlocks;
+extern u32 NumRecompiledBlocks;
+
+// with JIT_ProfileBlocks every compiled block counts how often it's run
+// and how many cycles were spent in it, this prints the hottest ones
+// the statistics are thrown away with the block cache
+void ResetBlockProfile();
+void DumpBlockProfile(int maxBlocks);
+
 JitBlockEntry LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr);
 bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size);
 
@@ -28,6 +28,7 @@
 #include "../ARMJIT_RegisterCache.h"
 
 #include <unordered_map>
+#include <vector>
 
 namespace ARMJIT
 {
@@ -109,6 +110,10 @@ public:
         return RegCache.Mapping[reg];
     }
 
+    // compiling a block here may reset the whole block cache
+    // so it can't be done on another thread
+    static const bool BackgroundCompile = false;
+    void PrepareCodeSpace() {}
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr);
 
     bool CanCompile(bool thumb, u16 kind);
@@ -120,6 +125,17 @@ public:
 
     void Reset();
 
+    // used by the disk cache (see ARMJIT_Cache.cpp)
+    // not supported here, calls which are out of range for BL are made
+    // through absolute addresses, so the code isn't position independent
+    bool SaveCode(std::vector<u8>& data) { return false; }
+    bool LoadCode(const u8* data, u32 size) { return false; }
+
+    // blocks aren't linked to each other here yet, every block
+    // returns to the dispatcher
+    std::vector<BlockLink> BlockLinks;
+    void PatchBlockLink(u32 offset, JitBlockEntry entry) {}
+
     void Comp_AddCycles_C(bool forceNonConstant = false);
     void Comp_AddCycles_CI(u32 numI);
     void Comp_AddCycles_CI(u32 c, Arm64Gen::ARM64Reg numI, Arm64Gen::ArithOption shift);
@@ -0,0 +1,359 @@
+/*
+    Copyright 2016-2021 Arisotura, RSDuck
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+#include "ARMJIT_Cache.h"
+#include "ARMJIT_Internal.h"
+#include "ARMJIT_Compiler.h"
+#include "Config.h"
+#include "NDS.h"
+#include "NDSCart.h"
+#include "Platform.h"
+
+/*
+    JIT cache format
+
+    header:
+    00 - magic MJIT
+    04 - version
+    08 - hash of the build and the JIT settings
+    10 - hash of everything after the header
+    18 - number of blocks
+    1C - reserved
+
+    block:
+    00 - start address
+    04 - local start address
+    08 - instruction hash
+    0C - literal hash
+    10 - entry point offset
+    14 - CPU number
+    15 - reserved
+    16 - number of address ranges
+    18 - number of literals
+    1A - number of links
+    1C - address ranges, address masks, literal addresses (32-bit each)
+    followed by the links: target address, offset of the jump (32-bit each)
+
+    the blocks are followed by the compiled code, which is up to the backend
+
+    Implementation details
+
+    The compiled code is put back at the same place in the code memory it
+    was compiled at, so that it stays valid without having to relocate every
+    call. The backend patches up whatever else depends on the current run.
+    Links between blocks are all undone after loading, they're made again
+    once the blocks are actually in use.
+    Blocks aren't used as is, they merely become candidates for restoring,
+    so before one gets used again its instructions and literals have to hash
+    to the same values as the guest code which is actually there.
+*/
+
+namespace ARMJIT_Cache
+{
+
+using namespace ARMJIT;
+
+const u32 Version = 4;
+const u32 HeaderSize = 0x20;
+
+bool Opened = false;
+bool Active = false;
+char FileName[64];
+
+std::vector<u8> Stashed;
+
+
+// the cached code calls into the binary, so it's only valid for the exact
+// build which generated it. The compiler's CodeFingerprint catches
+// builds which are different without anyone telling us
+const char BuildID[] = MELONDS_VERSION
+#ifdef GIT_VERSION
+    GIT_VERSION
+#endif
+#ifdef __VERSION__
+    " " __VERSION__
+#endif
+    " " __DATE__ " " __TIME__;
+
+u64 SettingsHash()
+{
+    s32 settings[] =
+    {
+        NDS::ConsoleType,
+        Config::JIT_MaxBlockSize,
+        Config::JIT_BranchOptimisations,
+        Config::JIT_LiteralOptimisations,
+        Config::JIT_FastMemory,
+    };
+    return XXH3_64bits_withSeed(settings, sizeof(settings), XXH3_64bits(BuildID, sizeof(BuildID)));
+}
+
+void Put(std::vector<u8>& data, const void* ptr, u32 len)
+{
+    data.insert(data.end(), (const u8*)ptr, (const u8*)ptr + len);
+}
+
+void PutBlock(std::vector<u8>& data, JitBlock* block)
+{
+    u32 entry = JITCompiler->SubEntryOffset(block->EntryPoint);
+    u8 reserved = 0;
+
+    Put(data, &block->StartAddr, 4);
+    Put(data, &block->StartAddrLocal, 4);
+    Put(data, &block->InstrHash, 4);
+    Put(data, &block->LiteralHash, 4);
+    Put(data, &entry, 4);
+    Put(data, &block->Num, 1);
+    Put(data, &reserved, 1);
+    Put(data, &block->NumAddresses, 2);
+    Put(data, &block->NumLiterals, 2);
+    Put(data, &block->Links.Length, 2);
+    Put(data, block->AddressRanges(), (block->NumAddresses * 2 + block->NumLiterals) * 4);
+    for (int i = 0; i < block->Links.Length; i++)
+    {
+        Put(data, &block->Links[i].Target, 4);
+        Put(data, &block->Links[i].Offset, 4);
+    }
+}
+
+bool SaveImage(std::vector<u8>& data)
+{
+    data.resize(HeaderSize);
+
+    u32 numBlocks = 0;
+    for (auto& it : JitBlocks9)
+    {
+        PutBlock(data, it.second);
+        numBlocks++;
+    }
+    for (auto& it : JitBlocks7)
+    {
+        PutBlock(data, it.second);
+        numBlocks++;
+    }
+    // those were invalidated, but might come back
+    for (auto& it : RestoreCandidates)
+    {
+        PutBlock(data, it.second);
+        numBlocks++;
+    }
+
+    if (!JITCompiler->SaveCode(data))
+        return false;
+
+    u64 settings = SettingsHash();
+    u64 checksum = XXH3_64bits(&data[HeaderSize], data.size() - HeaderSize);
+    memset(&data[0], 0, HeaderSize);
+    memcpy(&data[0x00], "MJIT", 4);
+    memcpy(&data[0x04], &Version, 4);
+    memcpy(&data[0x08], &settings, 8);
+    memcpy(&data[0x10], &checksum, 8);
+    memcpy(&data[0x18], &numBlocks, 4);
+
+    return true;
+}
+
+bool LoadImage(const std::vector<u8>& data)
+{
+    if (data.size() < HeaderSize || memcmp(&data[0], "MJIT", 4))
+        return false;
+
+    u32 version, numBlocks;
+    u64 settings, checksum;
+    memcpy(&version, &data[0x04], 4);
+    memcpy(&settings, &data[0x08], 8);
+    memcpy(&checksum, &data[0x10], 8);
+    memcpy(&numBlocks, &data[0x18], 4);
+
+    if (version != Version || settings != SettingsHash()
+        || checksum != XXH3_64bits(&data[HeaderSize], data.size() - HeaderSize))
+        return false;
+
+    std::vector<JitBlock*> blocks;
+    auto freeBlocks = [&]()
+    {
+        for (JitBlock* block : blocks)
+            delete block;
+        return false;
+    };
+
+    u32 pos = HeaderSize;
+    for (u32 i = 0; i < numBlocks; i++)
+    {
+        if (data.size() - pos < 0x1C)
+            return freeBlocks();
+
+        u32 startAddr, startAddrLocal, instrHash, literalHash, entry;
+        u16 numAddresses, numLiterals, numLinks;
+        memcpy(&startAddr, &data[pos+0x00], 4);
+        memcpy(&startAddrLocal, &data[pos+0x04], 4);
+        memcpy(&instrHash, &data[pos+0x08], 4);
+        memcpy(&literalHash, &data[pos+0x0C], 4);
+        memcpy(&entry, &data[pos+0x10], 4);
+        u8 num = data[pos+0x14];
+        memcpy(&numAddresses, &data[pos+0x16], 2);
+        memcpy(&numLiterals, &data[pos+0x18], 2);
+        memcpy(&numLinks, &data[pos+0x1A], 2);
+        pos += 0x1C;
+
+        u32 len = (numAddresses * 2 + numLiterals) * 4;
+        if (num > 1 || data.size() - pos < len + numLinks * 8)
+            return freeBlocks();
+
+        JitBlock* block = new JitBlock(num, literalHash, numAddresses, numLiterals);
+        block->StartAddr = startAddr;
+        block->StartAddrLocal = startAddrLocal;
+        block->InstrHash = instrHash;
+        block->LiteralHash = literalHash;
+        block->EntryPoint = JITCompiler->AddEntryOffset(entry);
+        memcpy(block->AddressRanges(), &data[pos], len);
+        pos += len;
+        for (u32 j = 0; j < numLinks; j++)
+        {
+            BlockLink link;
+            memcpy(&link.Target, &data[pos], 4);
+            memcpy(&link.Offset, &data[pos+4], 4);
+            block->Links.Add(link);
+            pos += 8;
+        }
+
+        blocks.push_back(block);
+    }
+
+    JitEnableWrite();
+    bool loaded = JITCompiler->LoadCode(&data[pos], data.size() - pos);
+    if (loaded)
+    {
+        for (JitBlock* block : blocks)
+        {
+            for (int i = 0; i < block->Links.Length; i++)
+                JITCompiler->PatchBlockLink(block->Links[i].Offset, NULL);
+        }
+    }
+    JitEnableExecute();
+    if (!loaded)
+        return freeBlocks();
+
+    for (JitBlock* block : blocks)
+    {
+        auto it = RestoreCandidates.find(block->InstrHash);
+        if (it != RestoreCandidates.end())
+        {
+            delete it->second;
+            it->second = block;
+        }
+        else
+        {
+            RestoreCandidates[block->InstrHash] = block;
+        }
+    }
+
+    return true;
+}
+
+void Open()
+{
+    if (Opened) return;
+    Opened = true;
+
+    // profiled code has pointers to this session's counters baked in
+    if (!Config::JIT_DiskCache || Config::JIT_ProfileBlocks || !NDSCart::CartROM)
+        return;
+
+    u64 key = XXH3_64bits_withSeed(&NDSCart::Header, sizeof(NDSHeader), SettingsHash());
+    snprintf(FileName, sizeof(FileName), "jitcache_%016llx.bin", (unsigned long long)key);
+    Active = true;
+
+    FILE* f = Platform::OpenLocalFile(FileName, "rb");
+    if (!f) return;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    std::vector<u8> data;
+    if (len > 0)
+    {
+        data.resize(len);
+        if (fread(&data[0], len, 1, f) != 1)
+            data.clear();
+    }
+    fclose(f);
+
+    if (LoadImage(data))
+        printf("JIT cache: restored %u blocks from %s\n", (u32)RestoreCandidates.size(), FileName);
+    else
+        printf("JIT cache: %s is outdated or broken, ignoring it\n", FileName);
+}
+
+void Close()
+{
+    if (Active)
+    {
+        std::vector<u8> data;
+        if (SaveImage(data))
+        {
+            // the old file is only replaced once the new one is completely written
+            char tmpName[sizeof(FileName) + 4];
+            snprintf(tmpName, sizeof(tmpName), "%s.tmp", FileName);
+
+            bool ok = false;
+            FILE* f = Platform::OpenLocalFile(tmpName, "wb");
+            if (f)
+            {
+                ok = fwrite(&data[0], data.size(), 1, f) == 1;
+                if (fclose(f) != 0) ok = false;
+            }
+            if (ok) ok = Platform::RenameLocalFile(tmpName, FileName);
+
+            // a leftover temporary file is simply overwritten the next time
+            if (!ok)
+                printf("JIT cache: failed to write %s\n", FileName);
+        }
+    }
+
+    Opened = false;
+    Active = false;
+    std::vector<u8>().swap(Stashed);
+}
+
+void Stash()
+{
+    if (!Active) return;
+
+    Stashed.clear();
+    if (!SaveImage(Stashed))
+        Stashed.clear();
+}
+
+void Unstash()
+{
+    if (!Active || Stashed.empty()) return;
+
+    LoadImage(Stashed);
+    std::vector<u8>().swap(Stashed);
+}
+
+}
@@ -0,0 +1,42 @@
+/*
+    Copyright 2016-2021 Arisotura, RSDuck
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_CACHE_H
+#define ARMJIT_CACHE_H
+
+#include "types.h"
+
+// keeps the compiled code around between runs of the same game
+// (if enabled with Config::JIT_DiskCache)
+namespace ARMJIT_Cache
+{
+
+// opens the cache for the game which is currently loaded
+// and puts its blocks up for restoring, does nothing once opened
+void Open();
+// writes the compiled code back to disk and forgets about the game
+void Close();
+
+// to be called around resetting the block cache while running,
+// so blocks compiled so far aren't thrown away
+void Stash();
+void Unstash();
+
+}
+
+#endif
@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <unordered_map>
+#include <vector>
 
 #include "ARMJIT.h"
 #include "ARMJIT_Memory.h"
@@ -66,6 +68,22 @@ struct FetchedInstr
     u16 CodeCycles;
     u32 DataRegion;
 
+    // loads from literal pools which may be inlined
+    // get the (aligned) word they load from along
+    bool HasLiteral;
+    u32 LiteralValue;
+
+    // the parts of the memory map and timings the compiler needs,
+    // looked up while the block is fetched. This way a block which
+    // is compiled in the background never looks at the live state
+    u8 DataRegionType; // ClassifyAddress9/7(DataRegion)
+    void* DataFuncs[3]; // GetFuncForAddr(DataRegion) for 8, 16 and 32 bit accesses
+    u8 NonSeqCodeCycles; // ARM7 only
+    u8 SeqCodeCycles;
+    // of a branch with a constant target, see Comp_JumpTo()
+    u8 JumpRegionCodeCycles;
+    u8 JumpCycles;
+
     ARMInstrInfo::Info Info;
 };
 
@@ -171,6 +189,26 @@ struct __attribute__((packed)) TinyVector
     }
 };
 
+// a jump at the end of a block which can go straight into another one
+struct BlockLink
+{
+    u32 Target; // address of the block it leads to
+    u32 Offset; // of the end of the jump, relative to the code memory (like entry points)
+};
+
+// execution statistics for the code at one address, they're kept
+// when the block there gets recompiled
+struct BlockProfile
+{
+    u64 Executions;
+    u64 Cycles;
+
+    u32 Num;
+    u32 Addr;
+    bool Thumb;
+    std::vector<u32> Instrs; // of the last block compiled there
+};
+
 class JitBlock
 {
 public:
@@ -191,6 +229,8 @@ public:
 
     JitBlockEntry EntryPoint;
 
+    TinyVector<BlockLink> Links;
+
     u32* AddressRanges()
     { return &Data[0]; }
     u32* AddressMasks()
@@ -216,6 +256,10 @@ extern InterpreterFunc InterpretTHUMB[];
 
 extern TinyVector<u32> InvalidLiterals;
 
+extern std::unordered_map<u32, JitBlock*> JitBlocks9;
+extern std::unordered_map<u32, JitBlock*> JitBlocks7;
+extern std::unordered_map<u32, JitBlock*> RestoreCandidates;
+
 extern AddressRange* const CodeMemRegions[ARMJIT_Memory::memregions_Count];
 
 inline bool PageContainsCode(AddressRange* range)
@@ -230,8 +274,24 @@ inline bool PageContainsCode(AddressRange* range)
 
 u32 LocaliseCodeAddress(u32 num, u32 addr);
 
-template <u32 Num>
-void LinkBlock(ARM* cpu, u32 codeOffset);
+// throws out every block whose code starts within [start, end)
+// so that part of the code buffer can be reused
+void EvictBlocks(u8* start, u8* end);
+
+// returns NULL if the block isn't being profiled
+BlockProfile* GetBlockProfile(u32 num, u32 addr);
+
+// held while a block is compiled in the background, anything
+// else which modifies the compiler's state has to take it too
+void LockCompiler();
+void UnlockCompiler();
+
+// only blocks at addresses which always map to the same memory can be jumped
+// to directly, for everything else we need to go through the block lookup
+inline bool CanLinkTo(u32 num, u32 addr)
+{
+    return (addr >> 24) == 0x02 || (num == 1 && (addr & 0xFF800000) == 0x03800000);
+}
 
 template <typename T, int ConsoleType> T SlowRead9(u32 addr, ARMv5* cpu);
 template <typename T, int ConsoleType> void SlowWrite9(u32 addr, ARMv5* cpu, u32 val);
@@ -480,6 +480,8 @@ void SetCodeProtection(int region, u32 offset, bool protect)
 
 void RemapDTCM(u32 newBase, u32 newSize)
 {
+    ARMJIT::MemoryMapChanged();
+
     // this first part could be made more efficient
     // by unmapping DTCM first and then map the holes
     u32 oldDTCMBase = NDS::ARM9->DTCMBase;
@@ -527,6 +529,8 @@ void RemapDTCM(u32 newBase, u32 newSize)
 
 void RemapNWRAM(int num)
 {
+    ARMJIT::MemoryMapChanged();
+
     for (int i = 0; i < Mappings[memregion_SharedWRAM].Length;)
     {
         Mapping& mapping = Mappings[memregion_SharedWRAM][i];
@@ -550,6 +554,8 @@ void RemapNWRAM(int num)
 
 void RemapSWRAM()
 {
+    ARMJIT::MemoryMapChanged();
+
     printf("remapping SWRAM\n");
     for (int i = 0; i < Mappings[memregion_WRAM7].Length;)
     {
@@ -686,7 +692,11 @@ bool FaultHandler(FaultDescription& faultDesc)
             rewriteToSlowPath = !MapAtAddress(faultDesc.EmulatedFaultAddr);
 
         if (rewriteToSlowPath)
+        {
+            ARMJIT::LockCompiler();
             faultDesc.FaultPC = ARMJIT::JITCompiler->RewriteMemAccess(faultDesc.FaultPC);
+            ARMJIT::UnlockCompiler();
+        }
 
         return true;
     }
@@ -26,6 +26,9 @@
 
 #include "../dolphin/CommonFuncs.h"
 
+#define XXH_STATIC_LINKING_ONLY
+#include "../xxhash/xxhash.h"
+
 #ifdef _WIN32
 #include <windows.h>
 #else
@@ -235,6 +238,20 @@ u8 CodeMemory[1024 * 1024 * 32];
 
 Compiler::Compiler()
 {
+    PerfMap = NULL;
+    Profile = NULL;
+#ifdef __linux__
+    if (Config::JIT_PerfMap)
+    {
+        // perf looks here for symbols of JIT code
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        PerfMap = fopen(path, "w");
+        if (!PerfMap)
+            printf("JIT: couldn't create perf map %s\n", path);
+    }
+#endif
+
     {
     #ifdef _WIN32
         SYSTEM_INFO sysInfo;
@@ -300,9 +317,7 @@ Compiler::Compiler()
         MOV(32, R(RSCRATCH3), MComplex(RCPU, RSCRATCH2, SCALE_4, offsetof(ARM, R_UND)));
         RET();
 
-#ifdef JIT_PROFILING_ENABLED
         CreateMethod("ReadBanked", ReadBanked);
-#endif
     }
     {
         // RSCRATCH  mode
@@ -347,9 +362,7 @@ Compiler::Compiler()
         CLC();
         RET();
 
-#ifdef JIT_PROFILING_ENABLED
         CreateMethod("WriteBanked", WriteBanked);
-#endif
     }
 
     for (int consoleType = 0; consoleType < 2; consoleType++)
@@ -410,9 +423,7 @@ Compiler::Compiler()
                     ABI_PopRegistersAndAdjustStack(CallerSavedPushRegs, 8);
                     RET();
 
-#ifdef JIT_PROFILING_ENABLED
                     CreateMethod("FastMemStorePatch%d_%d_%d", PatchedStoreFuncs[consoleType][num][size][reg], num, size, reg);
-#endif
 
                     for (int signextend = 0; signextend < 2; signextend++)
                     {
@@ -453,15 +464,30 @@ Compiler::Compiler()
                             MOVZX(32, 8 << size, rdMapped, R(RSCRATCH));
                         RET();
 
-#ifdef JIT_PROFILING_ENABLED
                         CreateMethod("FastMemLoadPatch%d_%d_%d_%d", PatchedLoadFuncs[consoleType][num][size][signextend][reg], num, size, reg, signextend);
-#endif
                     }
                 }
             }
         }
     }
 
+    {
+        // code from the disk cache calls into the generated functions and the binary
+        // with relative offsets. The cache files are keyed on the build already,
+        // as a second line of defense the generated functions are fingerprinted
+        // together with their distance to a couple of functions in the binary
+        u8* codeStart = GetWritableCodePtr();
+        std::vector<s64> distances;
+        distances.push_back((u8*)&ARM_Ret - codeStart);
+        for (int i = 0; i < ARMInstrInfo::ak_Count; i++)
+            distances.push_back((u8*)InterpretARM[i] - codeStart);
+        for (int i = 0; i < ARMInstrInfo::tk_Count; i++)
+            distances.push_back((u8*)InterpretTHUMB[i] - codeStart);
+
+        CodeFingerprint = XXH3_64bits_withSeed(distances.data(), distances.size() * sizeof(s64),
+            XXH3_64bits(ResetStart, codeStart - ResetStart));
+    }
+
     // move the region forward to prevent overwriting the generated functions
     CodeMemSize -= GetWritableCodePtr() - ResetStart;
     ResetStart = GetWritableCodePtr();
@@ -507,8 +533,10 @@ void Compiler::SaveReg(int reg, X64Reg nativeReg)
 Gen::FixupBranch Compiler::CheckCondition(u32 cond)
 {
     // hack, ldm/stm can get really big TODO: make this better
-    bool ldmStm = !Thumb &&
-        (CurInstr.Info.Kind == ARMInstrInfo::ak_LDM || CurInstr.Info.Kind == ARMInstrInfo::ak_STM);
+    // same goes for branches which exit the block from the middle
+    bool longJump = (!Thumb &&
+        (CurInstr.Info.Kind == ARMInstrInfo::ak_LDM || CurInstr.Info.Kind == ARMInstrInfo::ak_STM))
+        || (CurInstr.BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
     if (cond >= 0x8)
     {
         static_assert(RSCRATCH3 == ECX, "RSCRATCH has to be equal to ECX!");
@@ -518,14 +546,14 @@ Gen::FixupBranch Compiler::CheckCondition(u32 cond)
         SHL(32, R(RSCRATCH), R(RSCRATCH3));
         TEST(32, R(RSCRATCH), Imm32(ARM::ConditionTable[cond]));
 
-        return J_CC(CC_Z, ldmStm);
+        return J_CC(CC_Z, longJump);
     }
     else
     {
         // could have used a LUT, but then where would be the fun?
         TEST(32, R(RCPSR), Imm32(1 << (28 + ((~(cond >> 1) & 1) << 1 | (cond >> 2 & 1) ^ (cond >> 1 & 1)))));
 
-        return J_CC(cond & 1 ? CC_NZ : CC_Z, ldmStm);
+        return J_CC(cond & 1 ? CC_NZ : CC_Z, longJump);
     }
 }
 
@@ -654,15 +682,222 @@ bool Compiler::CanCompile(bool thumb, u16 kind)
     return (thumb ? T_Comp[kind] : A_Comp[kind]) != NULL;
 }
 
+Compiler::~Compiler()
+{
+    if (PerfMap)
+        fclose(PerfMap);
+}
+
 void Compiler::Reset()
 {
+    if (PerfMap)
+        fflush(PerfMap);
+
     memset(ResetStart, 0xcc, CodeMemSize);
     SetCodePtr(ResetStart);
 
     NearCode = NearStart;
     FarCode = FarStart;
 
+    CurSegment = 0;
+    SegmentsWrapped = false;
+
     LoadStorePatches.clear();
+    FastMemBaseSites.clear();
+}
+
+void Compiler::NextCodeSegment()
+{
+    CurSegment = (CurSegment + 1) % CodeSegments;
+    if (CurSegment == 0)
+        SegmentsWrapped = true;
+
+    u8* nearStart = NearStart + CurSegment * (NearSize / CodeSegments);
+    u8* nearEnd = nearStart + NearSize / CodeSegments;
+    u8* farStart = FarStart + CurSegment * (FarSize / CodeSegments);
+    u8* farEnd = farStart + FarSize / CodeSegments;
+
+    if (SegmentsWrapped)
+    {
+        // the blocks compiled into this segment in the last round are the oldest ones
+        ARMJIT::EvictBlocks(nearStart, nearEnd);
+
+        auto inSegment = [=](u8* ptr)
+        {
+            return (ptr >= nearStart && ptr < nearEnd) || (ptr >= farStart && ptr < farEnd);
+        };
+        for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+        {
+            if (inSegment(it->first))
+                it = LoadStorePatches.erase(it);
+            else
+                it++;
+        }
+        for (auto it = FastMemBaseSites.begin(); it != FastMemBaseSites.end();)
+        {
+            if (inSegment(ResetStart + it->first))
+                it = FastMemBaseSites.erase(it);
+            else
+                it++;
+        }
+
+        memset(nearStart, 0xcc, nearEnd - nearStart);
+        memset(farStart, 0xcc, farEnd - farStart);
+    }
+
+    SetCodePtr(nearStart);
+    NearCode = nearStart;
+    FarCode = farStart;
+}
+
+bool Compiler::SaveCode(std::vector<u8>& data)
+{
+    auto put = [&](const void* ptr, u32 len)
+    {
+        data.insert(data.end(), (const u8*)ptr, (const u8*)ptr + len);
+    };
+
+    // blocks are scattered all over the place once
+    // the segments have been cycled through
+    if (SegmentsWrapped)
+        return false;
+
+    u32 nearLen = GetWritableCodePtr() - NearStart;
+    u32 farLen = FarCode - FarStart;
+
+    put(&CodeFingerprint, 8);
+    put(&nearLen, 4);
+    put(NearStart, nearLen);
+    put(&farLen, 4);
+    put(FarStart, farLen);
+
+    u32 numPatches = LoadStorePatches.size();
+    put(&numPatches, 4);
+    for (auto& it : LoadStorePatches)
+    {
+        u32 offset = it.first - ResetStart;
+        // either one of the functions generated in front of the code area
+        // or a slow path in far code
+        s32 patchFunc = (u8*)it.second.PatchFunc - ResetStart;
+        put(&offset, 4);
+        put(&patchFunc, 4);
+        put(&it.second.Offset, 2);
+        put(&it.second.Size, 2);
+    }
+
+    u32 numSites = FastMemBaseSites.size();
+    put(&numSites, 4);
+    for (auto& it : FastMemBaseSites)
+    {
+        put(&it.first, 4);
+        put(&it.second.Length, 1);
+        put(&it.second.Size, 1);
+        put(&it.second.Num, 1);
+    }
+
+    return true;
+}
+
+bool Compiler::LoadCode(const u8* data, u32 size)
+{
+    // only into an empty code area, so everything ends up at the same offset
+    if (GetWritableCodePtr() != NearStart || FarCode != FarStart)
+        return false;
+
+    u32 pos = 0;
+    auto get = [&](void* ptr, u32 len)
+    {
+        if (len > size - pos) return false;
+        memcpy(ptr, &data[pos], len);
+        pos += len;
+        return true;
+    };
+
+    u64 fingerprint;
+    if (!get(&fingerprint, 8) || fingerprint != CodeFingerprint)
+        return false;
+
+    // leave some space for new code, otherwise we end up
+    // resetting over and over
+    u32 nearLen, farLen;
+    if (!get(&nearLen, 4) || nearLen > NearSize / 2 || nearLen > size - pos)
+        return false;
+    const u8* nearCode = &data[pos];
+    pos += nearLen;
+    if (!get(&farLen, 4) || farLen > FarSize / 2 || farLen > size - pos)
+        return false;
+    const u8* farCode = &data[pos];
+    pos += farLen;
+
+    // near and far code always move onto the next segment together
+    u32 segment = nearLen / (NearSize / CodeSegments);
+    if (farLen / (FarSize / CodeSegments) != segment)
+        return false;
+
+    u32 nearEnd = NearStart - ResetStart + nearLen;
+    u32 farBegin = FarStart - ResetStart;
+    u32 farEnd = farBegin + farLen;
+
+    u32 numPatches;
+    if (!get(&numPatches, 4))
+        return false;
+    std::vector<std::pair<u32, LoadStorePatch>> patches;
+    for (u32 i = 0; i < numPatches; i++)
+    {
+        u32 offset;
+        s32 patchFunc;
+        LoadStorePatch patch;
+        if (!get(&offset, 4) || !get(&patchFunc, 4) || !get(&patch.Offset, 2) || !get(&patch.Size, 2))
+            return false;
+        if (!(offset < nearEnd || (offset >= farBegin && offset < farEnd))
+            || !(patchFunc < 0 || ((u32)patchFunc >= farBegin && (u32)patchFunc < farEnd)))
+            return false;
+
+        patch.PatchFunc = ResetStart + patchFunc;
+        patches.push_back(std::make_pair(offset, patch));
+    }
+
+    u32 numSites;
+    if (!get(&numSites, 4))
+        return false;
+    std::vector<std::pair<u32, FastMemBaseSite>> sites;
+    for (u32 i = 0; i < numSites; i++)
+    {
+        u32 offset;
+        FastMemBaseSite site;
+        if (!get(&offset, 4) || !get(&site.Length, 1) || !get(&site.Size, 1) || !get(&site.Num, 1))
+            return false;
+        if (site.Size > site.Length
+            || !(offset + site.Length <= nearEnd
+                || (offset >= farBegin && offset + site.Length <= farEnd)))
+            return false;
+
+        // the base has to fit into the space the code was generated with
+        u64 fastMem = (u64)(site.Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start);
+        if (site.Size != 8 && (site.Size != 4 || fastMem != (u32)fastMem))
+            return false;
+        sites.push_back(std::make_pair(offset, site));
+    }
+
+    memcpy(NearStart, nearCode, nearLen);
+    memcpy(FarStart, farCode, farLen);
+    NearCode = NearStart + nearLen;
+    FarCode = FarStart + farLen;
+    SetCodePtr(NearCode);
+    CurSegment = segment;
+
+    for (auto& it : patches)
+        LoadStorePatches[ResetStart + it.first] = it.second;
+
+    for (auto& it : sites)
+    {
+        const FastMemBaseSite& site = it.second;
+        u64 fastMem = (u64)(site.Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start);
+        memcpy(ResetStart + it.first + site.Length - site.Size, &fastMem, site.Size);
+        FastMemBaseSites[it.first] = site;
+    }
+
+    return true;
 }
 
 bool Compiler::IsJITFault(u8* addr)
@@ -682,45 +917,137 @@ void Compiler::Comp_SpecialBranchBehaviour(bool taken)
 
         if (ConstantCycles)
             ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-        JMP((u8*)&ARM_Ret, true);
+
+        u32 target = taken ? ExitBranchTarget : (CurInstr.Addr + (Thumb ? 2 : 4)) | Thumb;
+        Comp_ExitBlock(&target, target ? 1 : 0);
     }
 }
 
-#ifdef JIT_PROFILING_ENABLED
-void Compiler::CreateMethod(const char* namefmt, void* start, ...)
+void Compiler::Comp_ExitBlock(u32* targets, int numTargets)
 {
-    if (iJIT_IsProfilingActive())
+    // targets are given as address | thumb bit
+    u32 linkTargets[2];
+    int numLinkTargets = 0;
+    if (Config::JIT_BranchOptimisations)
+    {
+        for (int i = 0; i < numTargets; i++)
+        {
+            if (CanLinkTo(Num, targets[i] & ~1))
+                linkTargets[numLinkTargets++] = targets[i];
+        }
+    }
+
+    if (Profile)
     {
-        va_list args;
-        va_start(args, start);
-        char name[64];
-        vsprintf(name, namefmt, args);
-        va_end(args);
+        MOV(64, R(RSCRATCH), ImmPtr(&Profile->Cycles));
+        MOVSX(64, 32, RSCRATCH2, MDisp(RCPU, offsetof(ARM, Cycles)));
+        ADD(64, MatR(RSCRATCH), R(RSCRATCH2));
+    }
+
+    if (numLinkTargets > 0)
+    {
+        // do what the dispatcher would do before running the next block
+        MOV(32, MDisp(RCPU, offsetof(ARM, CPSR)), R(RCPSR));
+
+        CMP(32, MDisp(RCPU, offsetof(ARM, StopExecution)), Imm8(0));
+        FixupBranch stopExecution = J_CC(CC_NZ, true);
+
+        // addressed relative to the code, so that it still works
+        // when the code is restored from the disk cache
+        u64* timestamp = Num == 0 ? &NDS::ARM9Timestamp : &NDS::ARM7Timestamp;
+        u64* target = Num == 0 ? &NDS::ARM9Target : &NDS::ARM7Target;
+        MOVSX(64, 32, RSCRATCH2, MDisp(RCPU, offsetof(ARM, Cycles)));
+        ADD(64, R(RSCRATCH2), M(timestamp));
+        CMP(64, R(RSCRATCH2), M(target));
+        FixupBranch outOfTime = J_CC(CC_AE, true);
+        MOV(64, M(timestamp), R(RSCRATCH2));
+        MOV(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(0));
+
+        for (int i = 0; i < numLinkTargets; i++)
+        {
+            bool thumb = linkTargets[i] & 1;
+            u32 addr = linkTargets[i] & ~1;
+
+            CMP(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(addr + (thumb ? 2 : 4)));
+            FixupBranch wrongAddr = J_CC(CC_NE);
+            TEST(32, R(RCPSR), Imm32(0x20));
+            FixupBranch wrongMode = J_CC(thumb ? CC_Z : CC_NZ);
+
+            // while unlinked this jumps right behind itself
+            JMP(GetCodePtr() + 5, true);
+            BlockLink link;
+            link.Target = addr;
+            link.Offset = GetWritableCodePtr() - ResetStart;
+            BlockLinks.push_back(link);
+
+            SetJumpTarget(wrongAddr);
+            SetJumpTarget(wrongMode);
+        }
+
+        SetJumpTarget(stopExecution);
+        SetJumpTarget(outOfTime);
+    }
+
+    JMP((u8*)&ARM_Ret, true);
+}
+
+void Compiler::PatchBlockLink(u32 offset, JitBlockEntry entry)
+{
+    u8* end = ResetStart + offset;
+    s32 distance = entry ? (u8*)entry - end : 0;
+    memcpy(end - 4, &distance, 4);
+}
+
+void Compiler::CreateMethod(const char* namefmt, void* start, ...)
+{
+#ifdef JIT_PROFILING_ENABLED
+    bool vtune = iJIT_IsProfilingActive();
+#else
+    bool vtune = false;
+#endif
+    if (!vtune && !PerfMap)
+        return;
+
+    va_list args;
+    va_start(args, start);
+    char name[64];
+    vsnprintf(name, sizeof(name), namefmt, args);
+    va_end(args);
 
+    u32 size = GetWritableCodePtr() - (u8*)start;
+
+#ifdef JIT_PROFILING_ENABLED
+    if (vtune)
+    {
         iJIT_Method_Load method = {0};
         method.method_id = iJIT_GetNewMethodID();
         method.method_name = name;
         method.method_load_address = start;
-        method.method_size = GetWritableCodePtr() - (u8*)start;
+        method.method_size = size;
 
         iJIT_NotifyEvent(iJVM_EVENT_TYPE_METHOD_LOAD_FINISHED, (void*)&method);
     }
-}
 #endif
 
-JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr)
+    if (PerfMap)
+        fprintf(PerfMap, "%llx %x %s\n", (unsigned long long)(u64)start, size, name);
+}
+
+void Compiler::PrepareCodeSpace()
 {
-    if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
-    {
-        printf("near reset\n");
-        ResetBlockCache();
-    }
-    if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
+    // the code buffer is used as a ring of segments, instead of throwing
+    // everything away once it's full only the oldest segment is reclaimed
+    u32 nearSegmentSize = NearSize / CodeSegments;
+    u32 farSegmentSize = FarSize / CodeSegments;
+    if (nearSegmentSize - (GetCodePtr() - (NearStart + CurSegment * nearSegmentSize)) < 1024 * 32 // guess...
+        || farSegmentSize - (FarCode - (FarStart + CurSegment * farSegmentSize)) < 1024 * 32)
     {
-        printf("far reset\n");
-        ResetBlockCache();
+        NextCodeSegment();
     }
+}
 
+JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr)
+{
     ConstantCycles = 0;
     Thumb = thumb;
     Num = cpu->Num;
@@ -731,11 +1058,26 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     JitBlockEntry res = (JitBlockEntry)GetWritableCodePtr();
 
+    BlockLinks.clear();
+
+    Profile = Config::JIT_ProfileBlocks ? GetBlockProfile(Num, instrs[0].Addr) : NULL;
+    if (Profile)
+    {
+        // the cycles spent in the block are the difference
+        // between the cycle counter on entry and on exit
+        MOV(64, R(RSCRATCH), ImmPtr(&Profile->Executions));
+        ADD(64, MatR(RSCRATCH), Imm8(1));
+        MOV(64, R(RSCRATCH), ImmPtr(&Profile->Cycles));
+        MOVSX(64, 32, RSCRATCH2, MDisp(RCPU, offsetof(ARM, Cycles)));
+        SUB(64, MatR(RSCRATCH), R(RSCRATCH2));
+    }
+
     RegCache = RegisterCache<Compiler, X64Reg>(this, instrs, instrsCount);
 
     for (int i = 0; i < instrsCount; i++)
     {
         CurInstr = instrs[i];
+        ExitBranchTarget = 0;
         R15 = CurInstr.Addr + (Thumb ? 4 : 8);
         CodeRegion = R15 >> 24;
 
@@ -818,7 +1160,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
                 {
                     if (IrregularCycles || (CurInstr.BranchFlags & branch_FollowCondTaken))
                     {
-                        FixupBranch skipFailed = J();
+                        FixupBranch skipFailed = J(CurInstr.BranchFlags & branch_FollowCondTaken);
                         SetJumpTarget(skipExecute);
 
                         Comp_AddCycles_C(true);
@@ -844,11 +1186,17 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     if (ConstantCycles)
         ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
-    JMP((u8*)ARM_Ret, true);
 
-#ifdef JIT_PROFILING_ENABLED
+    u32 exitTargets[2];
+    int numExitTargets = 0;
+    if (ExitBranchTarget)
+        exitTargets[numExitTargets++] = ExitBranchTarget;
+    bool lastConditional = Thumb ? CurInstr.Info.Kind == ARMInstrInfo::tk_BCOND : CurInstr.Cond() < 0xE;
+    if (!CurInstr.Info.Branches() || lastConditional)
+        exitTargets[numExitTargets++] = (CurInstr.Addr + (Thumb ? 2 : 4)) | Thumb;
+    Comp_ExitBlock(exitTargets, numExitTargets);
+
     CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
-#endif
 
     /*FILE* codeout = fopen("codeout", "a");
     fprintf(codeout, "beginning block argargarg__ %x!!!", instrs[0].Addr);
@@ -862,7 +1210,7 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 {
     s32 cycles = Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 1 : 3]
+        CurInstr.SeqCodeCycles
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if ((!Thumb && CurInstr.Cond() < 0xE) || forceNonConstant)
@@ -874,7 +1222,7 @@ void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 void Compiler::Comp_AddCycles_CI(u32 i)
 {
     s32 cycles = (Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.NonSeqCodeCycles
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles)) + i;
 
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -886,7 +1234,7 @@ void Compiler::Comp_AddCycles_CI(u32 i)
 void Compiler::Comp_AddCycles_CI(Gen::X64Reg i, int add)
 {
     s32 cycles = Num ?
-        NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.NonSeqCodeCycles
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
     
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -911,7 +1259,7 @@ void Compiler::Comp_AddCycles_CDI()
 
         s32 cycles;
 
-        s32 numC = NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.NonSeqCodeCycles;
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 24) == 0x02) // mainRAM
@@ -956,7 +1304,7 @@ void Compiler::Comp_AddCycles_CD()
     }
     else
     {
-        s32 numC = NDS::ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.NonSeqCodeCycles;
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 4) == 0x02)
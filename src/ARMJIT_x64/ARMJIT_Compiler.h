@@ -30,6 +30,7 @@
 #endif
 
 #include <unordered_map>
+#include <vector>
 
 namespace ARMJIT
 {
@@ -49,6 +50,14 @@ struct LoadStorePatch
     u16 Size;
 };
 
+// instruction which loads the fast memory base
+struct FastMemBaseSite
+{
+    u8 Length;
+    u8 Size; // of the immediate at its end
+    u8 Num;
+};
+
 struct Op2
 {
     Op2()
@@ -80,9 +89,19 @@ class Compiler : public Gen::XEmitter
 {
 public:
     Compiler();
+    ~Compiler();
 
     void Reset();
 
+    // used by the disk cache (see ARMJIT_Cache.cpp)
+    bool SaveCode(std::vector<u8>& data);
+    bool LoadCode(const u8* data, u32 size);
+
+    // CompileBlock() only ever touches the code buffer and its own state,
+    // so it can run on another thread than the emulation. Making room
+    // in the buffer (which throws out old blocks) has to happen beforehand
+    static const bool BackgroundCompile = true;
+    void PrepareCodeSpace();
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr);
 
     void LoadReg(int reg, Gen::X64Reg nativeReg);
@@ -167,6 +186,7 @@ public:
         memop_SubtractOffset = 1 << 4
     };
     void Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flags);
+    void Comp_LoadFastMemBase(Gen::X64Reg reg);
     s32 Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc, bool decrement, bool usermode, bool skipLoadingRn);
     bool Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr);
 
@@ -181,6 +201,7 @@ public:
     void Comp_RetriveFlags(bool sign, bool retriveCV, bool carryUsed);
 
     void Comp_SpecialBranchBehaviour(bool taken);
+    void Comp_ExitBlock(u32* targets, int numTargets);
 
 
     Gen::OpArg Comp_RegShiftImm(int op, int amount, Gen::OpArg rm, bool S, bool& carryUsed);
@@ -218,6 +239,10 @@ public:
         return (u8*)entry - ResetStart;
     }
 
+    // points the jump ending at offset into the given block
+    // or back to the dispatcher if it's NULL
+    void PatchBlockLink(u32 offset, JitBlockEntry entry);
+
     void SwitchToNearCode()
     {
         FarCode = GetWritableCodePtr();
@@ -234,9 +259,9 @@ public:
 
     u8* RewriteMemAccess(u8* pc);
 
-#ifdef JIT_PROFILING_ENABLED
+    // tells VTune and perf where the generated code for something is
     void CreateMethod(const char* namefmt, void* start, ...);
-#endif
+    FILE* PerfMap;
 
     u8* FarCode;
     u8* NearCode;
@@ -246,14 +271,32 @@ public:
     u8* NearStart;
     u8* FarStart;
 
+    // both near and far code are split into this many segments,
+    // which are filled one after another
+    static const int CodeSegments = 8;
+    int CurSegment;
+    bool SegmentsWrapped;
+    void NextCodeSegment();
+
     void* PatchedStoreFuncs[2][2][3][16];
     void* PatchedLoadFuncs[2][2][3][2][16];
 
     std::unordered_map<u8*, LoadStorePatch> LoadStorePatches;
+    // by offset relative to ResetStart
+    std::unordered_map<u32, FastMemBaseSite> FastMemBaseSites;
 
     u8* ResetStart;
     u32 CodeMemSize;
 
+    u64 CodeFingerprint;
+
+    // direct jumps into other blocks emitted for the current block
+    std::vector<BlockLink> BlockLinks;
+    // where a static branch at the end of the current instruction leads to (address | thumb)
+    u32 ExitBranchTarget;
+    // counters of the current block, NULL if it isn't profiled
+    BlockProfile* Profile;
+
     bool Exit;
     bool IrregularCycles;
 
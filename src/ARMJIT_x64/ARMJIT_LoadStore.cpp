@@ -43,6 +43,9 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
         //printf("rewriting memory access %p %d %d\n", (u8*)pc-ResetStart, patch.Offset, patch.Size);
 
+        // the fast path always starts by loading the fast memory base
+        FastMemBaseSites.erase(pc + (ptrdiff_t)patch.Offset - ResetStart);
+
         XEmitter emitter(pc + (ptrdiff_t)patch.Offset);
         emitter.CALL(patch.PatchFunc);
         ptrdiff_t remainingSize = (ptrdiff_t)patch.Size - 5;
@@ -57,6 +60,21 @@ u8* Compiler::RewriteMemAccess(u8* pc)
     abort();
 }
 
+void Compiler::Comp_LoadFastMemBase(X64Reg reg)
+{
+    void* fastMem = Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start;
+    u8* start = GetWritableCodePtr();
+    MOV(64, R(reg), ImmPtr(fastMem));
+
+    // the base is different every run, remember where it is so
+    // code loaded from the disk cache can be fixed up
+    FastMemBaseSite site;
+    site.Length = GetWritableCodePtr() - start;
+    site.Size = (u64)fastMem == (u32)(u64)fastMem ? 4 : 8;
+    site.Num = Num;
+    FastMemBaseSites[start - ResetStart] = site;
+}
+
 /*
     According to DeSmuME and my own research, approx. 99% (seriously, that's an empirical number)
     of all memory load and store instructions always access addresses in the same region as
@@ -69,38 +87,29 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
 bool Compiler::Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr)
 {
-    u32 localAddr = LocaliseCodeAddress(Num, addr);
-
-    int invalidLiteralIdx = InvalidLiterals.Find(localAddr);
-    if (invalidLiteralIdx != -1)
-    {
+    // the literal was already read when the block was fetched
+    if (!CurInstr.HasLiteral)
         return false;
-    }
 
     Comp_AddCycles_CDI();
 
-    u32 val;
-    // make sure arm7 bios is accessible
-    u32 tmpR15 = CurCPU->R[15];
-    CurCPU->R[15] = R15;
+    u32 val = CurInstr.LiteralValue;
     if (size == 32)
     {
-        CurCPU->DataRead32(addr & ~0x3, &val);
         val = ::ROR(val, (addr & 0x3) << 3);
     }
     else if (size == 16)
     {
-        CurCPU->DataRead16(addr & ~0x1, &val);
+        val = (val >> ((addr & 0x2) << 3)) & 0xFFFF;
         if (signExtend)
             val = ((s32)val << 16) >> 16;
     }
     else
     {
-        CurCPU->DataRead8(addr, &val);
+        val = (val >> ((addr & 0x3) << 3)) & 0xFF;
         if (signExtend)
             val = ((s32)val << 24) >> 24;
     }
-    CurCPU->R[15] = tmpR15;
 
     MOV(32, MapReg(rd), Imm32(val));
 
@@ -196,9 +205,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
     if ((flags & memop_Writeback) && !(flags & memop_Post))
         MOV(32, rnMapped, R(finalAddr));
 
-    u32 expectedTarget = Num == 0
-        ? ARMJIT_Memory::ClassifyAddress9(CurInstr.DataRegion)
-        : ARMJIT_Memory::ClassifyAddress7(CurInstr.DataRegion);
+    u32 expectedTarget = CurInstr.DataRegionType;
 
     if (Config::JIT_FastMemory && ((!Thumb && CurInstr.Cond() != 0xE) || ARMJIT_Memory::IsFastmemCompatible(expectedTarget)))
     {
@@ -218,7 +225,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         assert(patch.PatchFunc != NULL);
 
-        MOV(64, R(RSCRATCH), ImmPtr(Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start));
+        Comp_LoadFastMemBase(RSCRATCH);
 
         X64Reg maskedAddr = RSCRATCH3;
         if (size > 8)
@@ -267,9 +274,12 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
     {
         PushRegs(false, false);
 
+        // the handlers were looked up for the address this instruction
+        // accessed while it was fetched
         void* func = NULL;
-        if (addrIsStatic)
-            func = ARMJIT_Memory::GetFuncForAddr(CurCPU, staticAddress, flags & memop_Store, size);
+        if (addrIsStatic && staticAddress == CurInstr.DataRegion
+            && !!(flags & memop_Store) == (CurInstr.Info.SpecialKind == ARMInstrInfo::special_WriteMem))
+            func = CurInstr.DataFuncs[__builtin_ctz(size) - 3];
 
         if (func)
         {
@@ -422,9 +432,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
 
     s32 offset = (regsCount * 4) * (decrement ? -1 : 1);
 
-    int expectedTarget = Num == 0
-        ? ARMJIT_Memory::ClassifyAddress9(CurInstr.DataRegion)
-        : ARMJIT_Memory::ClassifyAddress7(CurInstr.DataRegion);
+    int expectedTarget = CurInstr.DataRegionType;
 
     if (!store)
         Comp_AddCycles_CDI();
@@ -455,7 +463,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         u8* fastPathStart = GetWritableCodePtr();
         u8* loadStoreAddr[16];
 
-        MOV(64, R(RSCRATCH2), ImmPtr(Num == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start));
+        Comp_LoadFastMemBase(RSCRATCH2);
         ADD(64, R(RSCRATCH2), R(RSCRATCH4));
 
         u32 offset = 0;
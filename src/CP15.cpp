@@ -27,14 +27,6 @@
 #include "ARMJIT_Memory.h"
 #endif
 
-// access timing for cached regions
-// this would be an average between cache hits and cache misses
-// this was measured to be close to hardware average
-// a value of 1 would represent a perfect cache, but that causes
-// games to run too fast, causing a number of issues
-const int kDataCacheTiming = 3;//2;
-const int kCodeCacheTiming = 3;//5;
-
 
 void ARMv5::CP15Reset()
 {
@@ -137,6 +129,10 @@ void ARMv5::UpdateITCMSetting()
         ITCMSize = 0;
         //printf("ITCM disabled\n");
     }
+
+#ifdef JIT_ENABLED
+    ARMJIT::MemoryMapChanged();
+#endif
 }
 
 
@@ -299,6 +295,10 @@ void ARMv5::UpdateRegionTimings(u32 addrstart, u32 addrend)
             MemTimings[i][3] = bustimings[3] << NDS::ARM9ClockShift;
         }
     }
+
+#ifdef JIT_ENABLED
+    ARMJIT::MemoryMapChanged();
+#endif
 }
 
 
@@ -763,6 +763,17 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
     return BusRead32(addr);
 }
 
+s32 ARMv5::CodeReadCycles(u32 addr, bool branch, s32 regionCodeCycles)
+{
+    if (addr < ITCMSize)
+        return 1;
+
+    if (regionCodeCycles == 0xFF) // cached memory. hax
+        return (branch || !(addr & 0x1F)) ? kCodeCacheTiming : 1;
+
+    return regionCodeCycles;
+}
+
 
 void ARMv5::DataRead8(u32 addr, u32* val)
 {
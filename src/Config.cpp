@@ -51,6 +51,7 @@ char DSiSDPath[1024];
 
 int RandomizeMAC;
 int AudioBitrate;
+int CachedInterpreter = true;
 
 #ifdef JIT_ENABLED
 int JIT_Enable = false;
@@ -58,6 +59,11 @@ int JIT_MaxBlockSize = 32;
 int JIT_BranchOptimisations = true;
 int JIT_LiteralOptimisations = true;
 int JIT_FastMemory = true;
+int JIT_DiskCache = false;
+int JIT_PerfMap = false;
+int JIT_ProfileBlocks = false;
+int JIT_BackgroundCompile = false;
+int JIT_DSP = false;
 #endif
 
 ConfigEntry ConfigFile[] =
@@ -85,6 +91,7 @@ ConfigEntry ConfigFile[] =
 
     {"RandomizeMAC", 0, &RandomizeMAC, 0, NULL, 0},
     {"AudioBitrate", 0, &AudioBitrate, 0, NULL, 0},
+    {"CachedInterpreter", 0, &CachedInterpreter, 1, NULL, 0},
 
 #ifdef JIT_ENABLED
     {"JIT_Enable", 0, &JIT_Enable, 0, NULL, 0},
@@ -96,6 +103,11 @@ ConfigEntry ConfigFile[] =
     #else
         {"JIT_FastMemory", 0, &JIT_FastMemory, 1, NULL, 0},
     #endif
+    {"JIT_DiskCache", 0, &JIT_DiskCache, 0, NULL, 0},
+    {"JIT_PerfMap", 0, &JIT_PerfMap, 0, NULL, 0},
+    {"JIT_ProfileBlocks", 0, &JIT_ProfileBlocks, 0, NULL, 0},
+    {"JIT_BackgroundCompile", 0, &JIT_BackgroundCompile, 0, NULL, 0},
+    {"JIT_DSP", 0, &JIT_DSP, 0, NULL, 0},
 #endif
 
     {"", -1, NULL, 0, NULL, 0}
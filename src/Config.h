@@ -67,6 +67,7 @@ extern int AudioBitrate;
 extern int AudioInterp;
 extern int ConsoleType;
 extern int DirectBoot;
+extern int CachedInterpreter;
 
 #ifdef JIT_ENABLED
 extern int JIT_Enable;
@@ -74,6 +75,11 @@ extern int JIT_MaxBlockSize;
 extern int JIT_BranchOptimisations;
 extern int JIT_LiteralOptimisations;
 extern int JIT_FastMemory;
+extern int JIT_DiskCache;
+extern int JIT_PerfMap;
+extern int JIT_ProfileBlocks;
+extern int JIT_BackgroundCompile;
+extern int JIT_DSP;
 #endif
 
 }
@@ -17,6 +17,8 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "NDS.h"
 #include "DSi.h"
 #include "DMA.h"
@@ -543,6 +545,52 @@ u32 DMA::UnitTimings7_32(bool burststart)
     }
 }
 
+// fast path for when both sides are plain memory going up: the timings are
+// worked out for as many units as fit in the current page and before the
+// CPU target, then they're copied in one go
+template <int CPUNum, typename T>
+bool DMA::CopyBulk(bool burststart)
+{
+    if (SrcAddrInc != 1 || DstAddrInc != 1) return false;
+
+    u8* src = NDS::GetDMAReadPtr(CPUNum, CurSrcAddr);
+    if (!src) return false;
+    u8* dst = NDS::GetDMAWritePtr(CPUNum, CurDstAddr);
+    if (!dst) return false;
+
+    u32 len = 0x1000 - std::max(CurSrcAddr & 0xFFF, CurDstAddr & 0xFFF);
+    u32 maxunits = std::min(len / (u32)sizeof(T), IterCount);
+    if (!maxunits) return false;
+
+    // an overlapping copy going up has to see its own writes
+    if (dst > src && dst < src + maxunits*sizeof(T)) return false;
+
+    u32 dstaddr = CurDstAddr;
+    u32 n = 0;
+    while (n < maxunits)
+    {
+        if (CPUNum == 0)
+            NDS::ARM9Timestamp += ((sizeof(T) == 4 ? UnitTimings9_32(burststart) : UnitTimings9_16(burststart)) << NDS::ARM9ClockShift);
+        else
+            NDS::ARM7Timestamp += (sizeof(T) == 4 ? UnitTimings7_32(burststart) : UnitTimings7_16(burststart));
+        burststart = false;
+
+        CurSrcAddr += sizeof(T);
+        CurDstAddr += sizeof(T);
+        n++;
+
+        if (CPUNum == 0 && NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+        if (CPUNum == 1 && NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+    }
+
+    memmove(dst, src, n*sizeof(T));
+    NDS::MarkDMAWrite(CPUNum, dstaddr, n*sizeof(T));
+
+    IterCount -= n;
+    RemCount -= n;
+    return true;
+}
+
 template <int ConsoleType>
 void DMA::Run9()
 {
@@ -558,6 +606,13 @@ void DMA::Run9()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<0, u16>(burststart))
+            {
+                burststart = false;
+                if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+                continue;
+            }
+
             NDS::ARM9Timestamp += (UnitTimings9_16(burststart) << NDS::ARM9ClockShift);
             burststart = false;
 
@@ -578,6 +633,13 @@ void DMA::Run9()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<0, u32>(burststart))
+            {
+                burststart = false;
+                if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+                continue;
+            }
+
             NDS::ARM9Timestamp += (UnitTimings9_32(burststart) << NDS::ARM9ClockShift);
             burststart = false;
 
@@ -638,6 +700,13 @@ void DMA::Run7()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<1, u16>(burststart))
+            {
+                burststart = false;
+                if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+                continue;
+            }
+
             NDS::ARM7Timestamp += UnitTimings7_16(burststart);
             burststart = false;
 
@@ -658,6 +727,13 @@ void DMA::Run7()
     {
         while (IterCount > 0 && !Stall)
         {
+            if (CopyBulk<1, u32>(burststart))
+            {
+                burststart = false;
+                if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+                continue;
+            }
+
             NDS::ARM7Timestamp += UnitTimings7_32(burststart);
             burststart = false;
 
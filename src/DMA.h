@@ -47,6 +47,9 @@ public:
     template <int ConsoleType>
     void Run7();
 
+    template <int CPUNum, typename T>
+    bool CopyBulk(bool burststart);
+
     bool IsInMode(u32 mode)
     {
         return ((mode == StartMode) && (Cnt & 0x80000000));
@@ -549,6 +549,7 @@ void SoftReset()
     SCFG_Clock7 = 0x0187;
     SCFG_EXT[0] = 0x8307F100;
     SCFG_EXT[1] = 0x93FFFB06;
+    NDS::UpdateBusMap(0x03);
     SCFG_MC = 0x0010;//0x0011;
     // TODO: is this actually reset?
     SCFG_RST = 0;
@@ -646,6 +647,7 @@ bool LoadNAND()
     // run.
     SCFG_EXT[0] |= (1 << 25);
     SCFG_EXT[1] |= (1 << 25);
+    NDS::UpdateBusMap(0x03);
 
     memset(NWRAM_A, 0, NWRAMSize);
     memset(NWRAM_B, 0, NWRAMSize);
@@ -1127,6 +1129,8 @@ void ApplyNewRAMSize(u32 size)
         printf("RAM: 16MB\n");
         break;
     }
+
+    NDS::UpdateBusMap(0x02);
 }
 
 
@@ -2345,6 +2349,7 @@ void ARM9IOWrite32(u32 addr, u32 val)
             SCFG_EXT[0] |= (val & 0x8007F19F);
             SCFG_EXT[1] &= ~0x0000F080;
             SCFG_EXT[1] |= (val & 0x0000F080);
+            NDS::UpdateBusMap(0x03);
             printf("SCFG_EXT = %08X / %08X (val9 %08X)\n", SCFG_EXT[0], SCFG_EXT[1], val);
             /*switch ((SCFG_EXT[0] >> 14) & 0x3)
             {
@@ -2719,6 +2724,7 @@ void ARM7IOWrite32(u32 addr, u32 val)
         SCFG_EXT[0] |= (val & 0x03000000);
         SCFG_EXT[1] &= ~0x93FF0F07;
         SCFG_EXT[1] |= (val & 0x93FF0F07);
+        NDS::UpdateBusMap(0x03);
         printf("SCFG_EXT = %08X / %08X (val7 %08X)\n", SCFG_EXT[0], SCFG_EXT[1], val);
         return;
     case 0x04004010:
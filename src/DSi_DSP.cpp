@@ -22,12 +22,20 @@
 #include "DSi_DSP.h"
 #include "FIFO.h"
 #include "NDS.h"
+#include "Config.h"
+#if defined(JIT_ENABLED) && defined(__x86_64__)
+#include "DSi_DSPJIT.h"
+#define DSP_JIT
+#endif
 
 
 namespace DSi_DSP
 {
 
 Teakra::Teakra* TeakraCore;
+#ifdef DSP_JIT
+bool UseJIT;
+#endif
 
 bool SCFG_RST;
 
@@ -117,6 +125,11 @@ bool Init()
 
     TeakraCore->SetAudioCallback(AudioCb);
 
+#ifdef DSP_JIT
+    if (!DSi_DSPJIT::Init(TeakraCore)) return false;
+    UseJIT = false;
+#endif
+
     //PDATAReadFifo = new FIFO<u16>(16);
     //PDATAWriteFifo = new FIFO<u16>(16);
 
@@ -125,6 +138,9 @@ bool Init()
 void DeInit()
 {
     //if (PDATAWriteFifo) delete PDATAWriteFifo;
+#ifdef DSP_JIT
+    DSi_DSPJIT::DeInit();
+#endif
     if (TeakraCore) delete TeakraCore;
 
     //PDATAReadFifo = NULL;
@@ -149,6 +165,10 @@ void Reset()
     PDATAReadFifo.Clear();
     //PDATAWriteFifo->Clear();
     TeakraCore->Reset();
+#ifdef DSP_JIT
+    DSi_DSPJIT::Invalidate();
+    UseJIT = Config::JIT_DSP;
+#endif
 
     NDS::CancelEvent(NDS::Event_DSi_DSP);
 }
@@ -202,6 +222,11 @@ void OnMBKCfg(char bank, u32 slot, u8 oldcfg, u8 newcfg, u8* nwrambacking)
     }
 
     memcpy(dst, src, 1<<15); // 1 full slot
+
+#ifdef DSP_JIT
+    if (newdsp && bank == 'B')
+        DSi_DSPJIT::Invalidate(((newcfg >> 2) & 7) << 14, 1<<14);
+#endif
 }
 
 inline bool IsDSPCoreEnabled()
@@ -556,7 +581,12 @@ void Run(u32 cycles)
         return;
     }
 
-    TeakraCore->Run(cycles);
+#ifdef DSP_JIT
+    if (UseJIT)
+        DSi_DSPJIT::Run(cycles);
+    else
+#endif
+        TeakraCore->Run(cycles);
 
     DSPTimestamp += cycles;
 
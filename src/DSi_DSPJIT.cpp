@@ -0,0 +1,492 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "DSi_DSPJIT.h"
+
+#include "dolphin/x64ABI.h"
+#include "dolphin/x64Emitter.h"
+
+// teakra brings its own
+#undef ASSERT
+#include "teakra/include/teakra/teakra.h"
+#include "teakra/src/interpreter.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// immediates need the Gen:: though, teakra has operand types of the same name
+using namespace Gen;
+
+namespace DSi_DSPJIT
+{
+
+typedef u32 (*JitBlockEntry)();
+
+// a block returns how many of its instructions were executed
+// this is also how many cycles it took, every instruction takes one cycle in teakra
+const u32 MaxBlockInstrs = 32;
+// instructions are one or two words long
+const u32 MaxBlockWords = MaxBlockInstrs * 2;
+
+// pc is 18-bit, code running with another program page is always interpreted
+const u32 ProgramSize = 0x40000;
+
+// a compiled instruction takes up less than 200 bytes, exit stubs included
+const u32 MaxBlockSize = MaxBlockInstrs * 256;
+
+Teakra::Teakra* Core;
+Teakra::Interpreter* Interp;
+Teakra::RegisterState* Regs;
+
+JitBlockEntry Blocks[ProgramSize];
+u8 BlockLength[ProgramSize];
+u8 BlockWords[ProgramSize];
+std::vector<u32> CompiledAddrs;
+
+u8 CodeMemory[1024 * 1024 * 4];
+u8* CodeStart;
+u32 CodeSize;
+
+XEmitter Emitter;
+
+// where the fields accessed by the compiled code are, relative to RBX
+u32 OffsetPC, OffsetRep, OffsetLP, OffsetBCN;
+// end of the frame before bkrep_stack[0], so that it can be indexed with bcn
+u32 OffsetLoopEnd;
+
+// a block only runs while no timer can fire, the timers are then skipped
+// over its cycles later on. if it touches MMIO, they're brought up to date
+// first and the block is left after that instruction
+bool InBlock;
+u32 InstrsDone;
+bool TimersSynced;
+u32 PendingTicks;
+
+void CheckLoopEnd(Teakra::Interpreter* interp)
+{
+    interp->CheckLoopEnd();
+}
+
+void FlushTicks()
+{
+    if (PendingTicks > 0)
+        Interp->GetCoreTiming().Skip(PendingTicks);
+    PendingTicks = 0;
+}
+
+void SyncTimers()
+{
+    if (!InBlock || TimersSynced)
+        return;
+
+    // the instructions before this one
+    PendingTicks += InstrsDone;
+    FlushTicks();
+    TimersSynced = true;
+}
+
+// what the interpreter does after the instruction which touched MMIO
+void FinishInstr()
+{
+    Interp->HandleInterrupts();
+    Interp->GetCoreTiming().Tick();
+}
+
+bool InterruptFlagged()
+{
+    return Regs->ip[0] || Regs->ip[1] || Regs->ip[2] || Regs->ipv;
+}
+
+void CallHandler(Teakra::Interpreter* interp, u32 instr, const Matcher<Teakra::Interpreter>* decoder)
+{
+    decoder->call(*interp, instr & 0xFFFF, instr >> 16);
+}
+
+bool Init(Teakra::Teakra* core)
+{
+#ifdef _WIN32
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+
+    u64 pageSize = (u64)sysInfo.dwPageSize;
+#else
+    u64 pageSize = sysconf(_SC_PAGE_SIZE);
+#endif
+
+    u8* pageAligned = (u8*)(((u64)CodeMemory & ~(pageSize - 1)) + pageSize);
+    u64 alignedSize = (((u64)CodeMemory + sizeof(CodeMemory)) & ~(pageSize - 1)) - (u64)pageAligned;
+
+#ifdef _WIN32
+    DWORD dummy;
+    if (!VirtualProtect(pageAligned, alignedSize, PAGE_EXECUTE_READWRITE, &dummy))
+        return false;
+#elif defined(__APPLE__)
+    pageAligned = (u8*)mmap(NULL, sizeof(CodeMemory), PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pageAligned == MAP_FAILED)
+        return false;
+#else
+    if (mprotect(pageAligned, alignedSize, PROT_EXEC | PROT_READ | PROT_WRITE))
+        return false;
+#endif
+
+    CodeStart = pageAligned;
+    CodeSize = alignedSize;
+
+    Core = core;
+    Interp = &core->GetInterpreter();
+    Regs = &Interp->GetRegs();
+
+    OffsetPC = (u8*)&Regs->pc - (u8*)Regs;
+    OffsetRep = (u8*)&Regs->rep - (u8*)Regs;
+    OffsetLP = (u8*)&Regs->lp - (u8*)Regs;
+    OffsetBCN = (u8*)&Regs->bcn - (u8*)Regs;
+    OffsetLoopEnd = (u8*)&Regs->bkrep_stack[0].end - (u8*)Regs - sizeof(Teakra::RegisterState::BlockRepeatFrame);
+
+    core->SetProgramWriteHandler([](u32 addr) { Invalidate(addr, 1); });
+    core->SetMMIOAccessHandler(SyncTimers);
+    InBlock = false;
+    PendingTicks = 0;
+
+    memset(Blocks, 0, sizeof(Blocks));
+    CompiledAddrs.clear();
+    Emitter.SetCodePtr(CodeStart);
+
+    return true;
+}
+
+void DeInit()
+{
+    if (Core)
+    {
+        Core->SetProgramWriteHandler(nullptr);
+        Core->SetMMIOAccessHandler(nullptr);
+    }
+
+#ifdef __APPLE__
+    if (CodeStart)
+        munmap(CodeStart, sizeof(CodeMemory));
+#endif
+
+    Core = nullptr;
+    Interp = nullptr;
+    Regs = nullptr;
+    CodeStart = nullptr;
+}
+
+void ResetBlockCache()
+{
+    for (u32 addr : CompiledAddrs)
+        Blocks[addr] = nullptr;
+    CompiledAddrs.clear();
+
+    Emitter.SetCodePtr(CodeStart);
+}
+
+void Invalidate()
+{
+    // a block might be running right now, its code is only
+    // overwritten once the code memory is reset between blocks
+    for (u32 addr : CompiledAddrs)
+        Blocks[addr] = nullptr;
+}
+
+void Invalidate(u32 start, u32 len)
+{
+    if (start >= ProgramSize)
+        return;
+    u32 end = std::min(start + len, ProgramSize);
+
+    // only blocks overlapping the range, those can start at most one block before it
+    u32 addr = start >= MaxBlockWords ? start - MaxBlockWords + 1 : 0;
+    for (; addr < end; addr++)
+    {
+        if (Blocks[addr] && addr + BlockWords[addr] > start)
+            Blocks[addr] = nullptr;
+    }
+}
+
+bool IsNative(const char* name)
+{
+    return !strcmp(name, "nop")
+        || !strcmp(name, "load_page")
+        || !strcmp(name, "load_stepi") || !strcmp(name, "load_stepj")
+        || !strcmp(name, "load_modi") || !strcmp(name, "load_modj")
+        || !strcmp(name, "load_ps")
+        || !strcmp(name, "dint") || !strcmp(name, "eint");
+}
+
+void CompileNative(const char* name, u16 opcode)
+{
+    u16* field;
+    u16 value;
+
+    if (!strcmp(name, "nop"))
+        return;
+    else if (!strcmp(name, "load_page"))
+    {
+        field = &Regs->page;
+        value = opcode & 0xFF;
+    }
+    else if (!strcmp(name, "load_stepi") || !strcmp(name, "load_stepj"))
+    {
+        field = !strcmp(name, "load_stepi") ? &Regs->stepi : &Regs->stepj;
+        value = opcode & 0x7F;
+    }
+    else if (!strcmp(name, "load_modi") || !strcmp(name, "load_modj"))
+    {
+        field = !strcmp(name, "load_modi") ? &Regs->modi : &Regs->modj;
+        value = opcode & 0x1FF;
+    }
+    else if (!strcmp(name, "load_ps"))
+    {
+        field = &Regs->ps[0];
+        value = opcode & 0x3;
+    }
+    else // dint/eint
+    {
+        field = &Regs->ie;
+        value = !strcmp(name, "eint");
+    }
+
+    Emitter.MOV(16, MDisp(RBX, (u8*)field - (u8*)Regs), Gen::Imm16(value));
+}
+
+// instructions after which the rest of the block would never or only rarely run
+// or which the block has to end after, because they change how code is fetched
+bool EndsBlock(const char* name)
+{
+    static const char* const names[] =
+    {
+        "br", "brr", "call", "calla", "callr", "ret", "reti", "retic", "rets", "mov_pc",
+        "rep", "rep_r6", "eint",
+        "movd", "pop_prpage", "mov_prpage"
+    };
+
+    for (const char* end : names)
+    {
+        if (!strcmp(name, end))
+            return true;
+    }
+    return false;
+}
+
+JitBlockEntry CompileBlock(u32 startAddr)
+{
+    if (Emitter.GetCodePtr() + MaxBlockSize > CodeStart + CodeSize)
+        ResetBlockCache();
+
+    JitBlockEntry entry = (JitBlockEntry)Emitter.GetWritableCodePtr();
+
+    BitSet32 savedRegs = {RBX, R12};
+    Emitter.ABI_PushRegistersAndAdjustStack(savedRegs, 8);
+    Emitter.MOV(64, R(RBX), ImmPtr(Regs));
+    Emitter.MOV(64, R(R12), ImmPtr(Interp));
+
+    std::vector<FixupBranch> exits[MaxBlockInstrs];
+    FixupBranch syncExits[MaxBlockInstrs];
+    bool hasSyncExit[MaxBlockInstrs] = {};
+
+    Teakra::MemoryInterface& mem = Interp->GetMemory();
+    u32 addr = startAddr;
+    u32 numInstrs = 0;
+    while (numInstrs < MaxBlockInstrs)
+    {
+        u16 opcode = mem.ProgramRead(addr);
+        const Matcher<Teakra::Interpreter>& decoder = Interp->GetDecoder(opcode);
+        u16 expansion = decoder.NeedExpansion() ? mem.ProgramRead(addr + 1) : 0;
+        u32 nextAddr = addr + (decoder.NeedExpansion() ? 2 : 1);
+        const char* name = decoder.GetName();
+
+        // pc already points at the next instruction while one is executed
+        Emitter.MOV(32, MDisp(RBX, OffsetPC), Gen::Imm32(nextAddr));
+
+        // only call out when this is the end of the innermost loop
+        Emitter.CMP(16, MDisp(RBX, OffsetLP), Gen::Imm8(0));
+        FixupBranch notInLoop = Emitter.J_CC(CC_E);
+        Emitter.MOVZX(32, 16, EAX, MDisp(RBX, OffsetBCN));
+        Emitter.IMUL(32, EAX, R(EAX), Gen::Imm8(sizeof(Teakra::RegisterState::BlockRepeatFrame)));
+        Emitter.CMP(32, MComplex(RBX, RAX, SCALE_1, OffsetLoopEnd), Gen::Imm32(nextAddr - 1));
+        FixupBranch notLoopEnd = Emitter.J_CC(CC_NE);
+        Emitter.MOV(64, R(ABI_PARAM1), R(R12));
+        Emitter.ABI_CallFunction(CheckLoopEnd);
+        Emitter.SetJumpTarget(notInLoop);
+        Emitter.SetJumpTarget(notLoopEnd);
+
+        bool native = IsNative(name);
+        if (native)
+            CompileNative(name, opcode);
+        else
+        {
+            // for SyncTimers(), in case this touches MMIO
+            Emitter.MOV(64, R(RAX), ImmPtr(&InstrsDone));
+            Emitter.MOV(32, MatR(RAX), Gen::Imm32(numInstrs));
+
+            Emitter.MOV(64, R(ABI_PARAM1), R(R12));
+            Emitter.MOV(32, R(ABI_PARAM2), Gen::Imm32(opcode | ((u32)expansion << 16)));
+            Emitter.MOV(64, R(ABI_PARAM3), ImmPtr(&decoder));
+            Emitter.ABI_CallFunction(CallHandler);
+
+            Emitter.MOV(64, R(RAX), ImmPtr(&TimersSynced));
+            Emitter.CMP(8, MatR(RAX), Gen::Imm8(0));
+            syncExits[numInstrs] = Emitter.J_CC(CC_NE, true);
+            hasSyncExit[numInstrs] = true;
+        }
+
+        numInstrs++;
+
+        // the end of a loop or the instruction itself might have moved pc elsewhere
+        // a rep has to be handled by the interpreter
+        Emitter.CMP(32, MDisp(RBX, OffsetPC), Gen::Imm32(nextAddr));
+        exits[numInstrs - 1].push_back(Emitter.J_CC(CC_NE, true));
+        if (!native)
+        {
+            Emitter.CMP(8, MDisp(RBX, OffsetRep), Gen::Imm8(0));
+            exits[numInstrs - 1].push_back(Emitter.J_CC(CC_NE, true));
+        }
+
+        addr = nextAddr;
+        if (EndsBlock(name) || addr >= ProgramSize)
+            break;
+    }
+
+    Emitter.MOV(32, R(EAX), Gen::Imm32(numInstrs));
+    const u8* epilogue = Emitter.GetCodePtr();
+    Emitter.ABI_PopRegistersAndAdjustStack(savedRegs, 8);
+    Emitter.RET();
+
+    for (u32 i = 0; i < numInstrs; i++)
+    {
+        for (FixupBranch& exit : exits[i])
+            Emitter.SetJumpTarget(exit);
+        Emitter.MOV(32, R(EAX), Gen::Imm32(i + 1));
+        Emitter.JMP(epilogue, true);
+
+        if (hasSyncExit[i])
+        {
+            Emitter.SetJumpTarget(syncExits[i]);
+            Emitter.ABI_CallFunction(FinishInstr);
+            Emitter.MOV(32, R(EAX), Gen::Imm32(i + 1));
+            Emitter.JMP(epilogue, true);
+        }
+    }
+
+    Blocks[startAddr] = entry;
+    BlockLength[startAddr] = numInstrs;
+    BlockWords[startAddr] = addr - startAddr;
+    CompiledAddrs.push_back(startAddr);
+
+    return entry;
+}
+
+void Run(u32 cycles)
+{
+    Teakra::CoreTiming& timing = Interp->GetCoreTiming();
+    // how many more cycles the timers are known to stay quiet for
+    u64 quiet = 0;
+
+    // this follows Interpreter::Run()
+    Interp->SetIdle(false);
+    for (u64 i = 0; i < cycles;)
+    {
+        if (Interp->IsIdle())
+        {
+            FlushTicks();
+            quiet = 0;
+
+            u64 skipped = timing.Skip(cycles - i - 1);
+            i += skipped;
+
+            if (i < cycles - 1)
+            {
+                i++;
+                timing.Tick();
+            }
+
+            Interp->PollInterrupts();
+            Interp->Step();
+            timing.Tick();
+            i++;
+            continue;
+        }
+
+        Interp->PollInterrupts();
+
+        u32 pc = Regs->pc;
+        JitBlockEntry block = nullptr;
+        // blocks skip checking for interrupts, so while one is flagged
+        // (taken or not) everything goes through the interpreter
+        if (!Regs->rep && Regs->prpage == 0 && pc < ProgramSize && !InterruptFlagged())
+        {
+            block = Blocks[pc];
+            if (!block)
+                block = CompileBlock(pc);
+
+            // the block might need more cycles than we have left,
+            // or a timer might fire in the middle of it
+            u32 len = BlockLength[pc];
+            if (len > quiet)
+            {
+                FlushTicks();
+                quiet = timing.GetMaxSkip();
+            }
+            if (len > cycles - i || len > quiet)
+                block = nullptr;
+        }
+
+        if (block)
+        {
+            InBlock = true;
+            TimersSynced = false;
+            u32 executed = block();
+            InBlock = false;
+
+            // if it was left because of MMIO, the timers are already up to date
+            // it might have changed them though
+            if (TimersSynced)
+                quiet = 0;
+            else
+            {
+                PendingTicks += executed;
+                quiet -= executed;
+            }
+            i += executed;
+        }
+        else
+        {
+            FlushTicks();
+            quiet = 0;
+
+            Interp->Step();
+            timing.Tick();
+            i++;
+        }
+    }
+
+    FlushTicks();
+}
+
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef DSI_DSPJIT_H
+#define DSI_DSPJIT_H
+
+#include "types.h"
+
+namespace Teakra
+{
+class Teakra;
+}
+
+// block cache for the DSi's Teak DSP
+// only exists on x64, elsewhere the DSP is always interpreted
+//
+// code is compiled into blocks of up to a few dozen instructions
+// most instructions still call into teakra's interpreter handlers, the block
+// saves the fetching and decoding, and the timer ticks and interrupt polls
+// in between, which can be skipped as long as no timer fires and no MMIO is
+// touched. otherwise the interpreter takes over, timing is the same either way
+namespace DSi_DSPJIT
+{
+
+bool Init(Teakra::Teakra* core);
+void DeInit();
+
+// throws away all compiled code
+void Invalidate();
+// throws away the compiled code overlapping the given range of program memory (in words)
+// has to be called whenever it's changed behind teakra's back
+void Invalidate(u32 start, u32 len);
+
+// drop-in replacement for Teakra::Run()
+void Run(u32 cycles);
+
+}
+
+#endif // DSI_DSPJIT_H
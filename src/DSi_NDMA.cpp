@@ -17,6 +17,8 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "NDS.h"
 #include "DSi.h"
 #include "DSi_NDMA.h"
@@ -159,6 +161,56 @@ void DSi_NDMA::Run()
     else          return Run7();
 }
 
+// fast path for plain memory on both sides. every unit costs the same here,
+// so the number of units that fit before the CPU target is known up front
+bool DSi_NDMA::CopyBulk(s32 unitcycles, bool dofill)
+{
+    if (DstAddrInc != 1 || (!dofill && SrcAddrInc != 1)) return false;
+    if (unitcycles <= 0) return false;
+
+    u8* dst = NDS::GetDMAWritePtr(CPU, CurDstAddr);
+    if (!dst) return false;
+
+    u8* src = NULL;
+    u32 len = 0x1000 - (CurDstAddr & 0xFFF);
+    if (!dofill)
+    {
+        src = NDS::GetDMAReadPtr(CPU, CurSrcAddr);
+        if (!src) return false;
+        len = std::min(len, 0x1000 - (CurSrcAddr & 0xFFF));
+    }
+
+    u32 n = std::min(len >> 2, IterCount);
+    if (!n) return false;
+
+    // an overlapping copy going up has to see its own writes
+    if (!dofill && dst > src && dst < src + (n<<2)) return false;
+
+    // stop at the same unit the regular loop would
+    u64& timestamp = CPU ? NDS::ARM7Timestamp : NDS::ARM9Timestamp;
+    u64 target = CPU ? NDS::ARM7Target : NDS::ARM9Target;
+    u64 unit = CPU ? unitcycles : (unitcycles << NDS::ARM9ClockShift);
+    u64 fit = (target - timestamp + unit - 1) / unit;
+    if (fit < n) n = fit;
+    timestamp += n * unit;
+
+    if (dofill)
+    {
+        for (u32 i = 0; i < n; i++)
+            *(u32*)&dst[i<<2] = FillData;
+    }
+    else
+        memmove(dst, src, n<<2);
+    NDS::MarkDMAWrite(CPU, CurDstAddr, n<<2);
+
+    CurSrcAddr += (SrcAddrInc * n) << 2;
+    CurDstAddr += n << 2;
+    IterCount -= n;
+    RemCount -= n;
+    TotalRemCount -= n;
+    return true;
+}
+
 void DSi_NDMA::Run9()
 {
     if (NDS::ARM9Timestamp >= NDS::ARM9Target) return;
@@ -196,6 +248,12 @@ void DSi_NDMA::Run9()
 
     while (IterCount > 0 && !Stall)
     {
+        if (CopyBulk(unitcycles, dofill))
+        {
+            if (NDS::ARM9Timestamp >= NDS::ARM9Target) break;
+            continue;
+        }
+
         NDS::ARM9Timestamp += (unitcycles << NDS::ARM9ClockShift);
 
         if (dofill)
@@ -285,6 +343,12 @@ void DSi_NDMA::Run7()
 
     while (IterCount > 0 && !Stall)
     {
+        if (CopyBulk(unitcycles, dofill))
+        {
+            if (NDS::ARM7Timestamp >= NDS::ARM7Target) break;
+            continue;
+        }
+
         NDS::ARM7Timestamp += unitcycles;
 
         if (dofill)
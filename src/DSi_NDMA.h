@@ -39,6 +39,8 @@ public:
     void Run9();
     void Run7();
 
+    bool CopyBulk(s32 unitcycles, bool dofill);
+
     bool IsInMode(u32 mode)
     {
         return ((mode == StartMode) && (Cnt & 0x80000000));
@@ -18,10 +18,18 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "NDS.h"
 #include "GPU.h"
 
 #include "GPU2D_Soft.h"
+#include "Platform.h"
+#include "Profiler.h"
 
 namespace GPU
 {
@@ -82,10 +90,51 @@ int FrontBuffer;
 u32* Framebuffer[2][2];
 int Renderer = 0;
 
+bool FrontBufferChanged = true;
+bool ScreenSwapChanged = true;
+bool ScreenSwap;
+
 GPU2D::Unit GPU2D_A(0);
 GPU2D::Unit GPU2D_B(1);
 
-std::unique_ptr<GPU2D::Renderer2D> GPU2D_Renderer = {};
+// one renderer per engine, so that they don't share any state
+// and engine B can be drawn on its own thread
+std::unique_ptr<GPU2D::Renderer2D> GPU2D_Renderer[2] = {};
+
+Platform::Thread* Render2DThread;
+std::atomic_bool Render2DThreadRunning;
+Platform::Semaphore* Sema_Render2DStart;
+Platform::Semaphore* Sema_Render2DDone;
+GPU2D::Unit* Render2DUnit[2];
+int Render2DLine, Render2DSpriteLine;
+u32 Render2DVCount;
+
+void SetupRender2DThread();
+void StopRender2DThread();
+
+// deferred 2D rendering
+// the registers of both units are recorded at each visible HBlank, and the scanline
+// is drawn from that copy on the deferred 2D thread while emulation carries on.
+// Sync2D() waits for it to catch up, before anything else it reads gets modified.
+struct Deferred2DLine
+{
+    int Line, SpriteLine;
+    bool Restart; // first scanline since the last sync, doesn't continue from the previous one
+    std::unique_ptr<GPU2D::Unit> Unit[2];
+};
+
+Platform::Thread* Deferred2DThread;
+std::atomic_bool Deferred2DThreadRunning;
+Platform::Semaphore* Sema_Deferred2DLine;
+Platform::Semaphore* Sema_Deferred2DDone;
+Deferred2DLine Deferred2DLog[192];
+std::atomic_int Deferred2DCount; // scanlines recorded since the last sync
+int Deferred2DRead; // next scanline for the deferred 2D thread to draw
+bool Deferred2DFrame; // whether the current frame can be deferred
+bool Deferred2DPending;
+
+void SetupDeferred2DThread();
+void StopDeferred2DThread();
 
 /*
     VRAM invalidation tracking
@@ -128,6 +177,12 @@ u8 VRAMFlat_BBG[128*1024];
 u8 VRAMFlat_AOBJ[256*1024];
 u8 VRAMFlat_BOBJ[128*1024];
 
+// the same, with 16-color tile data expanded to one byte per pixel
+u8 VRAMFlat_ABG4bpp[512*1024*2];
+u8 VRAMFlat_BBG4bpp[128*1024*2];
+u8 VRAMFlat_AOBJ4bpp[256*1024*2];
+u8 VRAMFlat_BOBJ4bpp[128*1024*2];
+
 u8 VRAMFlat_ABGExtPal[32*1024];
 u8 VRAMFlat_BBGExtPal[32*1024];
 u8 VRAMFlat_AOBJExtPal[8*1024];
@@ -145,9 +200,27 @@ std::unique_ptr<GLCompositor> CurGLCompositor = {};
 
 bool Init()
 {
-    GPU2D_Renderer = std::make_unique<GPU2D::SoftRenderer>();
+    GPU2D_Renderer[0] = std::make_unique<GPU2D::SoftRenderer>();
+    GPU2D_Renderer[1] = std::make_unique<GPU2D::SoftRenderer>();
     if (!GPU3D::Init()) return false;
 
+    Render2DThreadRunning = false;
+    Sema_Render2DStart = Platform::Semaphore_Create();
+    Sema_Render2DDone = Platform::Semaphore_Create();
+
+    for (int i = 0; i < 192; i++)
+    {
+        Deferred2DLog[i].Unit[0] = std::make_unique<GPU2D::Unit>(0);
+        Deferred2DLog[i].Unit[1] = std::make_unique<GPU2D::Unit>(1);
+    }
+
+    Deferred2DThreadRunning = false;
+    Deferred2DPending = false;
+    Deferred2DCount = 0;
+    Deferred2DRead = 0;
+    Sema_Deferred2DLine = Platform::Semaphore_Create();
+    Sema_Deferred2DDone = Platform::Semaphore_Create();
+
     FrontBuffer = 0;
     Framebuffer[0][0] = NULL; Framebuffer[0][1] = NULL;
     Framebuffer[1][0] = NULL; Framebuffer[1][1] = NULL;
@@ -158,7 +231,22 @@ bool Init()
 
 void DeInit()
 {
-    GPU2D_Renderer.reset();
+    StopDeferred2DThread();
+    Platform::Semaphore_Free(Sema_Deferred2DLine);
+    Platform::Semaphore_Free(Sema_Deferred2DDone);
+
+    for (int i = 0; i < 192; i++)
+    {
+        Deferred2DLog[i].Unit[0].reset();
+        Deferred2DLog[i].Unit[1].reset();
+    }
+
+    StopRender2DThread();
+    Platform::Semaphore_Free(Sema_Render2DStart);
+    Platform::Semaphore_Free(Sema_Render2DDone);
+
+    GPU2D_Renderer[0].reset();
+    GPU2D_Renderer[1].reset();
     GPU3D::DeInit();
 
     if (Framebuffer[0][0]) delete[] Framebuffer[0][0];
@@ -187,6 +275,10 @@ void ResetVRAMCache()
     memset(VRAMFlat_BBG, 0, sizeof(VRAMFlat_BBG));
     memset(VRAMFlat_AOBJ, 0, sizeof(VRAMFlat_AOBJ));
     memset(VRAMFlat_BOBJ, 0, sizeof(VRAMFlat_BOBJ));
+    memset(VRAMFlat_ABG4bpp, 0, sizeof(VRAMFlat_ABG4bpp));
+    memset(VRAMFlat_BBG4bpp, 0, sizeof(VRAMFlat_BBG4bpp));
+    memset(VRAMFlat_AOBJ4bpp, 0, sizeof(VRAMFlat_AOBJ4bpp));
+    memset(VRAMFlat_BOBJ4bpp, 0, sizeof(VRAMFlat_BOBJ4bpp));
     memset(VRAMFlat_ABGExtPal, 0, sizeof(VRAMFlat_ABGExtPal));
     memset(VRAMFlat_BBGExtPal, 0, sizeof(VRAMFlat_BBGExtPal));
     memset(VRAMFlat_AOBJExtPal, 0, sizeof(VRAMFlat_AOBJExtPal));
@@ -197,6 +289,8 @@ void ResetVRAMCache()
 
 void Reset()
 {
+    Sync2D();
+
     VCount = 0;
     NextVCount = -1;
     TotalScanlines = 0;
@@ -267,7 +361,8 @@ void Reset()
     GPU3D::Reset();
 
     int backbuf = FrontBuffer ? 0 : 1;
-    GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+    GPU2D_Renderer[0]->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+    GPU2D_Renderer[1]->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
 
     ResetRenderer();
 
@@ -279,6 +374,8 @@ void Reset()
 
 void Stop()
 {
+    Sync2D();
+
     int fbsize;
     if (GPU3D::CurrentRenderer->Accelerated)
         fbsize = (256*3 + 1) * 192;
@@ -300,6 +397,8 @@ void Stop()
 
 void DoSavestate(Savestate* file)
 {
+    Sync2D();
+
     file->Section("GPUG");
 
     file->Var16(&VCount);
@@ -361,19 +460,34 @@ void DoSavestate(Savestate* file)
     GPU2D_B.DoSavestate(file);
     GPU3D::DoSavestate(file);
 
-    ResetVRAMCache();
+    // saving leaves VRAM untouched, no need to throw away the renderer caches
+    if (!file->Saving)
+        ResetVRAMCache();
 }
 
 void AssignFramebuffers()
 {
-    int backbuf = FrontBuffer ? 0 : 1;
-    if (NDS::PowerControl9 & (1<<15))
+    Sync2D();
+
+    // with the screens swapped the other way, no scanline ends up where it was
+    bool swap = NDS::PowerControl9 & (1<<15);
+    if (swap != ScreenSwap)
     {
-        GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][0], Framebuffer[backbuf][1]);
+        ScreenSwap = swap;
+        ScreenSwapChanged = true;
     }
-    else
+
+    int backbuf = FrontBuffer ? 0 : 1;
+    for (int i = 0; i < 2; i++)
     {
-        GPU2D_Renderer->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+        if (NDS::PowerControl9 & (1<<15))
+        {
+            GPU2D_Renderer[i]->SetFramebuffer(Framebuffer[backbuf][0], Framebuffer[backbuf][1]);
+        }
+        else
+        {
+            GPU2D_Renderer[i]->SetFramebuffer(Framebuffer[backbuf][1], Framebuffer[backbuf][0]);
+        }
     }
 }
 
@@ -439,6 +553,8 @@ void ResetRenderer()
 
 void SetRenderSettings(int renderer, RenderSettings& settings)
 {
+    Sync2D();
+
     if (renderer != Renderer)
     {
         DeInitRenderer();
@@ -468,6 +584,16 @@ void SetRenderSettings(int renderer, RenderSettings& settings)
 
     AssignFramebuffers();
 
+    if (settings.Threaded2D)
+        SetupRender2DThread();
+    else
+        StopRender2DThread();
+
+    if (settings.Deferred2D)
+        SetupDeferred2DThread();
+    else
+        StopDeferred2DThread();
+
     if (Renderer == 0)
     {
         GPU3D::CurrentRenderer->SetRenderSettings(settings);
@@ -519,6 +645,48 @@ u8* GetUniqueBankPtr(u32 mask, u32 offset)
     return &VRAM[num][offset & VRAMMask[num]];
 }
 
+// LCDC: each bank has its own fixed range, same layout as ReadVRAM_LCDC
+bool GetLCDCBank(u32 addr, u32& bank, u32& ofs)
+{
+    ofs = addr & 0x000FFFFF;
+
+    if      (ofs < 0x80000) bank = ofs >> 17;
+    else if (ofs < 0x90000) bank = 4;
+    else if (ofs < 0x94000) bank = 5;
+    else if (ofs < 0x98000) bank = 6;
+    else if (ofs < 0xA0000) bank = 7;
+    else if (ofs < 0xA4000) bank = 8;
+    else return false;
+
+    ofs &= VRAMMask[bank];
+    return (VRAMMap_LCDC & (1<<bank)) != 0;
+}
+
+u8* GetVRAMPtr_LCDC(u32 addr)
+{
+    u32 bank, ofs;
+    if (!GetLCDCBank(addr, bank, ofs)) return NULL;
+    return &VRAM[bank][ofs & ~0x3FFF];
+}
+
+bool GetVRAMBank(u32 addr, u32& bank, u32& ofs)
+{
+    u32 mask;
+    switch (addr & 0x00E00000)
+    {
+    case 0x00000000: mask = VRAMMap_ABG[(addr >> 14) & 0x1F]; break;
+    case 0x00200000: mask = VRAMMap_BBG[(addr >> 14) & 0x7]; break;
+    case 0x00400000: mask = VRAMMap_AOBJ[(addr >> 14) & 0xF]; break;
+    case 0x00600000: mask = VRAMMap_BOBJ[(addr >> 14) & 0x7]; break;
+    default: return GetLCDCBank(addr, bank, ofs);
+    }
+
+    if (!mask || (mask & (mask - 1)) != 0) return false;
+    bank = __builtin_ctz(mask);
+    ofs = addr & VRAMMask[bank];
+    return true;
+}
+
 #define MAP_RANGE(map, base, n)    for (int i = 0; i < n; i++) VRAMMap_##map[(base)+i] |= bankmask;
 #define UNMAP_RANGE(map, base, n)  for (int i = 0; i < n; i++) VRAMMap_##map[(base)+i] &= ~bankmask;
 
@@ -534,6 +702,8 @@ void MapVRAM_AB(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u8 oldofs = (oldcnt >> 3) & 0x3;
     u8 ofs = (cnt >> 3) & 0x3;
     u32 bankmask = 1 << bank;
@@ -583,6 +753,8 @@ void MapVRAM_AB(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 void MapVRAM_CD(u32 bank, u8 cnt)
@@ -594,6 +766,8 @@ void MapVRAM_CD(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u8 oldofs = (oldcnt >> 3) & 0x7;
     u8 ofs = (cnt >> 3) & 0x7;
     u32 bankmask = 1 << bank;
@@ -667,6 +841,8 @@ void MapVRAM_CD(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 void MapVRAM_E(u32 bank, u8 cnt)
@@ -676,6 +852,8 @@ void MapVRAM_E(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u32 bankmask = 1 << bank;
 
     if (oldcnt & (1<<7))
@@ -729,6 +907,8 @@ void MapVRAM_E(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 void MapVRAM_FG(u32 bank, u8 cnt)
@@ -738,6 +918,8 @@ void MapVRAM_FG(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u8 oldofs = (oldcnt >> 3) & 0x7;
     u8 ofs = (cnt >> 3) & 0x7;
     u32 bankmask = 1 << bank;
@@ -827,6 +1009,8 @@ void MapVRAM_FG(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 void MapVRAM_H(u32 bank, u8 cnt)
@@ -836,6 +1020,8 @@ void MapVRAM_H(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u32 bankmask = 1 << bank;
 
     if (oldcnt & (1<<7))
@@ -887,6 +1073,8 @@ void MapVRAM_H(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 void MapVRAM_I(u32 bank, u8 cnt)
@@ -896,6 +1084,8 @@ void MapVRAM_I(u32 bank, u8 cnt)
 
     if (oldcnt == cnt) return;
 
+    if (Deferred2DPending) Sync2D();
+
     u32 bankmask = 1 << bank;
 
     if (oldcnt & (1<<7))
@@ -955,6 +1145,8 @@ void MapVRAM_I(u32 bank, u8 cnt)
             break;
         }
     }
+
+    NDS::UpdateBusMap(0x06);
 }
 
 
@@ -970,6 +1162,8 @@ void SetPowerCnt(u32 val)
 
     if (!(val & (1<<0))) printf("!!! CLEARING POWCNT BIT0. DANGER\n");
 
+    Sync2D();
+
     GPU2D_A.SetEnabled(val & (1<<1));
     GPU2D_B.SetEnabled(val & (1<<9));
     GPU3D::SetEnabled(val & (1<<3), val & (1<<2));
@@ -1012,6 +1206,169 @@ void StartFrame()
     StartScanline(0);
 }
 
+void Render2DEngine(int num)
+{
+    if (Render2DLine >= 0)
+        GPU2D_Renderer[num]->DrawScanline(Render2DLine, Render2DVCount, Render2DUnit[num]);
+    if (Render2DSpriteLine >= 0)
+        GPU2D_Renderer[num]->DrawSprites(Render2DSpriteLine, Render2DUnit[num]);
+}
+
+void Render2DThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_Render2DStart);
+        if (!Render2DThreadRunning) return;
+
+        Render2DEngine(1);
+        Platform::Semaphore_Post(Sema_Render2DDone);
+    }
+}
+
+void SetupRender2DThread()
+{
+    if (Render2DThreadRunning.load(std::memory_order_relaxed))
+        return;
+
+    Platform::Semaphore_Reset(Sema_Render2DStart);
+    Platform::Semaphore_Reset(Sema_Render2DDone);
+
+    Render2DThreadRunning = true;
+    Render2DThread = Platform::Thread_Create(Render2DThreadFunc);
+}
+
+void StopRender2DThread()
+{
+    if (Render2DThreadRunning.load(std::memory_order_relaxed))
+    {
+        Render2DThreadRunning = false;
+        Platform::Semaphore_Post(Sema_Render2DStart);
+        Platform::Thread_Wait(Render2DThread);
+        Platform::Thread_Free(Render2DThread);
+    }
+}
+
+// draws a scanline and/or pre-renders the sprites of a later one, for both engines
+// (a negative line skips that part)
+// when threaded, engine B is drawn on the 2D thread while engine A is drawn here.
+// both are done by the time this returns, before the CPUs or DMA can touch the 2D state again
+void Render2D(GPU2D::Unit* unitA, GPU2D::Unit* unitB, int line, u32 vcount, int spriteline)
+{
+    Render2DUnit[0] = unitA;
+    Render2DUnit[1] = unitB;
+    Render2DLine = line;
+    Render2DVCount = vcount;
+    Render2DSpriteLine = spriteline;
+
+    if (Render2DThreadRunning.load(std::memory_order_relaxed))
+    {
+        Platform::Semaphore_Post(Sema_Render2DStart);
+
+        Render2DEngine(0);
+
+        Platform::Semaphore_Wait(Sema_Render2DDone);
+    }
+    else
+    {
+        Render2DEngine(0);
+        Render2DEngine(1);
+    }
+}
+
+void Deferred2DThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_Deferred2DLine);
+        if (!Deferred2DThreadRunning) return;
+
+        if (Deferred2DRead == Deferred2DCount)
+        {
+            // caught up, this was a sync request
+            Platform::Semaphore_Post(Sema_Deferred2DDone);
+            continue;
+        }
+
+        Deferred2DLine& entry = Deferred2DLog[Deferred2DRead];
+        if (!entry.Restart)
+        {
+            // the reference points and mosaic counters carry on from the previous scanline
+            Deferred2DLine& prev = Deferred2DLog[Deferred2DRead - 1];
+            entry.Unit[0]->TakeRenderState(*prev.Unit[0]);
+            entry.Unit[1]->TakeRenderState(*prev.Unit[1]);
+        }
+
+        u64 profstart = Profiler::Begin();
+        Render2D(entry.Unit[0].get(), entry.Unit[1].get(), entry.Line, entry.Line, entry.SpriteLine);
+        Profiler::End(Profiler::Prof_GPU2D, profstart);
+        Deferred2DRead++;
+    }
+}
+
+void SetupDeferred2DThread()
+{
+    if (Deferred2DThreadRunning.load(std::memory_order_relaxed))
+        return;
+
+    Platform::Semaphore_Reset(Sema_Deferred2DLine);
+    Platform::Semaphore_Reset(Sema_Deferred2DDone);
+
+    Deferred2DThreadRunning = true;
+    Deferred2DThread = Platform::Thread_Create(Deferred2DThreadFunc);
+}
+
+void StopDeferred2DThread()
+{
+    if (Deferred2DThreadRunning.load(std::memory_order_relaxed))
+    {
+        Sync2D();
+
+        Deferred2DThreadRunning = false;
+        Platform::Semaphore_Post(Sema_Deferred2DLine);
+        Platform::Thread_Wait(Deferred2DThread);
+        Platform::Thread_Free(Deferred2DThread);
+    }
+}
+
+// records the registers for a scanline and leaves it to the deferred 2D thread
+void Defer2D(int line, int spriteline)
+{
+    Deferred2DLine& entry = Deferred2DLog[Deferred2DCount];
+    entry.Line = line;
+    entry.SpriteLine = spriteline;
+    entry.Restart = !Deferred2DPending;
+    entry.Unit[0]->CopyRegisters(GPU2D_A);
+    entry.Unit[1]->CopyRegisters(GPU2D_B);
+
+    GPU2D_A.RefReload = 0;
+    GPU2D_B.RefReload = 0;
+
+    Deferred2DCount++;
+    Deferred2DPending = true;
+    Platform::Semaphore_Post(Sema_Deferred2DLine);
+}
+
+void Sync2D()
+{
+    if (!Deferred2DPending)
+        return;
+
+    Platform::Semaphore_Post(Sema_Deferred2DLine);
+    Platform::Semaphore_Wait(Sema_Deferred2DDone);
+
+    // take back what the renderer updated as it went
+    Deferred2DLine& last = Deferred2DLog[Deferred2DCount - 1];
+    GPU2D_A.TakeRenderState(*last.Unit[0]);
+    GPU2D_B.TakeRenderState(*last.Unit[1]);
+    GPU2D_A.RefReload = 0;
+    GPU2D_B.RefReload = 0;
+
+    Deferred2DCount = 0;
+    Deferred2DRead = 0;
+    Deferred2DPending = false;
+}
+
 void StartHBlank(u32 line)
 {
     DispStat[0] |= (1<<1);
@@ -1019,21 +1376,30 @@ void StartHBlank(u32 line)
 
     if (VCount < 192)
     {
+        u64 profstart = Profiler::Begin();
+
         // draw
         // note: this should start 48 cycles after the scanline start
-        if (line < 192)
-        {
-            GPU2D_Renderer->DrawScanline(line, &GPU2D_A);
-            GPU2D_Renderer->DrawScanline(line, &GPU2D_B);
-        }
-
         // sprites are pre-rendered one scanline in advance
-        if (line < 191)
+        int spriteline = (line < 191) ? line+1 : -1;
+
+        // frames involving display capture or the display FIFO are drawn right away,
+        // as are scanlines shifted by VCount writes
+        if (line == 0)
+            Deferred2DFrame = Deferred2DThreadRunning.load(std::memory_order_relaxed)
+                && !RunFIFO && !(GPU2D_A.CaptureCnt & (1<<31))
+                && !GPU3D::CurrentRenderer->Accelerated;
+
+        if (Deferred2DFrame && VCount == line)
+            Defer2D(line, spriteline);
+        else
         {
-            GPU2D_Renderer->DrawSprites(line+1, &GPU2D_A);
-            GPU2D_Renderer->DrawSprites(line+1, &GPU2D_B);
+            Sync2D();
+            Render2D(&GPU2D_A, &GPU2D_B, (line < 192) ? line : -1, VCount, spriteline);
         }
 
+        Profiler::End(Profiler::Prof_GPU2D, profstart);
+
         NDS::CheckDMAs(0, 0x02);
     }
     else if (VCount == 215)
@@ -1042,8 +1408,8 @@ void StartHBlank(u32 line)
     }
     else if (VCount == 262)
     {
-        GPU2D_Renderer->DrawSprites(0, &GPU2D_A);
-        GPU2D_Renderer->DrawSprites(0, &GPU2D_B);
+        Sync2D();
+        Render2D(&GPU2D_A, &GPU2D_B, -1, VCount, 0);
     }
 
     if (DispStat[0] & (1<<4)) NDS::SetIRQ(0, NDS::IRQ_HBlank);
@@ -1057,6 +1423,13 @@ void StartHBlank(u32 line)
 
 void FinishFrame(u32 lines)
 {
+    Sync2D();
+
+    bool changed = GPU2D_Renderer[0]->TakeFrameChanged();
+    changed |= GPU2D_Renderer[1]->TakeFrameChanged();
+    FrontBufferChanged = changed || ScreenSwapChanged;
+    ScreenSwapChanged = false;
+
     FrontBuffer = FrontBuffer ? 0 : 1;
     AssignFramebuffers();
 
@@ -1113,7 +1486,7 @@ void StartScanline(u32 line)
     {
         if (line == 0)
         {
-            GPU2D_Renderer->VBlankEnd(&GPU2D_A, &GPU2D_B);
+            GPU2D_Renderer[0]->VBlankEnd(&GPU2D_A, &GPU2D_B);
             GPU2D_A.VBlankEnd();
             GPU2D_B.VBlankEnd();
         }
@@ -1133,6 +1506,8 @@ void StartScanline(u32 line)
     {
         if (VCount == 192)
         {
+            Sync2D();
+
             // in reality rendering already finishes at line 144
             // and games might already start to modify texture memory.
             // That doesn't matter for us because we cache the entire
@@ -1186,6 +1561,8 @@ void SetVCount(u16 val)
     // 3D engine seems to give up on the current frame in that situation, repeating the last two scanlines
     // TODO: also check the various DMA types that can be involved
 
+    Sync2D();
+
     GPU3D::AbortFrame |= NextVCount != val;
     NextVCount = val;
 }
@@ -1298,22 +1675,72 @@ bool MakeVRAMFlat_TexPalCoherent(NonStupidBitField<128*1024/VRAMDirtyGranularity
     return CopyLinearVRAM<16*1024>(VRAMFlat_TexPal, VRAMMap_TexPal, dirty, ReadVRAM_TexPal<u64>);
 }
 
+// splits each byte of the dirty regions into two pixels, low nibble first
+// so 16-color tiles can be read the same way as 256-color ones
+template <u32 Size>
+inline void Expand4bppVRAM(u8* expanded, u8* flat, NonStupidBitField<Size>& dirty)
+{
+    typename NonStupidBitField<Size>::Iterator it = dirty.Begin();
+    while (it != dirty.End())
+    {
+        u32 offset = *it * VRAMDirtyGranularity;
+        u8* src = flat + offset;
+        u8* dst = expanded + offset*2;
+
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        for (u32 i = 0; i < VRAMDirtyGranularity; i += 16)
+        {
+            __m128i val = _mm_loadu_si128((__m128i*)&src[i]);
+            __m128i lo = _mm_and_si128(val, mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(val, 4), mask);
+            _mm_storeu_si128((__m128i*)&dst[i*2], _mm_unpacklo_epi8(lo, hi));
+            _mm_storeu_si128((__m128i*)&dst[i*2 + 16], _mm_unpackhi_epi8(lo, hi));
+        }
+#elif defined(__aarch64__)
+        for (u32 i = 0; i < VRAMDirtyGranularity; i += 16)
+        {
+            uint8x16_t val = vld1q_u8(&src[i]);
+            uint8x16x2_t pixels;
+            pixels.val[0] = vandq_u8(val, vdupq_n_u8(0x0F));
+            pixels.val[1] = vshrq_n_u8(val, 4);
+            vst2q_u8(&dst[i*2], pixels);
+        }
+#else
+        for (u32 i = 0; i < VRAMDirtyGranularity; i++)
+        {
+            dst[i*2] = src[i] & 0x0F;
+            dst[i*2 + 1] = src[i] >> 4;
+        }
+#endif
+        it++;
+    }
+}
+
 bool MakeVRAMFlat_ABGCoherent(NonStupidBitField<512*1024/VRAMDirtyGranularity>& dirty)
 {
-    return CopyLinearVRAM<16*1024>(VRAMFlat_ABG, VRAMMap_ABG, dirty, ReadVRAM_ABG<u64>);
+    bool change = CopyLinearVRAM<16*1024>(VRAMFlat_ABG, VRAMMap_ABG, dirty, ReadVRAM_ABG<u64>);
+    Expand4bppVRAM(VRAMFlat_ABG4bpp, VRAMFlat_ABG, dirty);
+    return change;
 }
 bool MakeVRAMFlat_BBGCoherent(NonStupidBitField<128*1024/VRAMDirtyGranularity>& dirty)
 {
-    return CopyLinearVRAM<16*1024>(VRAMFlat_BBG, VRAMMap_BBG, dirty, ReadVRAM_BBG<u64>);
+    bool change = CopyLinearVRAM<16*1024>(VRAMFlat_BBG, VRAMMap_BBG, dirty, ReadVRAM_BBG<u64>);
+    Expand4bppVRAM(VRAMFlat_BBG4bpp, VRAMFlat_BBG, dirty);
+    return change;
 }
 
 bool MakeVRAMFlat_AOBJCoherent(NonStupidBitField<256*1024/VRAMDirtyGranularity>& dirty)
 {
-    return CopyLinearVRAM<16*1024>(VRAMFlat_AOBJ, VRAMMap_AOBJ, dirty, ReadVRAM_AOBJ<u64>);
+    bool change = CopyLinearVRAM<16*1024>(VRAMFlat_AOBJ, VRAMMap_AOBJ, dirty, ReadVRAM_AOBJ<u64>);
+    Expand4bppVRAM(VRAMFlat_AOBJ4bpp, VRAMFlat_AOBJ, dirty);
+    return change;
 }
 bool MakeVRAMFlat_BOBJCoherent(NonStupidBitField<128*1024/VRAMDirtyGranularity>& dirty)
 {
-    return CopyLinearVRAM<16*1024>(VRAMFlat_BOBJ, VRAMMap_BOBJ, dirty, ReadVRAM_BOBJ<u64>);
+    bool change = CopyLinearVRAM<16*1024>(VRAMFlat_BOBJ, VRAMMap_BOBJ, dirty, ReadVRAM_BOBJ<u64>);
+    Expand4bppVRAM(VRAMFlat_BOBJ4bpp, VRAMFlat_BOBJ, dirty);
+    return change;
 }
 
 template<typename T>
@@ -79,8 +79,14 @@ extern u8* VRAMPtr_AOBJ[0x10];
 extern u8* VRAMPtr_BBG[0x8];
 extern u8* VRAMPtr_BOBJ[0x8];
 
+// start of the 16K chunk of the LCDC region addr is in, NULL if nothing is mapped there
+u8* GetVRAMPtr_LCDC(u32 addr);
+// bank and offset behind an ARM9 VRAM address, false unless exactly one bank is mapped there
+bool GetVRAMBank(u32 addr, u32& bank, u32& ofs);
+
 extern int FrontBuffer;
 extern u32* Framebuffer[2][2];
+extern bool FrontBufferChanged; // false when the last finished frame is identical to the one before
 
 extern GPU2D::Unit GPU2D_A;
 extern GPU2D::Unit GPU2D_B;
@@ -128,6 +134,11 @@ extern u8 VRAMFlat_BBG[128*1024];
 extern u8 VRAMFlat_AOBJ[256*1024];
 extern u8 VRAMFlat_BOBJ[128*1024];
 
+extern u8 VRAMFlat_ABG4bpp[512*1024*2];
+extern u8 VRAMFlat_BBG4bpp[128*1024*2];
+extern u8 VRAMFlat_AOBJ4bpp[256*1024*2];
+extern u8 VRAMFlat_BOBJ4bpp[128*1024*2];
+
 extern u8 VRAMFlat_ABGExtPal[32*1024];
 extern u8 VRAMFlat_BBGExtPal[32*1024];
 
@@ -164,6 +175,10 @@ extern std::unique_ptr<GLCompositor> CurGLCompositor;
 struct RenderSettings
 {
     bool Soft_Threaded;
+    int Soft_Threads; // how many threads the software renderer splits each frame across
+    bool Soft_ScalarFactors; // don't vectorize the perspective divide, to check the vector paths against
+    bool Threaded2D; // draw the two 2D engines in parallel
+    bool Deferred2D; // draw the 2D engines on a worker thread, behind emulation
 
     int GL_ScaleFactor;
     bool GL_BetterPolygons;
@@ -193,6 +208,11 @@ void MapVRAM_FG(u32 bank, u8 cnt);
 void MapVRAM_H(u32 bank, u8 cnt);
 void MapVRAM_I(u32 bank, u8 cnt);
 
+// with deferred 2D rendering, the 2D thread may still be drawing earlier scanlines
+// anything it reads (VRAM, palette, OAM, mappings) must wait for it before being modified
+extern bool Deferred2DPending;
+void Sync2D();
+
 
 template<typename T>
 T ReadVRAM_LCDC(u32 addr)
@@ -262,6 +282,8 @@ T ReadVRAM_LCDC(u32 addr)
 template<typename T>
 void WriteVRAM_LCDC(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     int bank;
 
     switch (addr & 0xFF8FC000)
@@ -350,6 +372,8 @@ T ReadVRAM_ABG(u32 addr)
 template<typename T>
 void WriteVRAM_ABG(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     u32 mask = VRAMMap_ABG[(addr >> 14) & 0x1F];
 
     if (mask & (1<<0))
@@ -411,6 +435,8 @@ T ReadVRAM_AOBJ(u32 addr)
 template<typename T>
 void WriteVRAM_AOBJ(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     u32 mask = VRAMMap_AOBJ[(addr >> 14) & 0xF];
 
     if (mask & (1<<0))
@@ -460,6 +486,8 @@ T ReadVRAM_BBG(u32 addr)
 template<typename T>
 void WriteVRAM_BBG(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     u32 mask = VRAMMap_BBG[(addr >> 14) & 0x7];
 
     if (mask & (1<<2))
@@ -498,6 +526,8 @@ T ReadVRAM_BOBJ(u32 addr)
 template<typename T>
 void WriteVRAM_BOBJ(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     u32 mask = VRAMMap_BOBJ[(addr >> 14) & 0x7];
 
     if (mask & (1<<3))
@@ -589,6 +619,8 @@ T ReadPalette(u32 addr)
 template<typename T>
 void WritePalette(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     addr &= 0x7FF;
 
     *(T*)&Palette[addr] = val;
@@ -604,6 +636,8 @@ T ReadOAM(u32 addr)
 template<typename T>
 void WriteOAM(u32 addr, T val)
 {
+    if (Deferred2DPending) Sync2D();
+
     addr &= 0x7FF;
 
     *(T*)&OAM[addr] = val;
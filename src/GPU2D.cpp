@@ -99,6 +99,7 @@ void Unit::Reset()
     memset(BGYRef, 0, 2*4);
     memset(BGXRefInternal, 0, 2*4);
     memset(BGYRefInternal, 0, 2*4);
+    RefReload = 0;
     memset(BGRotA, 0, 2*2);
     memset(BGRotB, 0, 2*2);
     memset(BGRotC, 0, 2*2);
@@ -420,21 +421,21 @@ void Unit::Write16(u32 addr, u16 val)
     case 0x026: BGRotD[0] = val; return;
     case 0x028:
         BGXRef[0] = (BGXRef[0] & 0xFFFF0000) | val;
-        if (GPU::VCount < 192) BGXRefInternal[0] = BGXRef[0];
+        if (GPU::VCount < 192) ReloadBGXRef(0);
         return;
     case 0x02A:
         if (val & 0x0800) val |= 0xF000;
         BGXRef[0] = (BGXRef[0] & 0xFFFF) | (val << 16);
-        if (GPU::VCount < 192) BGXRefInternal[0] = BGXRef[0];
+        if (GPU::VCount < 192) ReloadBGXRef(0);
         return;
     case 0x02C:
         BGYRef[0] = (BGYRef[0] & 0xFFFF0000) | val;
-        if (GPU::VCount < 192) BGYRefInternal[0] = BGYRef[0];
+        if (GPU::VCount < 192) ReloadBGYRef(0);
         return;
     case 0x02E:
         if (val & 0x0800) val |= 0xF000;
         BGYRef[0] = (BGYRef[0] & 0xFFFF) | (val << 16);
-        if (GPU::VCount < 192) BGYRefInternal[0] = BGYRef[0];
+        if (GPU::VCount < 192) ReloadBGYRef(0);
         return;
 
     case 0x030: BGRotA[1] = val; return;
@@ -443,21 +444,21 @@ void Unit::Write16(u32 addr, u16 val)
     case 0x036: BGRotD[1] = val; return;
     case 0x038:
         BGXRef[1] = (BGXRef[1] & 0xFFFF0000) | val;
-        if (GPU::VCount < 192) BGXRefInternal[1] = BGXRef[1];
+        if (GPU::VCount < 192) ReloadBGXRef(1);
         return;
     case 0x03A:
         if (val & 0x0800) val |= 0xF000;
         BGXRef[1] = (BGXRef[1] & 0xFFFF) | (val << 16);
-        if (GPU::VCount < 192) BGXRefInternal[1] = BGXRef[1];
+        if (GPU::VCount < 192) ReloadBGXRef(1);
         return;
     case 0x03C:
         BGYRef[1] = (BGYRef[1] & 0xFFFF0000) | val;
-        if (GPU::VCount < 192) BGYRefInternal[1] = BGYRef[1];
+        if (GPU::VCount < 192) ReloadBGYRef(1);
         return;
     case 0x03E:
         if (val & 0x0800) val |= 0xF000;
         BGYRef[1] = (BGYRef[1] & 0xFFFF) | (val << 16);
-        if (GPU::VCount < 192) BGYRefInternal[1] = BGYRef[1];
+        if (GPU::VCount < 192) ReloadBGYRef(1);
         return;
 
     case 0x040:
@@ -541,23 +542,23 @@ void Unit::Write32(u32 addr, u32 val)
     case 0x028:
         if (val & 0x08000000) val |= 0xF0000000;
         BGXRef[0] = val;
-        if (GPU::VCount < 192) BGXRefInternal[0] = BGXRef[0];
+        if (GPU::VCount < 192) ReloadBGXRef(0);
         return;
     case 0x02C:
         if (val & 0x08000000) val |= 0xF0000000;
         BGYRef[0] = val;
-        if (GPU::VCount < 192) BGYRefInternal[0] = BGYRef[0];
+        if (GPU::VCount < 192) ReloadBGYRef(0);
         return;
 
     case 0x038:
         if (val & 0x08000000) val |= 0xF0000000;
         BGXRef[1] = val;
-        if (GPU::VCount < 192) BGXRefInternal[1] = BGXRef[1];
+        if (GPU::VCount < 192) ReloadBGXRef(1);
         return;
     case 0x03C:
         if (val & 0x08000000) val |= 0xF0000000;
         BGYRef[1] = val;
-        if (GPU::VCount < 192) BGYRefInternal[1] = BGYRef[1];
+        if (GPU::VCount < 192) ReloadBGYRef(1);
         return;
     }
 
@@ -610,6 +611,85 @@ void Unit::VBlankEnd()
     //OBJMosaicYCount = 0;
 }
 
+void Unit::ReloadBGXRef(u32 n)
+{
+    BGXRefInternal[n] = BGXRef[n];
+    RefReload |= (1 << n);
+}
+
+void Unit::ReloadBGYRef(u32 n)
+{
+    BGYRefInternal[n] = BGYRef[n];
+    RefReload |= (4 << n);
+}
+
+void Unit::CopyRegisters(const Unit& src)
+{
+    // the display FIFO isn't copied, frames which use it aren't deferred
+    Enabled = src.Enabled;
+
+    DispCnt = src.DispCnt;
+    memcpy(BGCnt, src.BGCnt, sizeof(BGCnt));
+
+    memcpy(BGXPos, src.BGXPos, sizeof(BGXPos));
+    memcpy(BGYPos, src.BGYPos, sizeof(BGYPos));
+
+    memcpy(BGXRef, src.BGXRef, sizeof(BGXRef));
+    memcpy(BGYRef, src.BGYRef, sizeof(BGYRef));
+    memcpy(BGXRefInternal, src.BGXRefInternal, sizeof(BGXRefInternal));
+    memcpy(BGYRefInternal, src.BGYRefInternal, sizeof(BGYRefInternal));
+    RefReload = src.RefReload;
+    memcpy(BGRotA, src.BGRotA, sizeof(BGRotA));
+    memcpy(BGRotB, src.BGRotB, sizeof(BGRotB));
+    memcpy(BGRotC, src.BGRotC, sizeof(BGRotC));
+    memcpy(BGRotD, src.BGRotD, sizeof(BGRotD));
+
+    memcpy(Win0Coords, src.Win0Coords, sizeof(Win0Coords));
+    memcpy(Win1Coords, src.Win1Coords, sizeof(Win1Coords));
+    memcpy(WinCnt, src.WinCnt, sizeof(WinCnt));
+    Win0Active = src.Win0Active;
+    Win1Active = src.Win1Active;
+
+    memcpy(BGMosaicSize, src.BGMosaicSize, sizeof(BGMosaicSize));
+    memcpy(OBJMosaicSize, src.OBJMosaicSize, sizeof(OBJMosaicSize));
+    BGMosaicY = src.BGMosaicY;
+    BGMosaicYMax = src.BGMosaicYMax;
+    OBJMosaicYCount = src.OBJMosaicYCount;
+    OBJMosaicY = src.OBJMosaicY;
+    OBJMosaicYMax = src.OBJMosaicYMax;
+
+    BlendCnt = src.BlendCnt;
+    BlendAlpha = src.BlendAlpha;
+    EVA = src.EVA;
+    EVB = src.EVB;
+    EVY = src.EVY;
+
+    CaptureLatch = src.CaptureLatch;
+    CaptureCnt = src.CaptureCnt;
+
+    MasterBrightness = src.MasterBrightness;
+}
+
+void Unit::TakeRenderState(const Unit& src)
+{
+    // reference points written since the last scanline (RefReload) were already reloaded here
+    for (int i = 0; i < 2; i++)
+    {
+        if (!(RefReload & (1 << i))) BGXRefInternal[i] = src.BGXRefInternal[i];
+        if (!(RefReload & (4 << i))) BGYRefInternal[i] = src.BGYRefInternal[i];
+    }
+
+    // the horizontal window state (bit 1) is updated by the renderer, the vertical one by CheckWindows()
+    Win0Active = (Win0Active & ~0x2) | (src.Win0Active & 0x2);
+    Win1Active = (Win1Active & ~0x2) | (src.Win1Active & 0x2);
+
+    BGMosaicY = src.BGMosaicY;
+    BGMosaicYMax = src.BGMosaicYMax;
+    OBJMosaicY = src.OBJMosaicY;
+    OBJMosaicYCount = src.OBJMosaicYCount;
+    CaptureLatch = src.CaptureLatch;
+}
+
 void Unit::SampleFIFO(u32 offset, u32 num)
 {
     for (u32 i = 0; i < num; i++)
@@ -721,4 +801,33 @@ void Unit::GetOBJVRAM(u8*& data, u32& mask)
     }
 }
 
+// 16-color tile data with one byte per pixel, addresses are doubled
+void Unit::GetBGVRAM4bpp(u8*& data, u32& mask)
+{
+    if (Num == 0)
+    {
+        data = GPU::VRAMFlat_ABG4bpp;
+        mask = 0xFFFFF;
+    }
+    else
+    {
+        data = GPU::VRAMFlat_BBG4bpp;
+        mask = 0x3FFFF;
+    }
+}
+
+void Unit::GetOBJVRAM4bpp(u8*& data, u32& mask)
+{
+    if (Num == 0)
+    {
+        data = GPU::VRAMFlat_AOBJ4bpp;
+        mask = 0x7FFFF;
+    }
+    else
+    {
+        data = GPU::VRAMFlat_BOBJ4bpp;
+        mask = 0x3FFFF;
+    }
+}
+
 }
\ No newline at end of file
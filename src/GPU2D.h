@@ -68,10 +68,16 @@ public:
 
     void GetBGVRAM(u8*& data, u32& mask);
     void GetOBJVRAM(u8*& data, u32& mask);
+    void GetBGVRAM4bpp(u8*& data, u32& mask);
+    void GetOBJVRAM4bpp(u8*& data, u32& mask);
 
     void UpdateMosaicCounters(u32 line);
     void CalculateWindowMask(u32 line, u8* windowMask, u8* objWindow);
 
+    // deferred 2D rendering works on per-scanline copies of the units
+    void CopyRegisters(const Unit& src);
+    void TakeRenderState(const Unit& src);
+
     u32 Num;
     bool Enabled;
 
@@ -91,6 +97,7 @@ public:
     s32 BGYRef[2];
     s32 BGXRefInternal[2];
     s32 BGYRefInternal[2];
+    u8 RefReload; // internal reference points reloaded by a write since the last deferred scanline
     s16 BGRotA[2];
     s16 BGRotB[2];
     s16 BGRotC[2];
@@ -116,6 +123,10 @@ public:
     u32 CaptureCnt;
 
     u16 MasterBrightness;
+
+private:
+    void ReloadBGXRef(u32 n);
+    void ReloadBGYRef(u32 n);
 };
 
 class Renderer2D
@@ -123,7 +134,7 @@ class Renderer2D
 public:
     virtual ~Renderer2D() {}
 
-    virtual void DrawScanline(u32 line, Unit* unit) = 0;
+    virtual void DrawScanline(u32 line, u32 vcount, Unit* unit) = 0;
     virtual void DrawSprites(u32 line, Unit* unit) = 0;
 
     virtual void VBlankEnd(Unit* unitA, Unit* unitB) = 0;
@@ -133,10 +144,28 @@ public:
         Framebuffer[0] = unitA;
         Framebuffer[1] = unitB;
     }
+
+    // whether the scanlines drawn since the last call differ from the frame before them
+    // a frame that skipped scanlines (VCount writes) leaves stale ones in the buffer,
+    // so it and the one after it always count as changed
+    bool TakeFrameChanged()
+    {
+        bool complete = (LinesDrawn[0] & LinesDrawn[1] & LinesDrawn[2]) == ~0ULL;
+        bool changed = FrameChanged || !complete || !LastFrameComplete;
+
+        FrameChanged = false;
+        LastFrameComplete = complete;
+        LinesDrawn[0] = LinesDrawn[1] = LinesDrawn[2] = 0;
+        return changed;
+    }
 protected:
     u32* Framebuffer[2];
 
     Unit* CurUnit;
+
+    bool FrameChanged = true;
+    bool LastFrameComplete = false;
+    u64 LinesDrawn[3] = {};
 };
 
 }
@@ -18,6 +18,13 @@
 
 #include "GPU2D_Soft.h"
 #include "GPU.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace GPU2D
 {
@@ -25,6 +32,8 @@ namespace GPU2D
 SoftRenderer::SoftRenderer()
     : Renderer2D()
 {
+    memset(LineHash, 0, sizeof(LineHash));
+
     // initialize mosaic table
     for (int m = 0; m < 16; m++)
     {
@@ -168,7 +177,383 @@ u32 SoftRenderer::ColorComposite(int i, u32 val1, u32 val2)
     return val1;
 }
 
-void SoftRenderer::DrawScanline(u32 line, Unit* unit)
+// vectorized versions of the above, four pixels at a time
+// they rely on EVA/EVB/EVY and sprite alpha being at most 16,
+// which lets every per-channel product fit in 16 bits
+
+#if defined(__SSE2__)
+
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128i TestBits(__m128i val, __m128i bits)
+{
+    __m128i zero = _mm_cmpeq_epi32(_mm_and_si128(val, bits), _mm_setzero_si128());
+    return _mm_xor_si128(zero, _mm_set1_epi32(-1));
+}
+
+// spread a per-pixel factor over the four 16-bit channels of each pixel
+static inline void SpreadFactor(__m128i factor, __m128i& lo, __m128i& hi)
+{
+    factor = _mm_or_si128(factor, _mm_slli_epi32(factor, 16));
+    lo = _mm_unpacklo_epi32(factor, factor);
+    hi = _mm_unpackhi_epi32(factor, factor);
+}
+
+static inline __m128i ColorBlend4x4(__m128i val1, __m128i val2, __m128i eva, __m128i evb)
+{
+    const __m128i colormask = _mm_set1_epi32(0x003F3F3F);
+    const __m128i max = _mm_set1_epi16(0x3F);
+    const __m128i zero = _mm_setzero_si128();
+
+    val1 = _mm_and_si128(val1, colormask);
+    val2 = _mm_and_si128(val2, colormask);
+
+    __m128i evalo, evahi, evblo, evbhi;
+    SpreadFactor(eva, evalo, evahi);
+    SpreadFactor(evb, evblo, evbhi);
+
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(val1, zero), evalo),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(val2, zero), evblo));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(val1, zero), evahi),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(val2, zero), evbhi));
+    lo = _mm_min_epi16(_mm_srli_epi16(lo, 4), max);
+    hi = _mm_min_epi16(_mm_srli_epi16(hi, 4), max);
+
+    return _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFF000000));
+}
+
+static inline __m128i ColorBlend5x4(__m128i val1, __m128i val2)
+{
+    const __m128i colormask = _mm_set1_epi32(0x003F3F3F);
+    const __m128i max = _mm_set1_epi16(0x3F);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i eva = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(val1, 24), _mm_set1_epi32(0x1F)), _mm_set1_epi32(1));
+    __m128i evb = _mm_sub_epi32(_mm_set1_epi32(32), eva);
+    __m128i round = _mm_and_si128(_mm_cmplt_epi32(eva, _mm_set1_epi32(17)), _mm_set1_epi32(1));
+    __m128i full = _mm_cmpeq_epi32(eva, _mm_set1_epi32(32));
+
+    __m128i c1 = _mm_and_si128(val1, colormask);
+    __m128i c2 = _mm_and_si128(val2, colormask);
+
+    __m128i evalo, evahi, evblo, evbhi, roundlo, roundhi;
+    SpreadFactor(eva, evalo, evahi);
+    SpreadFactor(evb, evblo, evbhi);
+    SpreadFactor(round, roundlo, roundhi);
+
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c1, zero), evalo),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(c2, zero), evblo));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c1, zero), evahi),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(c2, zero), evbhi));
+    lo = _mm_min_epi16(_mm_add_epi16(_mm_srli_epi16(lo, 5), roundlo), max);
+    hi = _mm_min_epi16(_mm_add_epi16(_mm_srli_epi16(hi, 5), roundhi), max);
+
+    __m128i ret = _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFF000000));
+    return Select(full, val1, ret);
+}
+
+static inline __m128i ColorBrightnessUpx4(__m128i val, __m128i factor)
+{
+    const __m128i max = _mm_set1_epi16(0x3F);
+    const __m128i zero = _mm_setzero_si128();
+
+    val = _mm_and_si128(val, _mm_set1_epi32(0x003F3F3F));
+    __m128i lo = _mm_unpacklo_epi8(val, zero);
+    __m128i hi = _mm_unpackhi_epi8(val, zero);
+    lo = _mm_add_epi16(lo, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(max, lo), factor), 4));
+    hi = _mm_add_epi16(hi, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(max, hi), factor), 4));
+
+    return _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFF000000));
+}
+
+static inline __m128i ColorBrightnessDownx4(__m128i val, __m128i factor)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    val = _mm_and_si128(val, _mm_set1_epi32(0x003F3F3F));
+    __m128i lo = _mm_unpacklo_epi8(val, zero);
+    __m128i hi = _mm_unpackhi_epi8(val, zero);
+    lo = _mm_sub_epi16(lo, _mm_srli_epi16(_mm_mullo_epi16(lo, factor), 4));
+    hi = _mm_sub_epi16(hi, _mm_srli_epi16(_mm_mullo_epi16(hi, factor), 4));
+
+    return _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xFF000000));
+}
+
+#elif defined(__aarch64__)
+
+static inline uint32x4_t TestBits(uint32x4_t val, uint32x4_t bits)
+{
+    return vtstq_u32(val, bits);
+}
+
+// spread a per-pixel factor over the four 16-bit channels of each pixel
+static inline void SpreadFactor(uint32x4_t factor, uint16x8_t& lo, uint16x8_t& hi)
+{
+    factor = vorrq_u32(factor, vshlq_n_u32(factor, 16));
+    lo = vreinterpretq_u16_u32(vzip1q_u32(factor, factor));
+    hi = vreinterpretq_u16_u32(vzip2q_u32(factor, factor));
+}
+
+static inline uint32x4_t PackColor(uint16x8_t lo, uint16x8_t hi)
+{
+    uint8x16_t ret = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+    return vorrq_u32(vreinterpretq_u32_u8(ret), vdupq_n_u32(0xFF000000));
+}
+
+static inline uint32x4_t ColorBlend4x4(uint32x4_t val1, uint32x4_t val2, uint32x4_t eva, uint32x4_t evb)
+{
+    const uint16x8_t max = vdupq_n_u16(0x3F);
+
+    uint8x16_t c1 = vreinterpretq_u8_u32(vandq_u32(val1, vdupq_n_u32(0x003F3F3F)));
+    uint8x16_t c2 = vreinterpretq_u8_u32(vandq_u32(val2, vdupq_n_u32(0x003F3F3F)));
+
+    uint16x8_t evalo, evahi, evblo, evbhi;
+    SpreadFactor(eva, evalo, evahi);
+    SpreadFactor(evb, evblo, evbhi);
+
+    uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(c1)), evalo), vmovl_u8(vget_low_u8(c2)), evblo);
+    uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(c1)), evahi), vmovl_u8(vget_high_u8(c2)), evbhi);
+    lo = vminq_u16(vshrq_n_u16(lo, 4), max);
+    hi = vminq_u16(vshrq_n_u16(hi, 4), max);
+
+    return PackColor(lo, hi);
+}
+
+static inline uint32x4_t ColorBlend5x4(uint32x4_t val1, uint32x4_t val2)
+{
+    const uint16x8_t max = vdupq_n_u16(0x3F);
+
+    uint32x4_t eva = vaddq_u32(vandq_u32(vshrq_n_u32(val1, 24), vdupq_n_u32(0x1F)), vdupq_n_u32(1));
+    uint32x4_t evb = vsubq_u32(vdupq_n_u32(32), eva);
+    uint32x4_t round = vandq_u32(vcltq_u32(eva, vdupq_n_u32(17)), vdupq_n_u32(1));
+    uint32x4_t full = vceqq_u32(eva, vdupq_n_u32(32));
+
+    uint8x16_t c1 = vreinterpretq_u8_u32(vandq_u32(val1, vdupq_n_u32(0x003F3F3F)));
+    uint8x16_t c2 = vreinterpretq_u8_u32(vandq_u32(val2, vdupq_n_u32(0x003F3F3F)));
+
+    uint16x8_t evalo, evahi, evblo, evbhi, roundlo, roundhi;
+    SpreadFactor(eva, evalo, evahi);
+    SpreadFactor(evb, evblo, evbhi);
+    SpreadFactor(round, roundlo, roundhi);
+
+    uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(c1)), evalo), vmovl_u8(vget_low_u8(c2)), evblo);
+    uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(c1)), evahi), vmovl_u8(vget_high_u8(c2)), evbhi);
+    lo = vminq_u16(vaddq_u16(vshrq_n_u16(lo, 5), roundlo), max);
+    hi = vminq_u16(vaddq_u16(vshrq_n_u16(hi, 5), roundhi), max);
+
+    return vbslq_u32(full, val1, PackColor(lo, hi));
+}
+
+static inline uint32x4_t ColorBrightnessUpx4(uint32x4_t val, uint16x8_t factor)
+{
+    const uint16x8_t max = vdupq_n_u16(0x3F);
+
+    uint8x16_t c = vreinterpretq_u8_u32(vandq_u32(val, vdupq_n_u32(0x003F3F3F)));
+    uint16x8_t lo = vmovl_u8(vget_low_u8(c));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(c));
+    lo = vaddq_u16(lo, vshrq_n_u16(vmulq_u16(vsubq_u16(max, lo), factor), 4));
+    hi = vaddq_u16(hi, vshrq_n_u16(vmulq_u16(vsubq_u16(max, hi), factor), 4));
+
+    return PackColor(lo, hi);
+}
+
+static inline uint32x4_t ColorBrightnessDownx4(uint32x4_t val, uint16x8_t factor)
+{
+    uint8x16_t c = vreinterpretq_u8_u32(vandq_u32(val, vdupq_n_u32(0x003F3F3F)));
+    uint16x8_t lo = vmovl_u8(vget_low_u8(c));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(c));
+    lo = vsubq_u16(lo, vshrq_n_u16(vmulq_u16(lo, factor), 4));
+    hi = vsubq_u16(hi, vshrq_n_u16(vmulq_u16(hi, factor), 4));
+
+    return PackColor(lo, hi);
+}
+
+#endif
+
+void SoftRenderer::ColorCompositeLine()
+{
+    // same decisions as ColorComposite(), made for four pixels at once
+    // BGOBJLine[0..255] receives the composited result
+
+#if defined(__SSE2__)
+    const __m128i blendcnt = _mm_set1_epi32(CurUnit->BlendCnt);
+    const __m128i eva = _mm_set1_epi32(CurUnit->EVA);
+    const __m128i evb = _mm_set1_epi32(CurUnit->EVB);
+    const __m128i evy = _mm_set1_epi16(CurUnit->EVY);
+    const __m128i zero = _mm_setzero_si128();
+    u32 coloreffect = (CurUnit->BlendCnt >> 6) & 0x3;
+
+    for (int i = 0; i < 256; i += 4)
+    {
+        __m128i val1 = _mm_loadu_si128((__m128i*)&BGOBJLine[i]);
+        __m128i val2 = _mm_loadu_si128((__m128i*)&BGOBJLine[256+i]);
+        __m128i flag1 = _mm_srli_epi32(val1, 24);
+        __m128i flag2 = _mm_srli_epi32(val2, 24);
+
+        __m128i win = _mm_cvtsi32_si128(*(u32*)&WindowMask[i]);
+        win = _mm_unpacklo_epi16(_mm_unpacklo_epi8(win, zero), zero);
+
+        __m128i obj1 = TestBits(flag1, _mm_set1_epi32(0x80));
+        __m128i bg3d1 = TestBits(flag1, _mm_set1_epi32(0x40));
+        __m128i obj2 = TestBits(flag2, _mm_set1_epi32(0x80));
+        __m128i bg3d2 = TestBits(flag2, _mm_set1_epi32(0x40));
+
+        __m128i target2 = Select(obj2, _mm_set1_epi32(0x1000),
+                                 Select(bg3d2, _mm_set1_epi32(0x0100), _mm_slli_epi32(flag2, 8)));
+        __m128i target1 = Select(obj1, _mm_set1_epi32(0x10),
+                                 Select(bg3d1, _mm_set1_epi32(0x01), flag1));
+        __m128i second = TestBits(target2, blendcnt);
+        __m128i first = _mm_and_si128(TestBits(target1, blendcnt), TestBits(win, _mm_set1_epi32(0x20)));
+
+        __m128i objblend = _mm_and_si128(obj1, second);
+        __m128i blend3d = _mm_andnot_si128(obj1, _mm_and_si128(bg3d1, second));
+        __m128i regular = _mm_andnot_si128(_mm_or_si128(objblend, blend3d), first);
+
+        __m128i blend4 = objblend;
+        if (coloreffect == 1)
+            blend4 = _mm_or_si128(blend4, _mm_and_si128(regular, second));
+        else if (coloreffect == 0)
+            regular = zero;
+
+        __m128i all = _mm_or_si128(_mm_or_si128(blend4, blend3d), regular);
+        if (!_mm_movemask_epi8(all))
+            continue;
+
+        __m128i ret = val1;
+        if (_mm_movemask_epi8(blend4))
+        {
+            // bitmap sprites use their own alpha
+            __m128i bmp = _mm_and_si128(obj1, bg3d1);
+            __m128i sprite_eva = _mm_and_si128(flag1, _mm_set1_epi32(0x1F));
+            __m128i eva1 = Select(bmp, sprite_eva, eva);
+            __m128i evb1 = Select(bmp, _mm_sub_epi32(_mm_set1_epi32(16), sprite_eva), evb);
+            ret = Select(blend4, ColorBlend4x4(val1, val2, eva1, evb1), ret);
+        }
+        if (_mm_movemask_epi8(blend3d))
+            ret = Select(blend3d, ColorBlend5x4(val1, val2), ret);
+        if (coloreffect >= 2 && _mm_movemask_epi8(regular))
+        {
+            __m128i bright = (coloreffect == 2) ? ColorBrightnessUpx4(val1, evy) : ColorBrightnessDownx4(val1, evy);
+            ret = Select(regular, bright, ret);
+        }
+
+        _mm_storeu_si128((__m128i*)&BGOBJLine[i], ret);
+    }
+#elif defined(__aarch64__)
+    const uint32x4_t blendcnt = vdupq_n_u32(CurUnit->BlendCnt);
+    const uint32x4_t eva = vdupq_n_u32(CurUnit->EVA);
+    const uint32x4_t evb = vdupq_n_u32(CurUnit->EVB);
+    const uint16x8_t evy = vdupq_n_u16(CurUnit->EVY);
+    u32 coloreffect = (CurUnit->BlendCnt >> 6) & 0x3;
+
+    for (int i = 0; i < 256; i += 4)
+    {
+        uint32x4_t val1 = vld1q_u32(&BGOBJLine[i]);
+        uint32x4_t val2 = vld1q_u32(&BGOBJLine[256+i]);
+        uint32x4_t flag1 = vshrq_n_u32(val1, 24);
+        uint32x4_t flag2 = vshrq_n_u32(val2, 24);
+
+        uint32x4_t win = vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(*(u32*)&WindowMask[i]))));
+
+        uint32x4_t obj1 = TestBits(flag1, vdupq_n_u32(0x80));
+        uint32x4_t bg3d1 = TestBits(flag1, vdupq_n_u32(0x40));
+        uint32x4_t obj2 = TestBits(flag2, vdupq_n_u32(0x80));
+        uint32x4_t bg3d2 = TestBits(flag2, vdupq_n_u32(0x40));
+
+        uint32x4_t target2 = vbslq_u32(obj2, vdupq_n_u32(0x1000),
+                                       vbslq_u32(bg3d2, vdupq_n_u32(0x0100), vshlq_n_u32(flag2, 8)));
+        uint32x4_t target1 = vbslq_u32(obj1, vdupq_n_u32(0x10),
+                                       vbslq_u32(bg3d1, vdupq_n_u32(0x01), flag1));
+        uint32x4_t second = TestBits(target2, blendcnt);
+        uint32x4_t first = vandq_u32(TestBits(target1, blendcnt), TestBits(win, vdupq_n_u32(0x20)));
+
+        uint32x4_t objblend = vandq_u32(obj1, second);
+        uint32x4_t blend3d = vbicq_u32(vandq_u32(bg3d1, second), obj1);
+        uint32x4_t regular = vbicq_u32(first, vorrq_u32(objblend, blend3d));
+
+        uint32x4_t blend4 = objblend;
+        if (coloreffect == 1)
+            blend4 = vorrq_u32(blend4, vandq_u32(regular, second));
+        else if (coloreffect == 0)
+            regular = vdupq_n_u32(0);
+
+        uint32x4_t all = vorrq_u32(vorrq_u32(blend4, blend3d), regular);
+        if (!vmaxvq_u32(all))
+            continue;
+
+        uint32x4_t ret = val1;
+        if (vmaxvq_u32(blend4))
+        {
+            // bitmap sprites use their own alpha
+            uint32x4_t bmp = vandq_u32(obj1, bg3d1);
+            uint32x4_t sprite_eva = vandq_u32(flag1, vdupq_n_u32(0x1F));
+            uint32x4_t eva1 = vbslq_u32(bmp, sprite_eva, eva);
+            uint32x4_t evb1 = vbslq_u32(bmp, vsubq_u32(vdupq_n_u32(16), sprite_eva), evb);
+            ret = vbslq_u32(blend4, ColorBlend4x4(val1, val2, eva1, evb1), ret);
+        }
+        if (vmaxvq_u32(blend3d))
+            ret = vbslq_u32(blend3d, ColorBlend5x4(val1, val2), ret);
+        if (coloreffect >= 2 && vmaxvq_u32(regular))
+        {
+            uint32x4_t bright = (coloreffect == 2) ? ColorBrightnessUpx4(val1, evy) : ColorBrightnessDownx4(val1, evy);
+            ret = vbslq_u32(regular, bright, ret);
+        }
+
+        vst1q_u32(&BGOBJLine[i], ret);
+    }
+#else
+    for (int i = 0; i < 256; i++)
+    {
+        u32 val1 = BGOBJLine[i];
+        u32 val2 = BGOBJLine[256+i];
+
+        BGOBJLine[i] = ColorComposite(i, val1, val2);
+    }
+#endif
+}
+
+void SoftRenderer::ColorBrightnessUpLine(u32* dst, u32 factor)
+{
+#if defined(__SSE2__)
+    __m128i f = _mm_set1_epi16(factor);
+    for (int i = 0; i < 256; i += 4)
+    {
+        __m128i val = _mm_loadu_si128((__m128i*)&dst[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], ColorBrightnessUpx4(val, f));
+    }
+#elif defined(__aarch64__)
+    uint16x8_t f = vdupq_n_u16(factor);
+    for (int i = 0; i < 256; i += 4)
+        vst1q_u32(&dst[i], ColorBrightnessUpx4(vld1q_u32(&dst[i]), f));
+#else
+    for (int i = 0; i < 256; i++)
+        dst[i] = ColorBrightnessUp(dst[i], factor);
+#endif
+}
+
+void SoftRenderer::ColorBrightnessDownLine(u32* dst, u32 factor)
+{
+#if defined(__SSE2__)
+    __m128i f = _mm_set1_epi16(factor);
+    for (int i = 0; i < 256; i += 4)
+    {
+        __m128i val = _mm_loadu_si128((__m128i*)&dst[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], ColorBrightnessDownx4(val, f));
+    }
+#elif defined(__aarch64__)
+    uint16x8_t f = vdupq_n_u16(factor);
+    for (int i = 0; i < 256; i += 4)
+        vst1q_u32(&dst[i], ColorBrightnessDownx4(vld1q_u32(&dst[i]), f));
+#else
+    for (int i = 0; i < 256; i++)
+        dst[i] = ColorBrightnessDown(dst[i], factor);
+#endif
+}
+
+void SoftRenderer::DrawScanline(u32 line, u32 vcount, Unit* unit)
 {
     CurUnit = unit;
 
@@ -176,7 +561,7 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     u32* dst = &Framebuffer[CurUnit->Num][stride * line];
 
     int n3dline = line;
-    line = GPU::VCount;
+    line = vcount;
 
     if (CurUnit->Num == 0)
     {
@@ -229,7 +614,10 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
         if (GPU3D::CurrentRenderer->Accelerated)
         {
             dst[256*3] = 0;
+            FrameChanged = true;
         }
+        else
+            HashScanline(n3dline, dst);
         return;
     }
 
@@ -320,7 +708,9 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
 
     if (GPU3D::CurrentRenderer->Accelerated)
     {
+        // the final picture is only known once the GPU composited it
         dst[256*3] = masterBrightness | (CurUnit->DispCnt & 0x30000);
+        FrameChanged = true;
         return;
     }
 
@@ -333,10 +723,7 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
             u32 factor = masterBrightness & 0x1F;
             if (factor > 16) factor = 16;
 
-            for (int i = 0; i < 256; i++)
-            {
-                dst[i] = ColorBrightnessUp(dst[i], factor);
-            }
+            ColorBrightnessUpLine(dst, factor);
         }
         else if ((masterBrightness >> 14) == 2)
         {
@@ -344,16 +731,40 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
             u32 factor = masterBrightness & 0x1F;
             if (factor > 16) factor = 16;
 
-            for (int i = 0; i < 256; i++)
-            {
-                dst[i] = ColorBrightnessDown(dst[i], factor);
-            }
+            ColorBrightnessDownLine(dst, factor);
         }
     }
 
     // convert to 32-bit BGRA
     // note: 32-bit RGBA would be more straightforward, but
     // BGRA seems to be more compatible (Direct2D soft, cairo...)
+#if defined(__SSE2__)
+    for (int i = 0; i < 256; i+=4)
+    {
+        __m128i c = _mm_loadu_si128((__m128i*)&dst[i]);
+
+        __m128i r = _mm_and_si128(_mm_slli_epi32(c, 18), _mm_set1_epi32(0xFC0000));
+        __m128i g = _mm_and_si128(_mm_slli_epi32(c, 2), _mm_set1_epi32(0xFC00));
+        __m128i b = _mm_and_si128(_mm_srli_epi32(c, 14), _mm_set1_epi32(0xFC));
+        c = _mm_or_si128(_mm_or_si128(r, g), b);
+
+        c = _mm_or_si128(c, _mm_srli_epi32(_mm_and_si128(c, _mm_set1_epi32(0x00C0C0C0)), 6));
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_or_si128(c, _mm_set1_epi32(0xFF000000)));
+    }
+#elif defined(__aarch64__)
+    for (int i = 0; i < 256; i+=4)
+    {
+        uint32x4_t c = vld1q_u32(&dst[i]);
+
+        uint32x4_t r = vandq_u32(vshlq_n_u32(c, 18), vdupq_n_u32(0xFC0000));
+        uint32x4_t g = vandq_u32(vshlq_n_u32(c, 2), vdupq_n_u32(0xFC00));
+        uint32x4_t b = vandq_u32(vshrq_n_u32(c, 14), vdupq_n_u32(0xFC));
+        c = vorrq_u32(vorrq_u32(r, g), b);
+
+        c = vorrq_u32(c, vshrq_n_u32(vandq_u32(c, vdupq_n_u32(0x00C0C0C0)), 6));
+        vst1q_u32(&dst[i], vorrq_u32(c, vdupq_n_u32(0xFF000000)));
+    }
+#else
     for (int i = 0; i < 256; i+=2)
     {
         u64 c = *(u64*)&dst[i];
@@ -365,6 +776,23 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
 
         *(u64*)&dst[i] = c | ((c & 0x00C0C0C000C0C0C0) >> 6) | 0xFF000000FF000000;
     }
+#endif
+
+    HashScanline(n3dline, dst);
+}
+
+void SoftRenderer::HashScanline(u32 line, u32* dst)
+{
+    u64 hash = XXH3_64bits(dst, 256*4);
+
+    u64& lasthash = LineHash[CurUnit->Num][line];
+    if (hash != lasthash)
+    {
+        lasthash = hash;
+        FrameChanged = true;
+    }
+
+    LinesDrawn[line >> 6] |= (1ULL << (line & 0x3F));
 }
 
 void SoftRenderer::VBlankEnd(Unit* unitA, Unit* unitB)
@@ -799,17 +1227,10 @@ void SoftRenderer::DrawScanline_BGOBJ(u32 line)
     }
 
     // color special effects
-    // can likely be optimized
 
     if (!GPU3D::CurrentRenderer->Accelerated)
     {
-        for (int i = 0; i < 256; i++)
-        {
-            u32 val1 = BGOBJLine[i];
-            u32 val2 = BGOBJLine[256+i];
-
-            BGOBJLine[i] = ColorComposite(i, val1, val2);
-        }
+        ColorCompositeLine();
     }
     else
     {
@@ -891,12 +1312,10 @@ void SoftRenderer::DrawScanline_BGOBJ(u32 line)
         }
         else
         {
+            ColorCompositeLine();
+
             for (int i = 0; i < 256; i++)
             {
-                u32 val1 = BGOBJLine[i];
-                u32 val2 = BGOBJLine[256+i];
-
-                BGOBJLine[i]     = ColorComposite(i, val1, val2);
                 BGOBJLine[256+i] = 0;
                 BGOBJLine[512+i] = 0x07000000;
             }
@@ -1026,114 +1445,75 @@ void SoftRenderer::DrawBG_Text(u32 line, u32 bgnum)
 
     u16 curtile;
     u16* curpal;
-    u32 pixelsaddr;
-    u8 color;
+    u64 pixels; // the 8 pixels of the current tile row, already flipped
     u32 lastxpos;
 
+    // 16-color tiles are read from the expanded VRAM copy, so both modes fetch a row of 8 bytes per tile
+    u8* tilevram;
+    u32 tilevrammask;
     if (bgcnt & 0x0080)
     {
-        // 256-color
+        tilevram = bgvram;
+        tilevrammask = bgvrammask;
+    }
+    else
+    {
+        CurUnit->GetBGVRAM4bpp(tilevram, tilevrammask);
+        tilesetaddr <<= 1;
+    }
 
-        // preload shit as needed
-        if ((xoff & 0x7) || mosaic)
-        {
-            curtile = *(u16*)&bgvram[(tilemapaddr + ((xoff & 0xF8) >> 2) + ((xoff & widexmask) << 3)) & bgvrammask];
+    u32 tileyoff = yoff & 0x7;
+    u32 tileyoffflip = 7 - tileyoff;
 
+    auto loadTile = [&](u32 xpos)
+    {
+        curtile = *(u16*)&bgvram[(tilemapaddr + ((xpos & 0xF8) >> 2) + ((xpos & widexmask) << 3)) & bgvrammask];
+
+        if (bgcnt & 0x0080)
+        {
             if (extpal) curpal = CurUnit->GetBGExtPal(extpalslot, curtile>>12);
             else        curpal = pal;
-
-            pixelsaddr = tilesetaddr + ((curtile & 0x03FF) << 6)
-                                     + (((curtile & 0x0800) ? (7-(yoff&0x7)) : (yoff&0x7)) << 3);
         }
+        else
+            curpal = pal + ((curtile & 0xF000) >> 8);
 
-        if (mosaic) lastxpos = xoff;
-
-        for (int i = 0; i < 256; i++)
-        {
-            u32 xpos;
-            if (mosaic) xpos = xoff - CurBGXMosaicTable[i];
-            else        xpos = xoff;
-
-            if ((!mosaic && (!(xpos & 0x7))) ||
-                (mosaic && ((xpos >> 3) != (lastxpos >> 3))))
-            {
-                // load a new tile
-                curtile = *(u16*)&bgvram[(tilemapaddr + ((xpos & 0xF8) >> 2) + ((xpos & widexmask) << 3)) & bgvrammask];
-
-                if (extpal) curpal = CurUnit->GetBGExtPal(extpalslot, curtile>>12);
-                else        curpal = pal;
-
-                pixelsaddr = tilesetaddr + ((curtile & 0x03FF) << 6)
-                                         + (((curtile & 0x0800) ? (7-(yoff&0x7)) : (yoff&0x7)) << 3);
-
-                if (mosaic) lastxpos = xpos;
-            }
+        u32 pixelsaddr = tilesetaddr + ((curtile & 0x03FF) << 6)
+                                     + (((curtile & 0x0800) ? tileyoffflip : tileyoff) << 3);
+        pixels = *(u64*)&tilevram[pixelsaddr & tilevrammask];
+        if (curtile & 0x0400) pixels = __builtin_bswap64(pixels);
+    };
 
-            // draw pixel
-            if (WindowMask[i] & (1<<bgnum))
-            {
-                u32 tilexoff = (curtile & 0x0400) ? (7-(xpos&0x7)) : (xpos&0x7);
-                color = bgvram[(pixelsaddr + tilexoff) & bgvrammask];
+    // preload shit as needed
+    if ((xoff & 0x7) || mosaic)
+        loadTile(xoff);
 
-                if (color)
-                    drawPixel(&BGOBJLine[i], curpal[color], 0x01000000<<bgnum);
-            }
+    if (mosaic) lastxpos = xoff;
 
-            xoff++;
-        }
-    }
-    else
+    for (int i = 0; i < 256; i++)
     {
-        // 16-color
+        u32 xpos;
+        if (mosaic) xpos = xoff - CurBGXMosaicTable[i];
+        else        xpos = xoff;
 
-        // preload shit as needed
-        if ((xoff & 0x7) || mosaic)
+        if ((!mosaic && (!(xpos & 0x7))) ||
+            (mosaic && ((xpos >> 3) != (lastxpos >> 3))))
         {
-            curtile = *(u16*)&bgvram[((tilemapaddr + ((xoff & 0xF8) >> 2) + ((xoff & widexmask) << 3))) & bgvrammask];
-            curpal = pal + ((curtile & 0xF000) >> 8);
-            pixelsaddr = tilesetaddr + ((curtile & 0x03FF) << 5)
-                                     + (((curtile & 0x0800) ? (7-(yoff&0x7)) : (yoff&0x7)) << 2);
-        }
+            // load a new tile
+            loadTile(xpos);
 
-        if (mosaic) lastxpos = xoff;
+            if (mosaic) lastxpos = xpos;
+        }
 
-        for (int i = 0; i < 256; i++)
+        // draw pixel
+        if (WindowMask[i] & (1<<bgnum))
         {
-            u32 xpos;
-            if (mosaic) xpos = xoff - CurBGXMosaicTable[i];
-            else        xpos = xoff;
-
-            if ((!mosaic && (!(xpos & 0x7))) ||
-                (mosaic && ((xpos >> 3) != (lastxpos >> 3))))
-            {
-                // load a new tile
-                curtile = *(u16*)&bgvram[(tilemapaddr + ((xpos & 0xF8) >> 2) + ((xpos & widexmask) << 3)) & bgvrammask];
-                curpal = pal + ((curtile & 0xF000) >> 8);
-                pixelsaddr = tilesetaddr + ((curtile & 0x03FF) << 5)
-                                         + (((curtile & 0x0800) ? (7-(yoff&0x7)) : (yoff&0x7)) << 2);
-
-                if (mosaic) lastxpos = xpos;
-            }
-
-            // draw pixel
-            if (WindowMask[i] & (1<<bgnum))
-            {
-                u32 tilexoff = (curtile & 0x0400) ? (7-(xpos&0x7)) : (xpos&0x7);
-                if (tilexoff & 0x1)
-                {
-                    color = bgvram[(pixelsaddr + (tilexoff >> 1)) & bgvrammask] >> 4;
-                }
-                else
-                {
-                    color = bgvram[(pixelsaddr + (tilexoff >> 1)) & bgvrammask] & 0x0F;
-                }
-
-                if (color)
-                    drawPixel(&BGOBJLine[i], curpal[color], 0x01000000<<bgnum);
-            }
+            u8 color = pixels >> ((xpos & 0x7) << 3);
 
-            xoff++;
+            if (color)
+                drawPixel(&BGOBJLine[i], curpal[color], 0x01000000<<bgnum);
         }
+
+        xoff++;
     }
 }
 
@@ -1957,6 +2337,14 @@ void SoftRenderer::DrawSprite_Rotscale(u32 num, u32 boundwidth, u32 boundheight,
         else
         {
             // 16-color
+            // read from the expanded VRAM copy, where tiles are laid out like 256-color ones
+            u8* tilevram;
+            u32 tilevrammask;
+            CurUnit->GetOBJVRAM4bpp(tilevram, tilevrammask);
+
+            pixelsaddr <<= 1;
+            ytilefactor <<= 1;
+
             if (!window)
             {
                 pixelattr |= 0x1000;
@@ -1967,11 +2355,7 @@ void SoftRenderer::DrawSprite_Rotscale(u32 num, u32 boundwidth, u32 boundheight,
             {
                 if ((u32)rotX < width && (u32)rotY < height)
                 {
-                    color = objvram[(pixelsaddr + ((rotY>>11)*ytilefactor) + ((rotY&0x700)>>6) + ((rotX>>11)*32) + ((rotX&0x700)>>9)) & objvrammask];
-                    if (rotX & 0x100)
-                        color >>= 4;
-                    else
-                        color &= 0x0F;
+                    color = tilevram[(pixelsaddr + ((rotY>>11)*ytilefactor) + ((rotY&0x700)>>5) + ((rotX>>11)*64) + ((rotX&0x700)>>8)) & tilevrammask];
 
                     if (color)
                     {
@@ -2195,8 +2579,13 @@ void SoftRenderer::DrawSprite_Normal(u32 num, u32 width, u32 height, s32 xpos, s
         else
         {
             // 16-color
-            pixelsaddr <<= 5;
-            pixelsaddr += ((ypos & 0x7) << 2);
+            // read from the expanded VRAM copy, one byte per pixel like 256-color tiles
+            u8* tilevram;
+            u32 tilevrammask;
+            CurUnit->GetOBJVRAM4bpp(tilevram, tilevrammask);
+
+            pixelsaddr <<= 6;
+            pixelsaddr += ((ypos & 0x7) << 3);
             s32 pixelstride;
 
             if (!window)
@@ -2205,36 +2594,26 @@ void SoftRenderer::DrawSprite_Normal(u32 num, u32 width, u32 height, s32 xpos, s
                 pixelattr |= ((attrib[2] & 0xF000) >> 8);
             }
 
-            // TODO: optimize VRAM access!!
-            // TODO: do xflip better? the 'two pixels per byte' thing makes it a bit shitty
-
             if (attrib[1] & 0x1000) // xflip
             {
-                pixelsaddr += (((width-1) & wmask) << 2);
-                pixelsaddr += (((width-1) & 0x7) >> 1);
-                pixelsaddr -= ((xoff & wmask) << 2);
-                pixelsaddr -= ((xoff & 0x7) >> 1);
+                pixelsaddr += (((width-1) & wmask) << 3);
+                pixelsaddr += ((width-1) & 0x7);
+                pixelsaddr -= ((xoff & wmask) << 3);
+                pixelsaddr -= (xoff & 0x7);
                 pixelstride = -1;
             }
             else
             {
-                pixelsaddr += ((xoff & wmask) << 2);
-                pixelsaddr += ((xoff & 0x7) >> 1);
+                pixelsaddr += ((xoff & wmask) << 3);
+                pixelsaddr += (xoff & 0x7);
                 pixelstride = 1;
             }
 
             for (; xoff < xend;)
             {
-                if (attrib[1] & 0x1000)
-                {
-                    if (xoff & 0x1) { color = objvram[pixelsaddr & objvrammask] & 0x0F; pixelsaddr--; }
-                    else              color = objvram[pixelsaddr & objvrammask] >> 4;
-                }
-                else
-                {
-                    if (xoff & 0x1) { color = objvram[pixelsaddr & objvrammask] >> 4; pixelsaddr++; }
-                    else              color = objvram[pixelsaddr & objvrammask] & 0x0F;
-                }
+                color = tilevram[pixelsaddr & tilevrammask];
+
+                pixelsaddr += pixelstride;
 
                 if (color)
                 {
@@ -2252,7 +2631,7 @@ void SoftRenderer::DrawSprite_Normal(u32 num, u32 width, u32 height, s32 xpos, s
 
                 xoff++;
                 xpos++;
-                if (!(xoff & 0x7)) pixelsaddr += ((attrib[1] & 0x1000) ? -28 : 28);
+                if (!(xoff & 0x7)) pixelsaddr += (56 * pixelstride);
             }
         }
     }
@@ -29,7 +29,7 @@ public:
     SoftRenderer();
     ~SoftRenderer() override {}
 
-    void DrawScanline(u32 line, Unit* unit) override;
+    void DrawScanline(u32 line, u32 vcount, Unit* unit) override;
     void DrawSprites(u32 line, Unit* unit) override;
     void VBlankEnd(Unit* unitA, Unit* unitB) override;
 private:
@@ -47,16 +47,22 @@ private:
     u8* CurBGXMosaicTable;
     u8 MosaicTable[16][256];
 
+    u64 LineHash[2][192]; // of each finished scanline, to tell unchanged frames apart
+
     u32 ColorBlend4(u32 val1, u32 val2, u32 eva, u32 evb);
     u32 ColorBlend5(u32 val1, u32 val2);
     u32 ColorBrightnessUp(u32 val, u32 factor);
     u32 ColorBrightnessDown(u32 val, u32 factor);
     u32 ColorComposite(int i, u32 val1, u32 val2);
+    void ColorCompositeLine();
+    void ColorBrightnessUpLine(u32* dst, u32 factor);
+    void ColorBrightnessDownLine(u32* dst, u32 factor);
 
     template<u32 bgmode> void DrawScanlineBGMode(u32 line);
     void DrawScanlineBGMode6(u32 line);
     void DrawScanlineBGMode7(u32 line);
     void DrawScanline_BGOBJ(u32 line);
+    void HashScanline(u32 line, u32* dst);
 
     static void DrawPixel_Normal(u32* dst, u16 color, u32 flag);
     static void DrawPixel_Accel(u32* dst, u16 color, u32 flag);
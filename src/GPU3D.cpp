@@ -23,6 +23,14 @@
 #include "GPU.h"
 #include "FIFO.h"
 #include "Config.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#if defined(JIT_ENABLED) && defined(__x86_64__)
+#include "dolphin/CPUDetect.h"
+#endif
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 
 // 3D engine notes
@@ -222,6 +230,7 @@ s32 ProjMatrixStackPointer;
 s32 PosMatrixStackPointer;
 s32 TexMatrixStackPointer;
 
+void SelectMatrixTransform();
 void MatrixLoadIdentity(s32* m);
 void UpdateClipMatrix();
 
@@ -279,6 +288,8 @@ bool AbortFrame;
 
 bool Init()
 {
+    SelectMatrixTransform();
+
     return true;
 }
 
@@ -641,6 +652,122 @@ void SetEnabled(bool geometry, bool rendering)
 
 
 
+// matrix/vector kernel used by the matrix commands and vertex transforms
+// out[k*4+j] = (in[k*4+0]*m[j] + in[k*4+1]*m[4+j] + in[k*4+2]*m[8+j] + in[k*4+3]*m[12+j]) >> 12
+// products and sums are 64-bit, like on hardware. out must not alias in or m.
+
+void MatrixTransformScalar(s32* out, const s32* in, int count, const s32* m)
+{
+    for (int k = 0; k < count; k++, in += 4, out += 4)
+    {
+        for (int j = 0; j < 4; j++)
+            out[j] = ((s64)in[0]*m[j] + (s64)in[1]*m[4+j] + (s64)in[2]*m[8+j] + (s64)in[3]*m[12+j]) >> 12;
+    }
+}
+
+#if defined(__SSE2__)
+
+#ifdef _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// only the low 32 bits of each sum>>12 are kept, so the shifts below can be logical
+
+TARGET_SSE41 void MatrixTransformSSE41(s32* out, const s32* in, int count, const s32* m)
+{
+    __m128i even[4], odd[4];
+    for (int i = 0; i < 4; i++)
+    {
+        even[i] = _mm_loadu_si128((const __m128i*)&m[i*4]);
+        odd[i] = _mm_srli_epi64(even[i], 32);
+    }
+
+    for (int k = 0; k < count; k++, in += 4, out += 4)
+    {
+        __m128i sumeven = _mm_setzero_si128();
+        __m128i sumodd = _mm_setzero_si128();
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i v = _mm_set1_epi32(in[i]);
+            sumeven = _mm_add_epi64(sumeven, _mm_mul_epi32(v, even[i]));
+            sumodd = _mm_add_epi64(sumodd, _mm_mul_epi32(v, odd[i]));
+        }
+
+        sumeven = _mm_srli_epi64(sumeven, 12);
+        sumodd = _mm_slli_epi64(sumodd, 32-12);
+        _mm_storeu_si128((__m128i*)out, _mm_blend_epi16(sumeven, sumodd, 0xCC));
+    }
+}
+
+TARGET_AVX2 void MatrixTransformAVX2(s32* out, const s32* in, int count, const s32* m)
+{
+    __m256i rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)&m[i*4]));
+
+    const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    for (int k = 0; k < count; k++, in += 4, out += 4)
+    {
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < 4; i++)
+            sum = _mm256_add_epi64(sum, _mm256_mul_epi32(_mm256_set1_epi32(in[i]), rows[i]));
+
+        sum = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(sum, 12), pack);
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(sum));
+    }
+}
+
+#elif defined(__aarch64__)
+
+void MatrixTransformNEON(s32* out, const s32* in, int count, const s32* m)
+{
+    int32x4_t rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = vld1q_s32(&m[i*4]);
+
+    for (int k = 0; k < count; k++, in += 4, out += 4)
+    {
+        int64x2_t lo = vmull_n_s32(vget_low_s32(rows[0]), in[0]);
+        int64x2_t hi = vmull_n_s32(vget_high_s32(rows[0]), in[0]);
+        for (int i = 1; i < 4; i++)
+        {
+            lo = vmlal_n_s32(lo, vget_low_s32(rows[i]), in[i]);
+            hi = vmlal_n_s32(hi, vget_high_s32(rows[i]), in[i]);
+        }
+
+        vst1q_s32(out, vcombine_s32(vshrn_n_s64(lo, 12), vshrn_n_s64(hi, 12)));
+    }
+}
+
+#endif
+
+void (*MatrixTransform)(s32* out, const s32* in, int count, const s32* m) = MatrixTransformScalar;
+
+void SelectMatrixTransform()
+{
+    MatrixTransform = MatrixTransformScalar;
+
+#if defined(__SSE2__)
+#if defined(JIT_ENABLED) && defined(__x86_64__)
+    // the CPU detection code is only built along with the x64 JIT
+    if (cpu_info.bAVX2)
+        MatrixTransform = MatrixTransformAVX2;
+    else if (cpu_info.bSSE4_1)
+        MatrixTransform = MatrixTransformSSE41;
+#elif defined(__AVX2__)
+    MatrixTransform = MatrixTransformAVX2;
+#elif defined(__SSE4_1__)
+    MatrixTransform = MatrixTransformSSE41;
+#endif
+#elif defined(__aarch64__)
+    MatrixTransform = MatrixTransformNEON;
+#endif
+}
+
 void MatrixLoadIdentity(s32* m)
 {
     m[0] = 0x1000; m[1] = 0;      m[2] = 0;       m[3] = 0;
@@ -668,25 +795,7 @@ void MatrixMult4x4(s32* m, s32* s)
     memcpy(tmp, m, 16*4);
 
     // m = s*m
-    m[0] = ((s64)s[0]*tmp[0] + (s64)s[1]*tmp[4] + (s64)s[2]*tmp[8] + (s64)s[3]*tmp[12]) >> 12;
-    m[1] = ((s64)s[0]*tmp[1] + (s64)s[1]*tmp[5] + (s64)s[2]*tmp[9] + (s64)s[3]*tmp[13]) >> 12;
-    m[2] = ((s64)s[0]*tmp[2] + (s64)s[1]*tmp[6] + (s64)s[2]*tmp[10] + (s64)s[3]*tmp[14]) >> 12;
-    m[3] = ((s64)s[0]*tmp[3] + (s64)s[1]*tmp[7] + (s64)s[2]*tmp[11] + (s64)s[3]*tmp[15]) >> 12;
-
-    m[4] = ((s64)s[4]*tmp[0] + (s64)s[5]*tmp[4] + (s64)s[6]*tmp[8] + (s64)s[7]*tmp[12]) >> 12;
-    m[5] = ((s64)s[4]*tmp[1] + (s64)s[5]*tmp[5] + (s64)s[6]*tmp[9] + (s64)s[7]*tmp[13]) >> 12;
-    m[6] = ((s64)s[4]*tmp[2] + (s64)s[5]*tmp[6] + (s64)s[6]*tmp[10] + (s64)s[7]*tmp[14]) >> 12;
-    m[7] = ((s64)s[4]*tmp[3] + (s64)s[5]*tmp[7] + (s64)s[6]*tmp[11] + (s64)s[7]*tmp[15]) >> 12;
-
-    m[8] = ((s64)s[8]*tmp[0] + (s64)s[9]*tmp[4] + (s64)s[10]*tmp[8] + (s64)s[11]*tmp[12]) >> 12;
-    m[9] = ((s64)s[8]*tmp[1] + (s64)s[9]*tmp[5] + (s64)s[10]*tmp[9] + (s64)s[11]*tmp[13]) >> 12;
-    m[10] = ((s64)s[8]*tmp[2] + (s64)s[9]*tmp[6] + (s64)s[10]*tmp[10] + (s64)s[11]*tmp[14]) >> 12;
-    m[11] = ((s64)s[8]*tmp[3] + (s64)s[9]*tmp[7] + (s64)s[10]*tmp[11] + (s64)s[11]*tmp[15]) >> 12;
-
-    m[12] = ((s64)s[12]*tmp[0] + (s64)s[13]*tmp[4] + (s64)s[14]*tmp[8] + (s64)s[15]*tmp[12]) >> 12;
-    m[13] = ((s64)s[12]*tmp[1] + (s64)s[13]*tmp[5] + (s64)s[14]*tmp[9] + (s64)s[15]*tmp[13]) >> 12;
-    m[14] = ((s64)s[12]*tmp[2] + (s64)s[13]*tmp[6] + (s64)s[14]*tmp[10] + (s64)s[15]*tmp[14]) >> 12;
-    m[15] = ((s64)s[12]*tmp[3] + (s64)s[13]*tmp[7] + (s64)s[14]*tmp[11] + (s64)s[15]*tmp[15]) >> 12;
+    MatrixTransform(m, s, 4, tmp);
 }
 
 void MatrixMult4x3(s32* m, s32* s)
@@ -694,48 +803,26 @@ void MatrixMult4x3(s32* m, s32* s)
     s32 tmp[16];
     memcpy(tmp, m, 16*4);
 
+    s32 s4[16] = {s[0], s[1],  s[2],  0,
+                  s[3], s[4],  s[5],  0,
+                  s[6], s[7],  s[8],  0,
+                  s[9], s[10], s[11], 0x1000};
+
     // m = s*m
-    m[0] = ((s64)s[0]*tmp[0] + (s64)s[1]*tmp[4] + (s64)s[2]*tmp[8]) >> 12;
-    m[1] = ((s64)s[0]*tmp[1] + (s64)s[1]*tmp[5] + (s64)s[2]*tmp[9]) >> 12;
-    m[2] = ((s64)s[0]*tmp[2] + (s64)s[1]*tmp[6] + (s64)s[2]*tmp[10]) >> 12;
-    m[3] = ((s64)s[0]*tmp[3] + (s64)s[1]*tmp[7] + (s64)s[2]*tmp[11]) >> 12;
-
-    m[4] = ((s64)s[3]*tmp[0] + (s64)s[4]*tmp[4] + (s64)s[5]*tmp[8]) >> 12;
-    m[5] = ((s64)s[3]*tmp[1] + (s64)s[4]*tmp[5] + (s64)s[5]*tmp[9]) >> 12;
-    m[6] = ((s64)s[3]*tmp[2] + (s64)s[4]*tmp[6] + (s64)s[5]*tmp[10]) >> 12;
-    m[7] = ((s64)s[3]*tmp[3] + (s64)s[4]*tmp[7] + (s64)s[5]*tmp[11]) >> 12;
-
-    m[8] = ((s64)s[6]*tmp[0] + (s64)s[7]*tmp[4] + (s64)s[8]*tmp[8]) >> 12;
-    m[9] = ((s64)s[6]*tmp[1] + (s64)s[7]*tmp[5] + (s64)s[8]*tmp[9]) >> 12;
-    m[10] = ((s64)s[6]*tmp[2] + (s64)s[7]*tmp[6] + (s64)s[8]*tmp[10]) >> 12;
-    m[11] = ((s64)s[6]*tmp[3] + (s64)s[7]*tmp[7] + (s64)s[8]*tmp[11]) >> 12;
-
-    m[12] = ((s64)s[9]*tmp[0] + (s64)s[10]*tmp[4] + (s64)s[11]*tmp[8] + (s64)0x1000*tmp[12]) >> 12;
-    m[13] = ((s64)s[9]*tmp[1] + (s64)s[10]*tmp[5] + (s64)s[11]*tmp[9] + (s64)0x1000*tmp[13]) >> 12;
-    m[14] = ((s64)s[9]*tmp[2] + (s64)s[10]*tmp[6] + (s64)s[11]*tmp[10] + (s64)0x1000*tmp[14]) >> 12;
-    m[15] = ((s64)s[9]*tmp[3] + (s64)s[10]*tmp[7] + (s64)s[11]*tmp[11] + (s64)0x1000*tmp[15]) >> 12;
+    MatrixTransform(m, s4, 4, tmp);
 }
 
 void MatrixMult3x3(s32* m, s32* s)
 {
-    s32 tmp[12];
-    memcpy(tmp, m, 12*4);
+    s32 tmp[16];
+    memcpy(tmp, m, 16*4);
+
+    s32 s4[12] = {s[0], s[1], s[2], 0,
+                  s[3], s[4], s[5], 0,
+                  s[6], s[7], s[8], 0};
 
     // m = s*m
-    m[0] = ((s64)s[0]*tmp[0] + (s64)s[1]*tmp[4] + (s64)s[2]*tmp[8]) >> 12;
-    m[1] = ((s64)s[0]*tmp[1] + (s64)s[1]*tmp[5] + (s64)s[2]*tmp[9]) >> 12;
-    m[2] = ((s64)s[0]*tmp[2] + (s64)s[1]*tmp[6] + (s64)s[2]*tmp[10]) >> 12;
-    m[3] = ((s64)s[0]*tmp[3] + (s64)s[1]*tmp[7] + (s64)s[2]*tmp[11]) >> 12;
-
-    m[4] = ((s64)s[3]*tmp[0] + (s64)s[4]*tmp[4] + (s64)s[5]*tmp[8]) >> 12;
-    m[5] = ((s64)s[3]*tmp[1] + (s64)s[4]*tmp[5] + (s64)s[5]*tmp[9]) >> 12;
-    m[6] = ((s64)s[3]*tmp[2] + (s64)s[4]*tmp[6] + (s64)s[5]*tmp[10]) >> 12;
-    m[7] = ((s64)s[3]*tmp[3] + (s64)s[4]*tmp[7] + (s64)s[5]*tmp[11]) >> 12;
-
-    m[8] = ((s64)s[6]*tmp[0] + (s64)s[7]*tmp[4] + (s64)s[8]*tmp[8]) >> 12;
-    m[9] = ((s64)s[6]*tmp[1] + (s64)s[7]*tmp[5] + (s64)s[8]*tmp[9]) >> 12;
-    m[10] = ((s64)s[6]*tmp[2] + (s64)s[7]*tmp[6] + (s64)s[8]*tmp[10]) >> 12;
-    m[11] = ((s64)s[6]*tmp[3] + (s64)s[7]*tmp[7] + (s64)s[8]*tmp[11]) >> 12;
+    MatrixTransform(m, s4, 3, tmp);
 }
 
 void MatrixScale(s32* m, s32* s)
@@ -758,10 +845,14 @@ void MatrixScale(s32* m, s32* s)
 
 void MatrixTranslate(s32* m, s32* s)
 {
-    m[12] += ((s64)s[0]*m[0] + (s64)s[1]*m[4] + (s64)s[2]*m[8]) >> 12;
-    m[13] += ((s64)s[0]*m[1] + (s64)s[1]*m[5] + (s64)s[2]*m[9]) >> 12;
-    m[14] += ((s64)s[0]*m[2] + (s64)s[1]*m[6] + (s64)s[2]*m[10]) >> 12;
-    m[15] += ((s64)s[0]*m[3] + (s64)s[1]*m[7] + (s64)s[2]*m[11]) >> 12;
+    s32 v[4] = {s[0], s[1], s[2], 0};
+    s32 t[4];
+    MatrixTransform(t, v, 1, m);
+
+    m[12] += t[0];
+    m[13] += t[1];
+    m[14] += t[2];
+    m[15] += t[3];
 }
 
 void UpdateClipMatrix()
@@ -1425,13 +1516,11 @@ void SubmitPolygon()
 void SubmitVertex()
 {
     s64 vertex[4] = {(s64)CurVertex[0], (s64)CurVertex[1], (s64)CurVertex[2], 0x1000};
+    s32 pos[4] = {CurVertex[0], CurVertex[1], CurVertex[2], 0x1000};
     Vertex* vertextrans = &TempVertexBuffer[VertexNumInPoly];
 
     UpdateClipMatrix();
-    vertextrans->Position[0] = (vertex[0]*ClipMatrix[0] + vertex[1]*ClipMatrix[4] + vertex[2]*ClipMatrix[8] + vertex[3]*ClipMatrix[12]) >> 12;
-    vertextrans->Position[1] = (vertex[0]*ClipMatrix[1] + vertex[1]*ClipMatrix[5] + vertex[2]*ClipMatrix[9] + vertex[3]*ClipMatrix[13]) >> 12;
-    vertextrans->Position[2] = (vertex[0]*ClipMatrix[2] + vertex[1]*ClipMatrix[6] + vertex[2]*ClipMatrix[10] + vertex[3]*ClipMatrix[14]) >> 12;
-    vertextrans->Position[3] = (vertex[0]*ClipMatrix[3] + vertex[1]*ClipMatrix[7] + vertex[2]*ClipMatrix[11] + vertex[3]*ClipMatrix[15]) >> 12;
+    MatrixTransform(vertextrans->Position, pos, 1, ClipMatrix);
 
     // this probably shouldn't be.
     // the way color is handled during clipping needs investigation. TODO
@@ -1625,17 +1714,18 @@ void BoxTest(u32* params)
     cube[7].Position[0] = x1; cube[7].Position[1] = y1; cube[7].Position[2] = z1;
 
     UpdateClipMatrix();
+    s32 corners[8*4];
+    s32 cornerstrans[8*4];
     for (int i = 0; i < 8; i++)
     {
-        s32 x = cube[i].Position[0];
-        s32 y = cube[i].Position[1];
-        s32 z = cube[i].Position[2];
-
-        cube[i].Position[0] = ((s64)x*ClipMatrix[0] + (s64)y*ClipMatrix[4] + (s64)z*ClipMatrix[8] + (s64)0x1000*ClipMatrix[12]) >> 12;
-        cube[i].Position[1] = ((s64)x*ClipMatrix[1] + (s64)y*ClipMatrix[5] + (s64)z*ClipMatrix[9] + (s64)0x1000*ClipMatrix[13]) >> 12;
-        cube[i].Position[2] = ((s64)x*ClipMatrix[2] + (s64)y*ClipMatrix[6] + (s64)z*ClipMatrix[10] + (s64)0x1000*ClipMatrix[14]) >> 12;
-        cube[i].Position[3] = ((s64)x*ClipMatrix[3] + (s64)y*ClipMatrix[7] + (s64)z*ClipMatrix[11] + (s64)0x1000*ClipMatrix[15]) >> 12;
+        corners[i*4+0] = cube[i].Position[0];
+        corners[i*4+1] = cube[i].Position[1];
+        corners[i*4+2] = cube[i].Position[2];
+        corners[i*4+3] = 0x1000;
     }
+    MatrixTransform(cornerstrans, corners, 8, ClipMatrix);
+    for (int i = 0; i < 8; i++)
+        memcpy(cube[i].Position, &cornerstrans[i*4], 4*4);
 
     // front face (-Z)
     face[0] = cube[0]; face[1] = cube[1]; face[2] = cube[2]; face[3] = cube[3];
@@ -1694,13 +1784,10 @@ void BoxTest(u32* params)
 
 void PosTest()
 {
-    s64 vertex[4] = {(s64)CurVertex[0], (s64)CurVertex[1], (s64)CurVertex[2], 0x1000};
+    s32 vertex[4] = {CurVertex[0], CurVertex[1], CurVertex[2], 0x1000};
 
     UpdateClipMatrix();
-    PosTestResult[0] = (vertex[0]*ClipMatrix[0] + vertex[1]*ClipMatrix[4] + vertex[2]*ClipMatrix[8] + vertex[3]*ClipMatrix[12]) >> 12;
-    PosTestResult[1] = (vertex[0]*ClipMatrix[1] + vertex[1]*ClipMatrix[5] + vertex[2]*ClipMatrix[9] + vertex[3]*ClipMatrix[13]) >> 12;
-    PosTestResult[2] = (vertex[0]*ClipMatrix[2] + vertex[1]*ClipMatrix[6] + vertex[2]*ClipMatrix[10] + vertex[3]*ClipMatrix[14]) >> 12;
-    PosTestResult[3] = (vertex[0]*ClipMatrix[3] + vertex[1]*ClipMatrix[7] + vertex[2]*ClipMatrix[11] + vertex[3]*ClipMatrix[15]) >> 12;
+    MatrixTransform(PosTestResult, vertex, 1, ClipMatrix);
 
     AddCycles(5);
 }
@@ -2610,6 +2697,10 @@ void SetRenderXPos(u16 xpos)
 {
     if (!RenderingEnabled) return;
 
+    // the 2D engine applies this when fetching 3D scanlines
+    if (GPU::Deferred2DPending && (xpos & 0x01FF) != RenderXPos)
+        GPU::Sync2D();
+
     RenderXPos = xpos & 0x01FF;
 }
 
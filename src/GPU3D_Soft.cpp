@@ -21,9 +21,15 @@
 #include <algorithm>
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "NDS.h"
 #include "GPU.h"
 #include "Config.h"
+#include "Profiler.h"
 
 
 namespace GPU3D
@@ -43,6 +49,58 @@ void SoftRenderer::StopRenderThread()
     }
 }
 
+void SoftRenderer::StopBands()
+{
+    if (BandThreadsRunning.load(std::memory_order_relaxed))
+    {
+        BandThreadsRunning = false;
+
+        for (int b = 1; b < NumBands; b++)
+        {
+            Platform::Semaphore_Post(Bands[b].Sema_Start);
+            Platform::Thread_Wait(Bands[b].Thread);
+            Platform::Thread_Free(Bands[b].Thread);
+
+            Platform::Semaphore_Free(Bands[b].Sema_Start);
+            Platform::Semaphore_Free(Bands[b].Sema_Done);
+            delete[] Bands[b].Polygons;
+            delete Bands[b].Bins;
+        }
+    }
+
+    NumBands = 1;
+    Bands[0].YStart = 0;
+    Bands[0].YEnd = 192;
+    Bands[0].Polygons = PolygonList;
+    Bands[0].Bins = &Bins;
+}
+
+void SoftRenderer::SetupBands(int numbands)
+{
+    if (numbands < 1) numbands = 1;
+    if (numbands > MaxBands) numbands = MaxBands;
+    if (numbands == NumBands) return;
+
+    StopBands();
+    if (numbands == 1) return;
+
+    NumBands = numbands;
+    BandThreadsRunning = true;
+
+    for (int b = 0; b < NumBands; b++)
+    {
+        Bands[b].YStart = (192 * b) / NumBands;
+        Bands[b].YEnd = (192 * (b+1)) / NumBands;
+        if (b == 0) continue;
+
+        Bands[b].Polygons = new RendererPolygon[2048];
+        Bands[b].Bins = new PolygonBins;
+        Bands[b].Sema_Start = Platform::Semaphore_Create();
+        Bands[b].Sema_Done = Platform::Semaphore_Create();
+        Bands[b].Thread = Platform::Thread_Create(std::bind(&SoftRenderer::BandThreadFunc, this, b));
+    }
+}
+
 void SoftRenderer::SetupRenderThread()
 {
     if (Threaded)
@@ -84,16 +142,23 @@ bool SoftRenderer::Init()
     Sema_RenderDone = Platform::Semaphore_Create();
     Sema_ScanlineCount = Platform::Semaphore_Create();
 
+    ScalarFactors = false;
     Threaded = false;
     RenderThreadRunning = false;
     RenderThreadRendering = false;
 
+    BandThreadsRunning = false;
+    StopBands();
+
+    TexCacheTexels = 0;
+
     return true;
 }
 
 void SoftRenderer::DeInit()
 {
     StopRenderThread();
+    StopBands();
 
     Platform::Semaphore_Free(Sema_RenderStart);
     Platform::Semaphore_Free(Sema_RenderDone);
@@ -113,14 +178,148 @@ void SoftRenderer::Reset()
 
 void SoftRenderer::SetRenderSettings(GPU::RenderSettings& settings)
 {
+    // the bands can't change under a frame that's being rendered
+    if (settings.Soft_Threads != NumBands)
+    {
+        StopRenderThread();
+        SetupBands(settings.Soft_Threads);
+    }
+
     Threaded = settings.Soft_Threaded;
     SetupRenderThread();
+
+    ScalarFactors = settings.Soft_ScalarFactors;
+}
+
+template <u32 Size>
+bool RangeDirty(NonStupidBitField<Size>& dirty, u32 addr, u32 len)
+{
+    if (len == 0) return false;
+
+    // the ranges can wrap around the end of VRAM like the reads do
+    u32 first = addr / GPU::VRAMDirtyGranularity;
+    u32 last = (addr + len - 1) / GPU::VRAMDirtyGranularity;
+    for (u32 i = first; i <= last; i++)
+    {
+        if (dirty[i % Size])
+            return true;
+    }
+
+    return false;
+}
+
+void SoftRenderer::SetupTextures(Polygon** polygons, int npolys)
+{
+    if (TexCacheTexels > TexCacheMaxTexels)
+    {
+        TexCache.clear();
+        TexCacheTexels = 0;
+    }
+
+    // drop the textures whose VRAM changed since they were decoded
+    bool texdirty = TexCacheDirty.Begin() != TexCacheDirty.End();
+    bool paldirty = TexCacheDirtyPal.Begin() != TexCacheDirtyPal.End();
+    if (texdirty || paldirty)
+    {
+        for (auto it = TexCache.begin(); it != TexCache.end();)
+        {
+            TexCacheEntry& entry = it->second;
+            if (RangeDirty(TexCacheDirty, entry.TexAddr, entry.TexLen) ||
+                RangeDirty(TexCacheDirty, entry.Slot1Addr, entry.Slot1Len) ||
+                RangeDirty(TexCacheDirtyPal, entry.PalAddr, entry.PalLen))
+            {
+                TexCacheTexels -= entry.Texels.size();
+                it = TexCache.erase(it);
+            }
+            else
+                it++;
+        }
+
+        TexCacheDirty.Clear();
+        TexCacheDirtyPal.Clear();
+    }
+
+    bool texturing = RenderDispCnt & (1<<0);
+    for (int i = 0; i < npolys; i++)
+    {
+        Polygon* polygon = polygons[i];
+
+        if (texturing && !polygon->Degenerate && ((polygon->TexParam >> 26) & 0x7) != 0)
+            PolygonTexels[i] = GetTexture(polygon->TexParam, polygon->TexPalette);
+        else
+            PolygonTexels[i] = nullptr;
+    }
 }
 
-void SoftRenderer::TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha)
+u32* SoftRenderer::GetTexture(u32 texparam, u32 texpal)
 {
+    u32 format = (texparam >> 26) & 0x7;
+    if (format == 7) texpal = 0;
+
+    // the repeat/flip and texcoord transform bits don't change the texels
+    u64 key = (texparam & 0x3FF0FFFF) | ((u64)texpal << 32);
+    auto it = TexCache.find(key);
+    if (it != TexCache.end())
+        return it->second.Texels.data();
+
+    TexCacheEntry& entry = TexCache[key];
+
     u32 vramaddr = (texparam & 0xFFFF) << 3;
+    s32 width = 8 << ((texparam >> 20) & 0x7);
+    s32 height = 8 << ((texparam >> 23) & 0x7);
+
+    entry.TexAddr = vramaddr;
+    entry.Slot1Addr = 0; entry.Slot1Len = 0;
+    entry.PalAddr = texpal << 4;
+
+    switch (format)
+    {
+    case 1: entry.TexLen = width * height; entry.PalLen = 32*2; break;
+    case 2: entry.TexLen = (width * height) >> 2; entry.PalAddr = texpal << 3; entry.PalLen = 4*2; break;
+    case 3: entry.TexLen = (width * height) >> 1; entry.PalLen = 16*2; break;
+    case 4: entry.TexLen = width * height; entry.PalLen = 256*2; break;
+    case 5:
+        {
+            entry.TexLen = (width * height) >> 2;
+
+            entry.Slot1Addr = 0x20000 + ((vramaddr & 0x1FFFC) >> 1);
+            if (vramaddr >= 0x40000)
+                entry.Slot1Addr += 0x10000;
+            entry.Slot1Len = (width * height) >> 3;
+
+            // every 4x4 block picks its own palette offset
+            u32 maxoffset = 0;
+            for (u32 i = 0; i < entry.Slot1Len; i += 2)
+            {
+                u32 paloffset = (ReadVRAM_Texture<u16>(entry.Slot1Addr + i) & 0x3FFF) << 2;
+                if (paloffset > maxoffset) maxoffset = paloffset;
+            }
+            entry.PalLen = maxoffset + 4*2;
+        }
+        break;
+    case 6: entry.TexLen = width * height; entry.PalLen = 8*2; break;
+    case 7: entry.TexLen = (width * height) << 1; entry.PalLen = 0; break;
+    }
+
+    entry.Texels.resize(width * height);
+    u32* texels = entry.Texels.data();
+    switch (format)
+    {
+    case 1: DecodeTexture<1>(texparam, texpal, texels); break;
+    case 2: DecodeTexture<2>(texparam, texpal, texels); break;
+    case 3: DecodeTexture<3>(texparam, texpal, texels); break;
+    case 4: DecodeTexture<4>(texparam, texpal, texels); break;
+    case 5: DecodeTexture<5>(texparam, texpal, texels); break;
+    case 6: DecodeTexture<6>(texparam, texpal, texels); break;
+    case 7: DecodeTexture<7>(texparam, texpal, texels); break;
+    }
+
+    TexCacheTexels += width * height;
+    return texels;
+}
 
+u32 SoftRenderer::TextureLookup(u32 texparam, u32* texels, s16 s, s16 t)
+{
     s32 width = 8 << ((texparam >> 20) & 0x7);
     s32 height = 8 << ((texparam >> 23) & 0x7);
 
@@ -163,11 +362,41 @@ void SoftRenderer::TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* co
         else if (t >= height) t = height-1;
     }
 
+    return texels[(t * width) + s];
+}
+
+template <u32 format>
+void SoftRenderer::DecodeTexture(u32 texparam, u32 texpal, u32* texels)
+{
+    s32 width = 8 << ((texparam >> 20) & 0x7);
+    s32 height = 8 << ((texparam >> 23) & 0x7);
+
+    for (s32 t = 0; t < height; t++)
+    {
+        for (s32 s = 0; s < width; s++)
+        {
+            u16 color; u8 alpha;
+            DecodeTexel<format>(texparam, texpal, s, t, &color, &alpha);
+
+            u32 r = (color << 1) & 0x3E; if (r) r++;
+            u32 g = (color >> 4) & 0x3E; if (g) g++;
+            u32 b = (color >> 9) & 0x3E; if (b) b++;
+            texels[(t * width) + s] = r | (g << 8) | (b << 16) | (alpha << 24);
+        }
+    }
+}
+
+template <u32 format>
+void SoftRenderer::DecodeTexel(u32 texparam, u32 texpal, s32 s, s32 t, u16* color, u8* alpha)
+{
+    u32 vramaddr = (texparam & 0xFFFF) << 3;
+    s32 width = 8 << ((texparam >> 20) & 0x7);
+
     u8 alpha0;
     if (texparam & (1<<29)) alpha0 = 0;
     else                    alpha0 = 31;
 
-    switch ((texparam >> 26) & 0x7)
+    switch (format)
     {
     case 1: // A3I5
         {
@@ -423,8 +652,9 @@ u32 AlphaBlend(u32 srccolor, u32 dstcolor, u32 alpha)
     return srcR | (srcG << 8) | (srcB << 16) | (dstalpha << 24);
 }
 
-u32 SoftRenderer::RenderPixel(Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t)
+u32 SoftRenderer::RenderPixel(RendererPolygon* rp, u8 vr, u8 vg, u8 vb, s16 s, s16 t)
 {
+    Polygon* polygon = rp->PolyData;
     u8 r, g, b, a;
 
     u32 blendmode = (polygon->Attr >> 4) & 0x3;
@@ -455,16 +685,14 @@ u32 SoftRenderer::RenderPixel(Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16
         }
     }
 
-    if ((RenderDispCnt & (1<<0)) && (((polygon->TexParam >> 26) & 0x7) != 0))
+    if (rp->Texels)
     {
-        u8 tr, tg, tb;
+        u32 texel = TextureLookup(polygon->TexParam, rp->Texels, s, t);
 
-        u16 tcolor; u8 talpha;
-        TextureLookup(polygon->TexParam, polygon->TexPalette, s, t, &tcolor, &talpha);
-
-        tr = (tcolor << 1) & 0x3E; if (tr) tr++;
-        tg = (tcolor >> 4) & 0x3E; if (tg) tg++;
-        tb = (tcolor >> 9) & 0x3E; if (tb) tb++;
+        u8 tr = texel & 0x3F;
+        u8 tg = (texel >> 8) & 0x3F;
+        u8 tb = (texel >> 16) & 0x3F;
+        u8 talpha = texel >> 24;
 
         if (blendmode & 0x1)
         {
@@ -677,6 +905,70 @@ void SoftRenderer::SetupPolygon(SoftRenderer::RendererPolygon* rp, Polygon* poly
     }
 }
 
+template<int dir>
+void SoftRenderer::Interpolator<dir>::CalcFactors(s32 xstart, s32 xend, u32* factors, bool scalar)
+{
+    if (xdiff == 0 || linear)
+    {
+        factorsstart = 0;
+        factorsend = 0;
+        return;
+    }
+
+    factorsstart = xstart;
+    factorsend = xend;
+
+    // the divisions are done in double precision, two at a time.
+    // the numerator stays well below 2^53 and any nonzero remainder keeps
+    // the quotient at least 1/den away from the next integer, so truncating
+    // the rounded quotient gives exactly what the integer division does
+    s32 x = xstart;
+    // the scalar path can be forced, to check the vector ones against it
+    s32 vecend = scalar ? xstart : xend;
+
+#if defined(__SSE2__)
+    __m128d nummul = _mm_set1_pd((double)w0n * (1 << shift));
+    __m128d denmul = _mm_set1_pd((double)(w0d - w1d));
+    __m128d denadd = _mm_set1_pd((double)xdiff * w1d);
+
+    for (; x + 2 <= vecend; x += 2)
+    {
+        __m128d vx = _mm_set_pd(x+1 - x0, x - x0);
+        __m128d num = _mm_mul_pd(vx, nummul);
+        __m128d den = _mm_add_pd(_mm_mul_pd(vx, denmul), denadd);
+        __m128i q = _mm_cvttpd_epi32(_mm_div_pd(num, den));
+
+        factors[x] = _mm_cvtsi128_si32(q);
+        factors[x+1] = _mm_cvtsi128_si32(_mm_shuffle_epi32(q, 0x1));
+
+        // dividing by zero or overflowing gives 0x80000000
+        if (factors[x] == 0x80000000) factors[x] = PerspectiveFactor(x - x0);
+        if (factors[x+1] == 0x80000000) factors[x+1] = PerspectiveFactor(x+1 - x0);
+    }
+#elif defined(__aarch64__)
+    float64x2_t nummul = vdupq_n_f64((double)w0n * (1 << shift));
+    float64x2_t denmul = vdupq_n_f64((double)(w0d - w1d));
+    float64x2_t denadd = vdupq_n_f64((double)xdiff * w1d);
+    float64x2_t vx = {(double)(x - x0), (double)(x+1 - x0)};
+    float64x2_t two = vdupq_n_f64(2.0);
+
+    for (; x + 2 <= vecend; x += 2)
+    {
+        float64x2_t num = vmulq_f64(vx, nummul);
+        float64x2_t den = vfmaq_f64(denadd, vx, denmul);
+        int64x2_t q = vcvtq_s64_f64(vdivq_f64(num, den));
+        q = vbslq_s64(vceqzq_f64(den), vdupq_n_s64(0), q);
+
+        factors[x] = (u32)vgetq_lane_s64(q, 0);
+        factors[x+1] = (u32)vgetq_lane_s64(q, 1);
+        vx = vaddq_f64(vx, two);
+    }
+#endif
+
+    for (; x < xend; x++)
+        factors[x] = PerspectiveFactor(x - x0);
+}
+
 void SoftRenderer::RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
@@ -797,6 +1089,9 @@ void SoftRenderer::RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     if (x < 0) x = 0;
     s32 xlimit;
 
+    u32 factors[256];
+    interpX.CalcFactors(x, std::min(xend+1, 256), factors, ScalarFactors);
+
     // for shadow masks: set stencil bits where the depth test fails.
     // draw nothing.
 
@@ -810,7 +1105,7 @@ void SoftRenderer::RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     {
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
@@ -840,7 +1135,7 @@ void SoftRenderer::RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     {
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
@@ -865,7 +1160,7 @@ void SoftRenderer::RenderShadowMaskScanline(RendererPolygon* rp, s32 y)
     {
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
         u32 dstattr = AttrBuffer[pixeladdr];
@@ -907,8 +1202,6 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
     else
         fnDepthTest = DepthTest_LessThan;
 
-    PrevIsShadowMask = false;
-
     if (polygon->YTop != polygon->YBottom)
     {
         if (y >= polygon->Vertices[rp->NextVL]->FinalPosition[1] && rp->CurVL != polygon->VBottom)
@@ -1025,6 +1318,9 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
     if (x < 0) x = 0;
     s32 xlimit;
 
+    u32 factors[256];
+    interpX.CalcFactors(x, std::min(xend+1, 256), factors, ScalarFactors);
+
     s32 xcov = 0;
 
     // part 1: left edge
@@ -1057,7 +1353,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
 
@@ -1080,7 +1376,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1153,7 +1449,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
 
@@ -1176,7 +1472,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1228,7 +1524,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
                 dstattr &= ~0x3; // quick way to prevent drawing the shadow under antialiased edges
         }
 
-        interpX.SetX(x);
+        interpX.SetX(x, factors);
 
         s32 z = interpX.InterpolateZ(zl, zr, polygon->WBuffer);
 
@@ -1251,7 +1547,7 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
         s16 s = interpX.Interpolate(sl, sr);
         s16 t = interpX.Interpolate(tl, tr);
 
-        u32 color = RenderPixel(polygon, vr>>3, vg>>3, vb>>3, s, t);
+        u32 color = RenderPixel(rp, vr>>3, vg>>3, vb>>3, s, t);
         u8 alpha = color >> 24;
 
         // alpha test
@@ -1303,19 +1599,85 @@ void SoftRenderer::RenderPolygonScanline(RendererPolygon* rp, s32 y)
     rp->XR = rp->SlopeR.Step();
 }
 
-void SoftRenderer::RenderScanline(s32 y, int npolys)
+void SoftRenderer::BinPolygons(PolygonBins* bins, RendererPolygon* polygons, int npolys, s32 ystart)
+{
+    // polygons that start above ystart are treated as starting on it
+    u16 count[193+1] = {0};
+    for (int i = 0; i < npolys; i++)
+    {
+        s32 ytop = std::clamp(polygons[i].PolyData->YTop, ystart, 192);
+        count[ytop]++;
+    }
+
+    u32 first = 0;
+    for (int y = 0; y <= 193; y++)
+    {
+        bins->First[y] = first;
+        if (y < 193) first += count[y];
+    }
+
+    for (int y = 0; y < 193; y++)
+        count[y] = bins->First[y];
+    for (int i = 0; i < npolys; i++)
+    {
+        s32 ytop = std::clamp(polygons[i].PolyData->YTop, ystart, 192);
+        bins->Order[count[ytop]++] = i;
+    }
+
+    bins->NumActive = 0;
+    bins->CurActive = 0;
+}
+
+u16* SoftRenderer::GetActivePolygons(PolygonBins* bins, RendererPolygon* polygons, s32 y, int& num)
 {
+    // drop the polygons that ended and merge in the ones starting on this
+    // scanline. scanlines have to be gone through in order for this to work
+    u16* prev = bins->Active[bins->CurActive];
+    u16* active = bins->Active[bins->CurActive ^ 1];
+    int nprev = bins->NumActive;
+    u16* start = &bins->Order[bins->First[y]];
+    int nstart = bins->First[y+1] - bins->First[y];
+
+    int i = 0, j = 0, n = 0;
+    for (;;)
+    {
+        u16 idx;
+        if (i < nprev && (j >= nstart || prev[i] < start[j]))
+            idx = prev[i++];
+        else if (j < nstart)
+            idx = start[j++];
+        else
+            break;
+
+        // flat polygons only cover the scanline they start on
+        Polygon* polygon = polygons[idx].PolyData;
+        if (y < polygon->YBottom || y == polygon->YTop)
+            active[n++] = idx;
+    }
+
+    bins->NumActive = n;
+    bins->CurActive ^= 1;
+
+    num = n;
+    return active;
+}
+
+void SoftRenderer::RenderScanline(s32 y)
+{
+    int npolys;
+    u16* active = GetActivePolygons(&Bins, PolygonList, y, npolys);
+
     for (int i = 0; i < npolys; i++)
     {
-        RendererPolygon* rp = &PolygonList[i];
+        RendererPolygon* rp = &PolygonList[active[i]];
         Polygon* polygon = rp->PolyData;
 
-        if (y >= polygon->YTop && (y < polygon->YBottom || (y == polygon->YTop && polygon->YBottom == polygon->YTop)))
+        if (polygon->IsShadowMask)
+            RenderShadowMaskScanline(rp, y);
+        else
         {
-            if (polygon->IsShadowMask)
-                RenderShadowMaskScanline(rp, y);
-            else
-                RenderPolygonScanline(rp, y);
+            PrevIsShadowMask = false;
+            RenderPolygonScanline(rp, y);
         }
     }
 }
@@ -1619,18 +1981,43 @@ void SoftRenderer::ClearBuffers()
 
 void SoftRenderer::RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 {
+    if (NumBands > 1)
+    {
+        // the stencil buffer used for shadows carries over from one scanline
+        // to the next, so frames with shadows have to be rendered in order
+        bool shadows = false;
+        for (int i = 0; i < npolys; i++)
+        {
+            if (polygons[i]->IsShadowMask || polygons[i]->IsShadow)
+            {
+                shadows = true;
+                break;
+            }
+        }
+
+        if (!shadows)
+            return RenderPolygonsBanded(threaded, polygons, npolys);
+    }
+
+    u64 profstart = Profiler::Begin();
+
+    SetupTextures(polygons, npolys);
+
     int j = 0;
     for (int i = 0; i < npolys; i++)
     {
         if (polygons[i]->Degenerate) continue;
-        SetupPolygon(&PolygonList[j++], polygons[i]);
+        SetupPolygon(&PolygonList[j], polygons[i]);
+        PolygonList[j++].Texels = PolygonTexels[i];
     }
 
-    RenderScanline(0, j);
+    BinPolygons(&Bins, PolygonList, j, 0);
+
+    RenderScanline(0);
 
     for (s32 y = 1; y < 192; y++)
     {
-        RenderScanline(y, j);
+        RenderScanline(y);
         ScanlineFinalPass(y-1);
 
         if (threaded)
@@ -1639,10 +2026,112 @@ void SoftRenderer::RenderPolygons(bool threaded, Polygon** polygons, int npolys)
 
     ScanlineFinalPass(191);
 
+    Profiler::End(Profiler::Prof_Rasterizer, profstart);
+
     if (threaded)
         Platform::Semaphore_Post(Sema_ScanlineCount);
 }
 
+void SoftRenderer::RenderBand(int band)
+{
+    RenderBandState& b = Bands[band];
+
+    if (BandPhase == 0)
+    {
+        // set up the polygons crossing this band, with their edges
+        // stepped to where it starts
+        int n = 0;
+        for (int i = 0; i < NumBandPolygons; i++)
+        {
+            Polygon* polygon = BandPolygons[i];
+            s32 ybottom = (polygon->YBottom == polygon->YTop) ? (polygon->YTop + 1) : polygon->YBottom;
+            if (polygon->YTop >= b.YEnd || ybottom <= b.YStart)
+                continue;
+
+            RendererPolygon* rp = &b.Polygons[n++];
+            SetupPolygon(rp, polygon);
+            rp->Texels = PolygonTexels[i];
+
+            if (polygon->YTop < b.YStart)
+            {
+                SetupPolygonLeftEdge(rp, b.YStart);
+                SetupPolygonRightEdge(rp, b.YStart);
+            }
+        }
+
+        BinPolygons(b.Bins, b.Polygons, n, b.YStart);
+
+        for (s32 y = b.YStart; y < b.YEnd; y++)
+        {
+            int npolys;
+            u16* active = GetActivePolygons(b.Bins, b.Polygons, y, npolys);
+
+            for (int i = 0; i < npolys; i++)
+                RenderPolygonScanline(&b.Polygons[active[i]], y);
+        }
+    }
+    else
+    {
+        // edge marking looks at the scanlines above and below, but only
+        // at the depth and polygon ID, which the final pass doesn't change
+        for (s32 y = b.YStart; y < b.YEnd; y++)
+            ScanlineFinalPass(y);
+    }
+}
+
+void SoftRenderer::RenderPolygonsBanded(bool threaded, Polygon** polygons, int npolys)
+{
+    u64 profstart = Profiler::Begin();
+
+    NumBandPolygons = 0;
+    for (int i = 0; i < npolys; i++)
+    {
+        if (polygons[i]->Degenerate) continue;
+        BandPolygons[NumBandPolygons++] = polygons[i];
+
+        if (polygons[i]->YTop < 192)
+            PrevIsShadowMask = false;
+    }
+
+    SetupTextures(BandPolygons, NumBandPolygons);
+
+    // all the bands need to be rasterized before the final pass
+    BandPhase = 0;
+    for (int b = 1; b < NumBands; b++)
+        Platform::Semaphore_Post(Bands[b].Sema_Start);
+    RenderBand(0);
+    for (int b = 1; b < NumBands; b++)
+        Platform::Semaphore_Wait(Bands[b].Sema_Done);
+
+    // scanlines are handed out in order as their band is done
+    BandPhase = 1;
+    for (int b = 1; b < NumBands; b++)
+        Platform::Semaphore_Post(Bands[b].Sema_Start);
+    RenderBand(0);
+    for (int b = 0; b < NumBands; b++)
+    {
+        if (b > 0)
+            Platform::Semaphore_Wait(Bands[b].Sema_Done);
+
+        if (threaded)
+            Platform::Semaphore_Post(Sema_ScanlineCount, Bands[b].YEnd - Bands[b].YStart);
+    }
+
+    Profiler::End(Profiler::Prof_Rasterizer, profstart);
+}
+
+void SoftRenderer::BandThreadFunc(int band)
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Bands[band].Sema_Start);
+        if (!BandThreadsRunning) return;
+
+        RenderBand(band);
+        Platform::Semaphore_Post(Bands[band].Sema_Done);
+    }
+}
+
 void SoftRenderer::VCount144()
 {
     if (RenderThreadRunning.load(std::memory_order_relaxed) && !GPU3D::AbortFrame)
@@ -1657,6 +2146,10 @@ void SoftRenderer::RenderFrame()
     bool textureChanged = GPU::MakeVRAMFlat_TextureCoherent(textureDirty);
     bool texPalChanged = GPU::MakeVRAMFlat_TexPalCoherent(texPalDirty);
 
+    // picked up by the texture cache when the frame is rendered
+    TexCacheDirty |= textureDirty;
+    TexCacheDirtyPal |= texPalDirty;
+
     FrameIdentical = !(textureChanged || texPalChanged) && RenderFrameIdentical;
 
     if (RenderThreadRunning.load(std::memory_order_relaxed))
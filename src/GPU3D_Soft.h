@@ -22,6 +22,8 @@
 #include "Platform.h"
 #include <thread>
 #include <atomic>
+#include <unordered_map>
+#include <vector>
 
 namespace GPU3D
 {
@@ -43,6 +45,8 @@ public:
 
     void SetupRenderThread();
     void StopRenderThread();
+    void SetupBands(int numbands);
+    void StopBands();
 private:
     // Notes on the interpolator:
     //
@@ -130,17 +134,24 @@ private:
             x -= x0;
             this->x = x;
             if (xdiff != 0 && !linear)
-            {
-                s64 num = ((s64)x * w0n) << shift;
-                s32 den = (x * w0d) + ((xdiff-x) * w1d);
+                yfactor = PerspectiveFactor(x);
+        }
 
-                // this seems to be a proper division on hardware :/
-                // I haven't been able to find cases that produce imperfect output
-                if (den == 0) yfactor = 0;
-                else          yfactor = (s32)(num / den);
+        // same as above, with the factors for the span worked out beforehand
+        // by CalcFactors. the edge fill rules can send x a bit outside of it
+        void SetX(s32 x, u32* factors)
+        {
+            if (x >= factorsstart && x < factorsend)
+            {
+                this->x = x - x0;
+                yfactor = factors[x];
             }
+            else
+                SetX(x);
         }
 
+        void CalcFactors(s32 xstart, s32 xend, u32* factors, bool scalar);
+
         s32 Interpolate(s32 y0, s32 y1)
         {
             if (xdiff == 0 || y0 == y1) return y0;
@@ -215,7 +226,19 @@ private:
         }
 
     private:
+        u32 PerspectiveFactor(s32 x)
+        {
+            s64 num = ((s64)x * w0n) << shift;
+            s32 den = (x * w0d) + ((xdiff-x) * w1d);
+
+            // this seems to be a proper division on hardware :/
+            // I haven't been able to find cases that produce imperfect output
+            if (den == 0) return 0;
+            else          return (s32)(num / den);
+        }
+
         s32 x0, x1, xdiff, x;
+        s32 factorsstart, factorsend;
 
         int shift;
         bool linear;
@@ -453,24 +476,76 @@ private:
         u32 CurVL, CurVR;
         u32 NextVL, NextVR;
 
+        // decoded texture, NULL if the polygon isn't textured
+        u32* Texels;
     };
 
     RendererPolygon PolygonList[2048];
-    void TextureLookup(u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha);
-    u32 RenderPixel(Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t);
+
+    // polygons binned by the scanline they start on, so that each scanline
+    // only has to go through the polygons that actually cover it.
+    // they're kept in their original order, which the rendering depends on
+    struct PolygonBins
+    {
+        u16 First[193+1]; // index in Order of the first polygon starting on each scanline
+        u16 Order[2048];
+        u16 Active[2][2048];
+        int NumActive;
+        int CurActive;
+    };
+
+    PolygonBins Bins;
+    void BinPolygons(PolygonBins* bins, RendererPolygon* polygons, int npolys, s32 ystart);
+    u16* GetActivePolygons(PolygonBins* bins, RendererPolygon* polygons, s32 y, int& num);
+
+    // texture cache
+    // textures are decoded once to 32-bit texels, laid out like the colors
+    // the rasterizer works with (6-bit components, alpha in the top byte),
+    // and kept until the VRAM they were decoded from changes.
+    // all of the textures a frame uses are decoded before it's rasterized,
+    // so that the cache is only read while the bands are running
+    struct TexCacheEntry
+    {
+        std::vector<u32> Texels;
+
+        // where the texture data, the compressed texture palette indices
+        // and the palette were read from
+        u32 TexAddr, TexLen;
+        u32 Slot1Addr, Slot1Len;
+        u32 PalAddr, PalLen;
+    };
+
+    static constexpr u32 TexCacheMaxTexels = 4*1024*1024;
+
+    std::unordered_map<u64, TexCacheEntry> TexCache;
+    u32 TexCacheTexels;
+    NonStupidBitField<512*1024/GPU::VRAMDirtyGranularity> TexCacheDirty;
+    NonStupidBitField<128*1024/GPU::VRAMDirtyGranularity> TexCacheDirtyPal;
+    u32* PolygonTexels[2048];
+
+    void SetupTextures(Polygon** polygons, int npolys);
+    u32* GetTexture(u32 texparam, u32 texpal);
+    template <u32 format> void DecodeTexel(u32 texparam, u32 texpal, s32 s, s32 t, u16* color, u8* alpha);
+    template <u32 format> void DecodeTexture(u32 texparam, u32 texpal, u32* texels);
+
+    u32 TextureLookup(u32 texparam, u32* texels, s16 s, s16 t);
+    u32 RenderPixel(RendererPolygon* rp, u8 vr, u8 vg, u8 vb, s16 s, s16 t);
     void PlotTranslucentPixel(u32 pixeladdr, u32 color, u32 z, u32 polyattr, u32 shadow);
     void SetupPolygonLeftEdge(RendererPolygon* rp, s32 y);
     void SetupPolygonRightEdge(RendererPolygon* rp, s32 y);
     void SetupPolygon(RendererPolygon* rp, Polygon* polygon);
     void RenderShadowMaskScanline(RendererPolygon* rp, s32 y);
     void RenderPolygonScanline(RendererPolygon* rp, s32 y);
-    void RenderScanline(s32 y, int npolys);
+    void RenderScanline(s32 y);
     u32 CalculateFogDensity(u32 pixeladdr);
     void ScanlineFinalPass(s32 y);
     void ClearBuffers();
     void RenderPolygons(bool threaded, Polygon** polygons, int npolys);
+    void RenderPolygonsBanded(bool threaded, Polygon** polygons, int npolys);
+    void RenderBand(int band);
 
     void RenderThreadFunc();
+    void BandThreadFunc(int band);
 
     // buffer dimensions are 258x194 to add a offscreen 1px border
     // which simplifies edge marking tests
@@ -503,6 +578,8 @@ private:
 
     bool FrameIdentical;
 
+    bool ScalarFactors;
+
     // threading
 
     bool Threaded;
@@ -512,5 +589,32 @@ private:
     Platform::Semaphore* Sema_RenderStart;
     Platform::Semaphore* Sema_RenderDone;
     Platform::Semaphore* Sema_ScanlineCount;
+
+    // band rendering
+    // the frame can be split in bands of scanlines that are rasterized
+    // concurrently, each one by its own worker. the first band is done by
+    // whichever thread is rendering the frame
+
+    static constexpr int MaxBands = 8;
+
+    struct RenderBandState
+    {
+        s32 YStart, YEnd;
+        RendererPolygon* Polygons;
+        PolygonBins* Bins;
+
+        Platform::Thread* Thread;
+        Platform::Semaphore* Sema_Start;
+        Platform::Semaphore* Sema_Done;
+    };
+
+    int NumBands;
+    RenderBandState Bands[MaxBands];
+    std::atomic_bool BandThreadsRunning;
+
+    // 0 = rasterize, 1 = final pass
+    int BandPhase;
+    Polygon* BandPolygons[2048];
+    int NumBandPolygons;
 };
 }
\ No newline at end of file
@@ -22,6 +22,7 @@
 #include "Config.h"
 #include "NDS.h"
 #include "ARM.h"
+#include "ARMInterpreter_Cache.h"
 #include "NDSCart.h"
 #include "GBACart.h"
 #include "DMA.h"
@@ -35,6 +36,8 @@
 #include "Platform.h"
 #include "NDSCart_SRAMManager.h"
 #include "FreeBIOS.h"
+#include "Profiler.h"
+#include "Rewind.h"
 
 #ifdef JIT_ENABLED
 #include "ARMJIT.h"
@@ -99,6 +102,11 @@ u64 SysTimestamp;
 
 SchedEvent SchedList[Event_MAX];
 u32 SchedListMask;
+// timestamp of the earliest scheduled event, kept up to date so that
+// NextTarget() doesn't have to walk the whole list every iteration
+u64 SchedListNext;
+// set when an event is cancelled, RunSystem() can't trust what it gathered then
+bool SchedListStale;
 
 u32 CPUStop;
 
@@ -117,6 +125,12 @@ MemRegion SWRAM_ARM7;
 
 u8* ARM7WRAM;
 
+u8* ARM9ReadMap[BusMapPages];
+u8* ARM9WriteMap[BusMapPages];
+u8* ARM7ReadMap[BusMapPages];
+u8* ARM7WriteMap[BusMapPages];
+bool BusMapWritable;
+
 u16 ExMemCnt[2];
 
 // TODO: these belong in NDSCart!
@@ -170,6 +184,7 @@ bool RunningGame;
 void DivDone(u32 param);
 void SqrtDone(u32 param);
 void RunTimer(u32 tid, s32 cycles);
+void UpdateSchedListNext();
 void SetWifiWaitCnt(u16 val);
 void SetGBASlotTimings();
 
@@ -236,6 +251,8 @@ void DeInit()
     DSi::DeInit();
 
     AREngine::DeInit();
+
+    Rewind::Reset();
 }
 
 
@@ -310,6 +327,10 @@ void SetARM7RegionTimings(u32 addrstart, u32 addrend, u32 region, int buswidth,
 
         ARM7Regions[i] = region;
     }
+
+#ifdef JIT_ENABLED
+    ARMJIT::MemoryMapChanged();
+#endif
 }
 
 void InitTimings()
@@ -458,6 +479,9 @@ void Reset()
     RunningGame = false;
     LastSysClockCycles = 0;
 
+    // the history belongs to whatever was running before
+    Rewind::Reset();
+
     memset(ARM9BIOS, 0, 0x1000);
     memset(ARM7BIOS, 0, 0x4000);
 
@@ -497,6 +521,7 @@ void Reset()
 #ifdef JIT_ENABLED
     ARMJIT::Reset();
 #endif
+    ARMInterpreter::ResetBlockCache();
 
     if (ConsoleType == 1)
     {
@@ -579,6 +604,7 @@ void Reset()
 
     memset(SchedList, 0, sizeof(SchedList));
     SchedListMask = 0;
+    SchedListNext = UINT64_MAX;
 
     KeyInput = 0x007F03FF;
     KeyCnt = 0;
@@ -612,6 +638,8 @@ void Reset()
     SPU::SetDegrade10Bit(degradeAudio);
 
     AREngine::Reset();
+
+    UpdateBusMaps();
 }
 
 void Stop()
@@ -687,7 +715,7 @@ bool DoSavestate_Scheduler(Savestate* file)
         {
             SchedEvent* evt = &SchedList[i];
 
-            u32 funcid;
+            u32 funcid = 0xFFFFFFFF;
             file->Var32(&funcid);
 
             if (funcid != 0xFFFFFFFF)
@@ -773,6 +801,8 @@ bool DoSavestate(Savestate* file)
 
     if (!DoSavestate_Scheduler(file)) return false;
     file->Var32(&SchedListMask);
+    if (!file->Saving)
+        UpdateSchedListNext();
     file->Var64(&ARM9Timestamp);
     file->Var64(&ARM9Target);
     file->Var64(&ARM7Timestamp);
@@ -836,6 +866,9 @@ bool DoSavestate(Savestate* file)
     }
 #endif
 
+    if (!file->Saving)
+        UpdateBusMaps();
+
     return true;
 }
 
@@ -912,23 +945,30 @@ void RelocateSave(const char* path, bool write)
 
 
 
-u64 NextTarget()
+void UpdateSchedListNext()
 {
-    u64 ret = SysTimestamp + kMaxIterationCycles;
+    u64 next = UINT64_MAX;
 
     u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+    while (mask)
     {
-        if (!mask) break;
-        if (mask & 0x1)
-        {
-            if (SchedList[i].Timestamp < ret)
-                ret = SchedList[i].Timestamp;
-        }
+        int i = __builtin_ctz(mask);
+        if (SchedList[i].Timestamp < next)
+            next = SchedList[i].Timestamp;
 
-        mask >>= 1;
+        mask &= mask - 1;
     }
 
+    SchedListNext = next;
+}
+
+u64 NextTarget()
+{
+    u64 ret = SysTimestamp + kMaxIterationCycles;
+
+    if (SchedListNext < ret)
+        ret = SchedListNext;
+
     return ret;
 }
 
@@ -936,21 +976,35 @@ void RunSystem(u64 timestamp)
 {
     SysTimestamp = timestamp;
 
+    // nothing is due yet, no need to look at the list
+    if (SchedListNext > SysTimestamp)
+        return;
+
+    // the next deadline is gathered in the same pass, events scheduled
+    // by the handlers lower it through ScheduleEvent()
+    u64 next = UINT64_MAX;
+    SchedListNext = UINT64_MAX;
+    SchedListStale = false;
+
     u32 mask = SchedListMask;
-    for (int i = 0; i < Event_MAX; i++)
+    while (mask)
     {
-        if (!mask) break;
-        if (mask & 0x1)
+        int i = __builtin_ctz(mask);
+        if (SchedList[i].Timestamp <= SysTimestamp)
         {
-            if (SchedList[i].Timestamp <= SysTimestamp)
-            {
-                SchedListMask &= ~(1<<i);
-                SchedList[i].Func(SchedList[i].Param);
-            }
+            SchedListMask &= ~(1<<i);
+            SchedList[i].Func(SchedList[i].Param);
         }
+        else if (SchedList[i].Timestamp < next)
+            next = SchedList[i].Timestamp;
 
-        mask >>= 1;
+        mask &= mask - 1;
     }
+
+    if (SchedListStale)
+        UpdateSchedListNext();
+    else if (next < SchedListNext)
+        SchedListNext = next;
 }
 
 template <bool EnableJIT, int ConsoleType>
@@ -971,6 +1025,8 @@ u32 RunFrame()
             ARM9Target = target << ARM9ClockShift;
             CurCPU = 0;
 
+            u64 profstart = Profiler::Begin();
+
             if (CPUStop & 0x80000000)
             {
                 // GXFIFO stall
@@ -985,6 +1041,8 @@ u32 RunFrame()
                 if (!(CPUStop & 0x80000000)) DMAs[2]->Run<ConsoleType>();
                 if (!(CPUStop & 0x80000000)) DMAs[3]->Run<ConsoleType>();
                 if (ConsoleType == 1) DSi::RunNDMAs(0);
+
+                Profiler::End(Profiler::Prof_DMA, profstart);
             }
             else
             {
@@ -993,11 +1051,19 @@ u32 RunFrame()
                     ARM9->ExecuteJIT();
                 else
 #endif
+                if (Config::CachedInterpreter)
+                    ARM9->ExecuteCached();
+                else
                     ARM9->Execute();
+
+                Profiler::End(Profiler::Prof_ARM9, profstart);
             }
 
             RunTimers(0);
+
+            profstart = Profiler::Begin();
             GPU3D::Run();
+            Profiler::End(Profiler::Prof_GPU3D, profstart);
 
             target = ARM9Timestamp >> ARM9ClockShift;
             CurCPU = 1;
@@ -1006,6 +1072,8 @@ u32 RunFrame()
             {
                 ARM7Target = target; // might be changed by a reschedule
 
+                profstart = Profiler::Begin();
+
                 if (CPUStop & 0x0FFF0000)
                 {
                     DMAs[4]->Run<ConsoleType>();
@@ -1013,6 +1081,8 @@ u32 RunFrame()
                     DMAs[6]->Run<ConsoleType>();
                     DMAs[7]->Run<ConsoleType>();
                     if (ConsoleType == 1) DSi::RunNDMAs(1);
+
+                    Profiler::End(Profiler::Prof_DMA, profstart);
                 }
                 else
                 {
@@ -1021,7 +1091,12 @@ u32 RunFrame()
                         ARM7->ExecuteJIT();
                     else
 #endif
+                    if (Config::CachedInterpreter)
+                        ARM7->ExecuteCached();
+                    else
                         ARM7->Execute();
+
+                    Profiler::End(Profiler::Prof_ARM7, profstart);
                 }
 
                 RunTimers(1);
@@ -1065,6 +1140,10 @@ u32 RunFrame()
 u32 RunFrame()
 {
 #ifdef JIT_ENABLED
+    // the JIT got toggled since the page tables were built
+    if (BusMapWritable == (bool)Config::JIT_Enable)
+        UpdateBusMaps();
+
     if (Config::JIT_Enable)
         return NDS::ConsoleType == 1
             ? RunFrame<true, 1>()
@@ -1114,13 +1193,21 @@ void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 para
     evt->Param = param;
 
     SchedListMask |= (1<<id);
+    if (evt->Timestamp < SchedListNext)
+        SchedListNext = evt->Timestamp;
 
     Reschedule(evt->Timestamp);
 }
 
 void CancelEvent(u32 id)
 {
+    if (!(SchedListMask & (1<<id)))
+        return;
+
     SchedListMask &= ~(1<<id);
+    SchedListStale = true;
+    if (SchedList[id].Timestamp == SchedListNext)
+        UpdateSchedListNext();
 }
 
 
@@ -1240,6 +1327,130 @@ void MapSharedWRAM(u8 val)
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
     }
+
+    UpdateBusMap(0x03);
+}
+
+void UpdateBusMap(u32 region)
+{
+    // this has to mirror what the Read/Write handlers below do, including
+    // the DSi ones, as DMA uses these tables directly
+    for (u32 page = region << 12; page < ((region + 1) << 12); page++)
+    {
+        u32 addr = page << 12;
+        u8* read9 = NULL;
+        u8* write9 = NULL;
+        u8* read7 = NULL;
+        u8* write7 = NULL;
+
+        switch (region)
+        {
+        case 0x02:
+            read9 = write9 = &MainRAM[addr & MainRAMMask];
+            read7 = write7 = &MainRAM[addr & MainRAMMask];
+
+            // region lock hack, see DSi::ARM9Read32
+            if (ConsoleType == 1 && page == (0x02FE71B0 >> 12))
+                read9 = NULL;
+            break;
+
+        case 0x03:
+            if (SWRAM_ARM9.Mem)
+                read9 = write9 = &SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask];
+
+            if (addr < 0x03800000 && SWRAM_ARM7.Mem)
+                read7 = write7 = &SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask];
+            else
+                read7 = write7 = &ARM7WRAM[addr & (ARM7WRAMSize - 1)];
+
+            // leave the new WRAM to the DSi handlers
+            if (ConsoleType == 1 && (DSi::SCFG_EXT[0] & (1<<25)))
+                read9 = write9 = NULL;
+            if (ConsoleType == 1 && (DSi::SCFG_EXT[1] & (1<<25)))
+                read7 = write7 = NULL;
+            break;
+
+        case 0x06:
+            // VRAM writes have side effects, only reads are mapped
+            switch (addr & 0x00E00000)
+            {
+            case 0x00000000: read9 = GPU::VRAMPtr_ABG[(addr >> 14) & 0x1F]; break;
+            case 0x00200000: read9 = GPU::VRAMPtr_BBG[(addr >> 14) & 0x7]; break;
+            case 0x00400000: read9 = GPU::VRAMPtr_AOBJ[(addr >> 14) & 0xF]; break;
+            case 0x00600000: read9 = GPU::VRAMPtr_BOBJ[(addr >> 14) & 0x7]; break;
+            default:         read9 = GPU::GetVRAMPtr_LCDC(addr); break;
+            }
+            if (read9) read9 += addr & 0x3000;
+
+            switch (GPU::VRAMMap_ARM7[(addr >> 17) & 0x1])
+            {
+            case (1<<2): read7 = &GPU::VRAM_C[addr & 0x1FFFF]; break;
+            case (1<<3): read7 = &GPU::VRAM_D[addr & 0x1FFFF]; break;
+            }
+            break;
+        }
+
+        ARM9ReadMap[page] = read9;
+        ARM7ReadMap[page] = read7;
+        ARM9WriteMap[page] = BusMapWritable ? write9 : NULL;
+        ARM7WriteMap[page] = BusMapWritable ? write7 : NULL;
+    }
+}
+
+void UpdateBusMaps()
+{
+#ifdef JIT_ENABLED
+    BusMapWritable = !Config::JIT_Enable;
+#else
+    BusMapWritable = true;
+#endif
+
+    for (u32 region = 0; region < (BusMapPages >> 12); region++)
+        UpdateBusMap(region);
+}
+
+u8* GetDMAReadPtr(u32 cpu, u32 addr)
+{
+    u8* page = BusMapLookup(cpu ? ARM7ReadMap : ARM9ReadMap, addr);
+    if (!page) return NULL;
+    return &page[addr & 0xFFF];
+}
+
+u8* GetDMAWritePtr(u32 cpu, u32 addr)
+{
+    u8* page = BusMapLookup(cpu ? ARM7WriteMap : ARM9WriteMap, addr);
+    if (page) return &page[addr & 0xFFF];
+
+    // VRAM isn't in the write tables because of the dirty tracking,
+    // which MarkDMAWrite takes care of instead
+    if (cpu == 0 && (addr & 0xFF000000) == 0x06000000 && BusMapWritable)
+    {
+        if (ConsoleType == 1 && !(DSi::SCFG_EXT[0] & (1<<13)))
+            return NULL;
+
+        u32 bank, ofs;
+        if (GPU::GetVRAMBank(addr, bank, ofs))
+        {
+            if (GPU::Deferred2DPending) GPU::Sync2D();
+            return &GPU::VRAM[bank][ofs];
+        }
+    }
+
+    return NULL;
+}
+
+void MarkDMAWrite(u32 cpu, u32 addr, u32 len)
+{
+    if (cpu != 0 || (addr & 0xFF000000) != 0x06000000 || !len)
+        return;
+
+    u32 bank, ofs;
+    if (!GPU::GetVRAMBank(addr, bank, ofs))
+        return;
+
+    u32 start = ofs / GPU::VRAMDirtyGranularity;
+    u32 end = (ofs + len - 1) / GPU::VRAMDirtyGranularity;
+    GPU::VRAMDirty[bank].SetRange(start, end - start + 1);
 }
 
 
@@ -1897,6 +2108,9 @@ void debug(u32 param)
 
 u8 ARM9Read8(u32 addr)
 {
+    u8* page = BusMapLookup(ARM9ReadMap, addr);
+    if (page) return *(u8*)&page[addr & 0xFFF];
+
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
     {
         return *(u8*)&ARM9BIOS[addr & 0xFFF];
@@ -1955,6 +2169,9 @@ u8 ARM9Read8(u32 addr)
 
 u16 ARM9Read16(u32 addr)
 {
+    u8* page = BusMapLookup(ARM9ReadMap, addr);
+    if (page) return *(u16*)&page[addr & 0xFFF];
+
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
     {
         return *(u16*)&ARM9BIOS[addr & 0xFFF];
@@ -2013,6 +2230,9 @@ u16 ARM9Read16(u32 addr)
 
 u32 ARM9Read32(u32 addr)
 {
+    u8* page = BusMapLookup(ARM9ReadMap, addr);
+    if (page) return *(u32*)&page[addr & 0xFFF];
+
     if ((addr & 0xFFFFF000) == 0xFFFF0000)
     {
         return *(u32*)&ARM9BIOS[addr & 0xFFF];
@@ -2074,6 +2294,13 @@ u32 ARM9Read32(u32 addr)
 
 void ARM9Write8(u32 addr, u8 val)
 {
+    u8* page = BusMapLookup(ARM9WriteMap, addr);
+    if (page)
+    {
+        *(u8*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF000000)
     {
     case 0x02000000:
@@ -2117,6 +2344,13 @@ void ARM9Write8(u32 addr, u8 val)
 
 void ARM9Write16(u32 addr, u16 val)
 {
+    u8* page = BusMapLookup(ARM9WriteMap, addr);
+    if (page)
+    {
+        *(u16*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF000000)
     {
     case 0x02000000:
@@ -2181,6 +2415,13 @@ void ARM9Write16(u32 addr, u16 val)
 
 void ARM9Write32(u32 addr, u32 val)
 {
+    u8* page = BusMapLookup(ARM9WriteMap, addr);
+    if (page)
+    {
+        *(u32*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF000000)
     {
     case 0x02000000:
@@ -2280,6 +2521,9 @@ bool ARM9GetMemRegion(u32 addr, bool write, MemRegion* region)
 
 u8 ARM7Read8(u32 addr)
 {
+    u8* page = BusMapLookup(ARM7ReadMap, addr);
+    if (page) return *(u8*)&page[addr & 0xFFF];
+
     if (addr < 0x00004000)
     {
         // TODO: check the boundary? is it 4000 or higher on regular DS?
@@ -2345,6 +2589,9 @@ u8 ARM7Read8(u32 addr)
 
 u16 ARM7Read16(u32 addr)
 {
+    u8* page = BusMapLookup(ARM7ReadMap, addr);
+    if (page) return *(u16*)&page[addr & 0xFFF];
+
     if (addr < 0x00004000)
     {
         if (ARM7->R[15] >= 0x00004000)
@@ -2408,6 +2655,9 @@ u16 ARM7Read16(u32 addr)
 
 u32 ARM7Read32(u32 addr)
 {
+    u8* page = BusMapLookup(ARM7ReadMap, addr);
+    if (page) return *(u32*)&page[addr & 0xFFF];
+
     if (addr < 0x00004000)
     {
         if (ARM7->R[15] >= 0x00004000)
@@ -2474,6 +2724,13 @@ u32 ARM7Read32(u32 addr)
 
 void ARM7Write8(u32 addr, u8 val)
 {
+    u8* page = BusMapLookup(ARM7WriteMap, addr);
+    if (page)
+    {
+        *(u8*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF800000)
     {
     case 0x02000000:
@@ -2540,6 +2797,13 @@ void ARM7Write8(u32 addr, u8 val)
 
 void ARM7Write16(u32 addr, u16 val)
 {
+    u8* page = BusMapLookup(ARM7WriteMap, addr);
+    if (page)
+    {
+        *(u16*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF800000)
     {
     case 0x02000000:
@@ -2616,6 +2880,13 @@ void ARM7Write16(u32 addr, u16 val)
 
 void ARM7Write32(u32 addr, u32 val)
 {
+    u8* page = BusMapLookup(ARM7WriteMap, addr);
+    if (page)
+    {
+        *(u32*)&page[addr & 0xFFF] = val;
+        return;
+    }
+
     switch (addr & 0xFF800000)
     {
     case 0x02000000:
@@ -3345,6 +3616,10 @@ void ARM9IOWrite16(u32 addr, u16 val)
             ExMemCnt[1] = (ExMemCnt[1] & 0x007F) | (val & 0xFF80);
             if ((oldVal ^ ExMemCnt[0]) & 0xFF)
                 SetGBASlotTimings();
+#ifdef JIT_ENABLED
+            if ((oldVal ^ ExMemCnt[0]) & (1<<11))
+                ARMJIT::MemoryMapChanged();
+#endif
             return;
         }
 
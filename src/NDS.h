@@ -213,6 +213,24 @@ extern u32 KeyInput;
 const u32 ARM7WRAMSize = 0x10000;
 extern u8* ARM7WRAM;
 
+// page tables for the ARM9/ARM7 buses, one host pointer per 4K page
+// over the first 256MB. NULL means the access has to go through the
+// regular handlers (I/O, BIOS, VRAM with several banks overlapping, ...)
+// the write tables are left empty while the JIT runs, since it needs
+// to see every write to invalidate code
+const u32 BusMapPages = 0x10000;
+
+extern u8* ARM9ReadMap[BusMapPages];
+extern u8* ARM9WriteMap[BusMapPages];
+extern u8* ARM7ReadMap[BusMapPages];
+extern u8* ARM7WriteMap[BusMapPages];
+
+inline u8* BusMapLookup(u8** map, u32 addr)
+{
+    if (addr >= (BusMapPages << 12)) return NULL;
+    return map[addr >> 12];
+}
+
 bool Init();
 void DeInit();
 void Reset();
@@ -250,6 +268,9 @@ int ImportSRAM(u8* data, u32 length);
 
 void ScheduleEvent(u32 id, bool periodic, s32 delay, void (*func)(u32), u32 param);
 void CancelEvent(u32 id);
+// timestamp RunFrame() runs the CPUs up to, then runs the events due by then
+u64 NextTarget();
+void RunSystem(u64 timestamp);
 
 void debug(u32 p);
 
@@ -257,6 +278,16 @@ void Halt();
 
 void MapSharedWRAM(u8 val);
 
+// rebuild the page tables for one 16MB region (addr >> 24), or all of them
+void UpdateBusMap(u32 region);
+void UpdateBusMaps();
+
+// host pointers DMA can use for a run of units within one page, NULL when it
+// has to go through the bus handlers. writes have to be followed by MarkDMAWrite
+u8* GetDMAReadPtr(u32 cpu, u32 addr);
+u8* GetDMAWritePtr(u32 cpu, u32 addr);
+void MarkDMAWrite(u32 cpu, u32 addr, u32 len);
+
 void UpdateIRQ(u32 cpu);
 void SetIRQ(u32 cpu, u32 irq);
 void ClearIRQ(u32 cpu, u32 irq);
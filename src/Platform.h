@@ -79,6 +79,12 @@ inline bool LocalFileExists(const char* name)
     return true;
 }
 
+// rename() wrapper that supports UTF8
+// replaces the destination if it exists, atomically where the OS allows it
+bool RenameFile(const char* oldpath, const char* newpath);
+// same for files local to the emulator, see OpenLocalFile()
+bool RenameLocalFile(const char* oldpath, const char* newpath);
+
 struct Thread;
 Thread* Thread_Create(std::function<void()> func);
 void Thread_Free(Thread* thread);
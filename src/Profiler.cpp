@@ -0,0 +1,45 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "Profiler.h"
+
+namespace Profiler
+{
+
+bool Enabled = false;
+std::atomic<u64> Time[Prof_MAX];
+
+const char* SectionNames[Prof_MAX] =
+{
+    "ARM9",
+    "ARM7",
+    "DMA",
+    "GPU3D::Run",
+    "2D scanlines",
+    "3D rasterizer",
+    "SPU::Mix",
+    "rewind capture",
+};
+
+void Reset()
+{
+    for (int i = 0; i < Prof_MAX; i++)
+        Time[i] = 0;
+}
+
+}
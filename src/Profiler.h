@@ -0,0 +1,75 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+
+#include "types.h"
+
+// coarse per-subsystem wall clock accounting
+// disabled by default, the cost when disabled is one branch per section
+namespace Profiler
+{
+
+enum
+{
+    Prof_ARM9 = 0,
+    Prof_ARM7,
+    Prof_DMA,
+    Prof_GPU3D,
+    Prof_GPU2D,
+    Prof_Rasterizer,
+    Prof_SPU,
+    Prof_Rewind,
+
+    Prof_MAX
+};
+
+extern bool Enabled;
+
+// accumulated time per section, in nanoseconds
+// atomic since some sections are also timed on worker threads
+extern std::atomic<u64> Time[Prof_MAX];
+
+extern const char* SectionNames[Prof_MAX];
+
+void Reset();
+
+inline u64 Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline u64 Begin()
+{
+    return Enabled ? Now() : 0;
+}
+
+inline void End(int section, u64 start)
+{
+    if (Enabled)
+        Time[section].fetch_add(Now() - start, std::memory_order_relaxed);
+}
+
+}
+
+#endif // PROFILER_H
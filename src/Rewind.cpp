@@ -0,0 +1,154 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "NDS.h"
+#include "Profiler.h"
+#include "Savestate.h"
+#include "Rewind.h"
+
+
+namespace Rewind
+{
+
+u32 Budget = DefaultBudget;
+
+// the most recently captured state, in full
+std::vector<u8> State;
+
+// one undo log per frame, oldest first
+// applying the newest one to State turns it into the frame before
+std::deque<std::vector<u8>> Journal;
+u32 JournalSize = 0;
+
+
+void Trim()
+{
+    while (!Journal.empty() && (State.size() + JournalSize) > Budget)
+    {
+        JournalSize -= Journal.front().size();
+        Journal.pop_front();
+    }
+}
+
+void SetBudget(u32 bytes)
+{
+    Budget = bytes;
+    Trim();
+}
+
+void Reset()
+{
+    State.clear();
+    Journal.clear();
+    JournalSize = 0;
+}
+
+bool CaptureFull()
+{
+    Savestate* dry = new Savestate();
+    NDS::DoSavestate(dry);
+    u32 size = (u32)dry->GetOffset();
+    delete dry;
+
+    Reset();
+    State.resize(size);
+
+    Savestate* state = new Savestate(State.data(), size, true);
+    bool ok = !state->Error && NDS::DoSavestate(state) && !state->Error;
+    delete state;
+
+    if (!ok) Reset();
+    return ok;
+}
+
+bool DoCapture()
+{
+    if (State.empty())
+        return CaptureFull();
+
+    // only the bytes that changed since the last frame are written to State,
+    // their old contents go to the log
+    std::vector<u8> log;
+
+    Savestate* state = new Savestate(State.data(), State.size(), true);
+    state->SetUndoLog(&log);
+    bool ok = !state->Error && NDS::DoSavestate(state) && !state->Error;
+
+    // the state size changes with the cart save memory, if it doesn't match
+    // anymore the history can't be diffed against, so start over
+    if (ok && state->GetOffset() != State.size())
+        ok = false;
+    delete state;
+
+    if (!ok)
+        return CaptureFull();
+
+    JournalSize += log.size();
+    Journal.push_back(std::move(log));
+    Trim();
+
+    return true;
+}
+
+bool Capture()
+{
+    u64 profstart = Profiler::Begin();
+    bool ret = DoCapture();
+    Profiler::End(Profiler::Prof_Rewind, profstart);
+    return ret;
+}
+
+bool Step()
+{
+    if (Journal.empty()) return false;
+
+    std::vector<u8>& log = Journal.back();
+    Savestate::ApplyUndoLog(State.data(), State.size(), log);
+    JournalSize -= log.size();
+    Journal.pop_back();
+
+    Savestate* state = new Savestate(State.data(), State.size(), false);
+    bool ok = !state->Error && NDS::DoSavestate(state) && !state->Error;
+    delete state;
+
+    if (!ok)
+    {
+        printf("rewind: failed to load previous frame\n");
+        Reset();
+        return false;
+    }
+
+    return true;
+}
+
+u32 NumFrames()
+{
+    return Journal.size();
+}
+
+u32 MemoryUsage()
+{
+    return State.size() + JournalSize;
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "types.h"
+
+// rewind history, kept in memory
+// the newest state is kept whole, every older frame is stored as the list of
+// bytes that changed between it and the frame after it
+namespace Rewind
+{
+
+// default memory budget for the history, in bytes
+const u32 DefaultBudget = 64 * 1024 * 1024;
+
+void SetBudget(u32 bytes);
+
+// drops the whole history
+// should be called whenever a new game is started
+void Reset();
+
+// records the current state of the emulator, to be called once per frame
+bool Capture();
+
+// goes back to the previous recorded frame
+// returns false if there is nothing left to go back to
+bool Step();
+
+u32 NumFrames();
+u32 MemoryUsage();
+
+}
+
+#endif // REWIND_H
@@ -23,6 +23,7 @@
 #include "NDS.h"
 #include "DSi.h"
 #include "SPU.h"
+#include "Profiler.h"
 
 
 // SPU TODO
@@ -692,6 +693,8 @@ void CaptureUnit::Run(s32 sample)
 
 void Mix(u32 dummy)
 {
+    u64 profstart = Profiler::Begin();
+
     s32 left = 0, right = 0;
     s32 leftoutput = 0, rightoutput = 0;
 
@@ -830,6 +833,8 @@ void Mix(u32 dummy)
     OutputBackbufferWritePosition += 2;
 
     NDS::ScheduleEvent(NDS::Event_SPU, true, 1024, Mix, 0);
+
+    Profiler::End(Profiler::Prof_SPU, profstart);
 }
 
 void TransferOutput()
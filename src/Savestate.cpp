@@ -17,17 +17,10 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "Savestate.h"
 #include "Platform.h"
 
-#ifdef __LIBRETRO__
-#define fclose(stream) memstream_close(stream)
-#define fread(data, len, count, stream) memstream_read(stream, data, len)
-#define fwrite(data, len, count, stream) memstream_write(stream, data, len)
-#define fseek(stream, offset, mask) memstream_seek(stream, offset, mask)
-#define ftell(stream) memstream_pos(stream)
-#endif
-
 /*
     Savestate format
 
@@ -51,76 +44,104 @@
     * different minor means adjustments may have to be made
 */
 
-#ifdef __LIBRETRO__
-Savestate::Savestate(void *data, size_t size, bool save)
-#else
+#ifndef __LIBRETRO__
 Savestate::Savestate(const char* filename, bool save)
+{
+    Error = false;
+    Measuring = false;
+    UndoLog = NULL;
+
+    Buffer = NULL;
+    BufferLength = 0;
+    BufferOffset = 0;
+    BufferEnd = 0;
+
+    file = Platform::OpenFile(filename, save ? "wb" : "rb");
+    if (!file)
+    {
+        printf("savestate: file %s doesn't exist\n", filename);
+        Error = true;
+        return;
+    }
+
+    Begin(save);
+}
 #endif
+
+Savestate::Savestate(void* data, u32 size, bool save)
 {
-    const char* magic = "MELN";
+    Error = false;
+    Measuring = false;
+    UndoLog = NULL;
+
+#ifndef __LIBRETRO__
+    file = NULL;
+#endif
+    Buffer = (u8*)data;
+    BufferLength = size;
+    BufferOffset = 0;
+    BufferEnd = 0;
+
+    if (!Buffer)
+    {
+        printf("savestate: no buffer given\n");
+        Error = true;
+        return;
+    }
+
+    Begin(save);
+}
 
+Savestate::Savestate()
+{
     Error = false;
+    Saving = true;
+    Measuring = true;
+    UndoLog = NULL;
+
+    VersionMajor = SAVESTATE_MAJOR;
+    VersionMinor = SAVESTATE_MINOR;
+
+#ifndef __LIBRETRO__
+    file = NULL;
+#endif
+    Buffer = NULL;
+    BufferLength = 0;
+    BufferOffset = 0;
+    BufferEnd = 0;
+
+    MeasuredLength = 0x10; // header
+    CurSection = -1;
+}
+
+void Savestate::Begin(bool save)
+{
+    const char* magic = "MELN";
 
     if (save)
     {
         Saving = true;
-#ifdef __LIBRETRO__
-        memstream_set_buffer((uint8_t*)data, size);
-        file = memstream_open(true);
-        if (file == NULL)
-        {
-            printf("unable to create memstream for savestate\n");
-            Error = true;
-            return;
-        }
-#else
-        file = Platform::OpenFile(filename, "wb");
-        if (!file)
-        {
-            printf("savestate: file %s doesn't exist\n", filename);
-            Error = true;
-            return;
-        }
-#endif
 
         VersionMajor = SAVESTATE_MAJOR;
         VersionMinor = SAVESTATE_MINOR;
 
-        fwrite(magic, 4, 1, file);
-        fwrite(&VersionMajor, 2, 1, file);
-        fwrite(&VersionMinor, 2, 1, file);
-        fseek(file, 8, SEEK_CUR); // length to be fixed later
+        Write(magic, 4);
+        Write(&VersionMajor, 2);
+        Write(&VersionMinor, 2);
+        Seek(8, SEEK_CUR); // length to be fixed later
     }
     else
     {
         Saving = false;
-#ifdef __LIBRETRO__
-        memstream_set_buffer((uint8_t*)data, size);
-        file = memstream_open(false);
-        if (file == NULL)
-        {
-            printf("unable to create memstream for savestate\n");
-            Error = true;
-            return;
-        }
-#else
-        file = Platform::OpenFile(filename, "rb");
-        if (!file)
-        {
-            printf("savestate: file %s doesn't exist\n", filename);
-            Error = true;
-            return;
-        }
-#endif
 
         u32 len;
-        fseek(file, 0, SEEK_END);
-        len = (u32)ftell(file);
-        fseek(file, 0, SEEK_SET);
+        Seek(0, SEEK_END);
+        len = Tell();
+        Seek(0, SEEK_SET);
 
         u32 buf = 0;
 
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != ((u32*)magic)[0])
         {
             printf("savestate: invalid magic %08X\n", buf);
@@ -131,7 +152,7 @@ Savestate::Savestate(const char* filename, bool save)
         VersionMajor = 0;
         VersionMinor = 0;
 
-        fread(&VersionMajor, 2, 1, file);
+        Read(&VersionMajor, 2);
         if (VersionMajor != SAVESTATE_MAJOR)
         {
             printf("savestate: bad version major %d, expecting %d\n", VersionMajor, SAVESTATE_MAJOR);
@@ -139,7 +160,7 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        fread(&VersionMinor, 2, 1, file);
+        Read(&VersionMinor, 2);
         if (VersionMinor > SAVESTATE_MINOR)
         {
             printf("savestate: state from the future, %d > %d\n", VersionMinor, SAVESTATE_MINOR);
@@ -148,7 +169,7 @@ Savestate::Savestate(const char* filename, bool save)
         }
 
         buf = 0;
-        fread(&buf, 4, 1, file);
+        Read(&buf, 4);
         if (buf != len)
         {
             printf("savestate: bad length %d\n", buf);
@@ -156,7 +177,7 @@ Savestate::Savestate(const char* filename, bool save)
             return;
         }
 
-        fseek(file, 4, SEEK_CUR);
+        Seek(4, SEEK_CUR);
     }
 
     CurSection = -1;
@@ -165,133 +186,243 @@ Savestate::Savestate(const char* filename, bool save)
 Savestate::~Savestate()
 {
     if (Error) return;
+    if (Measuring) return;
 
     if (Saving)
     {
         if (CurSection != 0xFFFFFFFF)
         {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+            u32 pos = Tell();
+            Seek(CurSection+4, SEEK_SET);
 
             u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+            Write(&len, 4);
 
-            fseek(file, pos, SEEK_SET);
+            Seek(pos, SEEK_SET);
         }
 
-        fseek(file, 0, SEEK_END);
-        u32 len = (u32)ftell(file);
-        fseek(file, 8, SEEK_SET);
-        fwrite(&len, 4, 1, file);
+        Seek(0, SEEK_END);
+        u32 len = Tell();
+        Seek(8, SEEK_SET);
+        Write(&len, 4);
     }
 
+#ifndef __LIBRETRO__
     if (file) fclose(file);
+#endif
 }
 
-void Savestate::Section(const char* magic)
+void Savestate::SetUndoLog(std::vector<u8>* log)
 {
-    if (Error) return;
+    if (!Buffer) return;
 
-    if (Saving)
+    UndoLog = log;
+    UndoLastRecord = 0;
+    UndoLastEnd = 0xFFFFFFFF;
+}
+
+void Savestate::ApplyUndoLog(u8* data, u32 size, const std::vector<u8>& log)
+{
+    // records are applied newest first, in case a spot got written twice
+    std::vector<u32> records;
+    u32 pos = 0;
+    while (pos + 8 <= log.size())
     {
-        if (CurSection != 0xFFFFFFFF)
-        {
-            u32 pos = (u32)ftell(file);
-            fseek(file, CurSection+4, SEEK_SET);
+        u32 len;
+        memcpy(&len, &log[pos+4], 4);
+        records.push_back(pos);
+        pos += 8 + len;
+    }
 
-            u32 len = pos - CurSection;
-            fwrite(&len, 4, 1, file);
+    for (auto it = records.rbegin(); it != records.rend(); it++)
+    {
+        u32 offset, len;
+        memcpy(&offset, &log[*it], 4);
+        memcpy(&len, &log[*it+4], 4);
+        if (offset > size || len > size - offset) continue;
 
-            fseek(file, pos, SEEK_SET);
-        }
+        memcpy(&data[offset], &log[*it+8], len);
+    }
+}
+
+void Savestate::Write(const void* data, u32 len)
+{
+    if (Measuring)
+    {
+        MeasuredLength += len;
+        return;
+    }
 
-        CurSection = (u32)ftell(file);
+#ifndef __LIBRETRO__
+    if (file)
+    {
+        fwrite(data, len, 1, file);
+        return;
+    }
+#endif
 
-        fwrite(magic, 4, 1, file);
-        fseek(file, 12, SEEK_CUR);
+    if (len > BufferLength - BufferOffset)
+    {
+        printf("savestate: buffer too small\n");
+        Error = true;
+        return;
     }
+
+    if (UndoLog)
+        WriteDiff(data, len);
     else
+        memcpy(&Buffer[BufferOffset], data, len);
+
+    BufferOffset += len;
+    if (BufferOffset > BufferEnd) BufferEnd = BufferOffset;
+}
+
+void Savestate::WriteDiff(const void* data, u32 len)
+{
+    // compare in blocks aligned to the start of the state
+    // unchanged blocks are left alone, changed ones are logged and copied over
+    const u32 blocksize = 256;
+    const u8* src = (const u8*)data;
+    u8* dst = &Buffer[BufferOffset];
+
+    u32 pos = 0;
+    while (pos < len)
     {
-        fseek(file, 0x10, SEEK_SET);
+        u32 offset = BufferOffset + pos;
+        u32 blocklen = blocksize - (offset & (blocksize-1));
+        if (blocklen > len - pos) blocklen = len - pos;
 
-        for (;;)
+        if (memcmp(&src[pos], &dst[pos], blocklen))
         {
-            u32 buf = 0;
-
-            fread(&buf, 4, 1, file);
-            if (buf != ((u32*)magic)[0])
+            if (offset == UndoLastEnd)
             {
-                if (buf == 0)
-                {
-                    printf("savestate: section %s not found. blarg\n", magic);
-                    return;
-                }
-
-                buf = 0;
-                fread(&buf, 4, 1, file);
-                fseek(file, buf-8, SEEK_CUR);
-                continue;
+                // contiguous with the previous change, grow that record
+                u32 reclen;
+                memcpy(&reclen, &(*UndoLog)[UndoLastRecord+4], 4);
+                reclen += blocklen;
+                memcpy(&(*UndoLog)[UndoLastRecord+4], &reclen, 4);
+            }
+            else
+            {
+                u32 header[2] = {offset, blocklen};
+                UndoLastRecord = UndoLog->size();
+                UndoLog->insert(UndoLog->end(), (u8*)&header[0], (u8*)&header[2]);
             }
 
-            fseek(file, 12, SEEK_CUR);
-            break;
+            UndoLog->insert(UndoLog->end(), &dst[pos], &dst[pos+blocklen]);
+            UndoLastEnd = offset + blocklen;
+
+            memcpy(&dst[pos], &src[pos], blocklen);
         }
+
+        pos += blocklen;
     }
 }
 
-void Savestate::Var8(u8* var)
+void Savestate::Read(void* data, u32 len)
 {
-    if (Error) return;
-
-    if (Saving)
-    {
-        fwrite(var, 1, 1, file);
-    }
-    else
+#ifndef __LIBRETRO__
+    if (file)
     {
-        fread(var, 1, 1, file);
+        fread(data, len, 1, file);
+        return;
     }
+#endif
+
+    // like fread, a read past the end only gets what's there
+    if (len > BufferLength - BufferOffset)
+        len = BufferLength - BufferOffset;
+
+    memcpy(data, &Buffer[BufferOffset], len);
+    BufferOffset += len;
 }
 
-void Savestate::Var16(u16* var)
+void Savestate::Seek(s32 offset, int origin)
 {
-    if (Error) return;
-
-    if (Saving)
+#ifndef __LIBRETRO__
+    if (file)
     {
-        fwrite(var, 2, 1, file);
+        fseek(file, offset, origin);
+        return;
     }
-    else
+#endif
+
+    s64 pos;
+    switch (origin)
     {
-        fread(var, 2, 1, file);
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = (s64)BufferOffset + offset; break;
+    // when saving, the end is wherever we've written up to
+    case SEEK_END: pos = (s64)(Saving ? BufferEnd : BufferLength) + offset; break;
+    default: return;
     }
+
+    if (pos < 0 || pos > BufferLength) return;
+    BufferOffset = (u32)pos;
 }
 
-void Savestate::Var32(u32* var)
+u32 Savestate::Tell()
 {
-    if (Error) return;
-
-    if (Saving)
-    {
-        fwrite(var, 4, 1, file);
-    }
-    else
-    {
-        fread(var, 4, 1, file);
-    }
+#ifndef __LIBRETRO__
+    if (file) return (u32)ftell(file);
+#endif
+    return BufferOffset;
 }
 
-void Savestate::Var64(u64* var)
+void Savestate::Section(const char* magic)
 {
     if (Error) return;
 
+    if (Measuring)
+    {
+        MeasuredLength += 0x10;
+        return;
+    }
+
     if (Saving)
     {
-        fwrite(var, 8, 1, file);
+        if (CurSection != 0xFFFFFFFF)
+        {
+            u32 pos = Tell();
+            Seek(CurSection+4, SEEK_SET);
+
+            u32 len = pos - CurSection;
+            Write(&len, 4);
+
+            Seek(pos, SEEK_SET);
+        }
+
+        CurSection = Tell();
+
+        Write(magic, 4);
+        Seek(12, SEEK_CUR);
     }
     else
     {
-        fread(var, 8, 1, file);
+        Seek(0x10, SEEK_SET);
+
+        for (;;)
+        {
+            u32 buf = 0;
+
+            Read(&buf, 4);
+            if (buf != ((u32*)magic)[0])
+            {
+                if (buf == 0)
+                {
+                    printf("savestate: section %s not found. blarg\n", magic);
+                    return;
+                }
+
+                buf = 0;
+                Read(&buf, 4);
+                Seek(buf-8, SEEK_CUR);
+                continue;
+            }
+
+            Seek(12, SEEK_CUR);
+            break;
+        }
     }
 }
 
@@ -305,22 +436,16 @@ void Savestate::Bool32(bool* var)
     }
     else
     {
-        u32 val;
+        u32 val = 0;
         Var32(&val);
         *var = val != 0;
     }
 }
 
-void Savestate::VarArray(void* data, u32 len)
+void Savestate::Transfer(void* data, u32 len)
 {
-    if (Error) return;
-
     if (Saving)
-    {
-        fwrite(data, len, 1, file);
-    }
+        Write(data, len);
     else
-    {
-        fread(data, len, 1, file);
-    }
+        Read(data, len);
 }
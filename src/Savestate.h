@@ -20,23 +20,25 @@
 #define SAVESTATE_H
 
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 #include "types.h"
 
 #define SAVESTATE_MAJOR 9
 #define SAVESTATE_MINOR 0
 
-#ifdef __LIBRETRO__
-#include <streams/memory_stream.h>
-#endif
-
 class Savestate
 {
 public:
-#ifdef __LIBRETRO__
-    Savestate(void *data, size_t size, bool save);
-#else
+#ifndef __LIBRETRO__
     Savestate(const char* filename, bool save);
 #endif
+    // in-memory state
+    // when saving, the buffer has to be large enough to hold the whole state
+    Savestate(void* data, u32 size, bool save);
+    // dry run: behaves like a save, but nothing is written anywhere
+    // only the size of the resulting state is tracked (see GetOffset())
+    Savestate();
     ~Savestate();
 
     bool Error;
@@ -49,14 +51,36 @@ public:
 
     void Section(const char* magic);
 
-    void Var8(u8* var);
-    void Var16(u16* var);
-    void Var32(u32* var);
-    void Var64(u64* var);
+    void Var8(u8* var) { VarArray(var, 1); }
+    void Var16(u16* var) { VarArray(var, 2); }
+    void Var32(u32* var) { VarArray(var, 4); }
+    void Var64(u64* var) { VarArray(var, 8); }
 
     void Bool32(bool* var);
 
-    void VarArray(void* data, u32 len);
+    void VarArray(void* data, u32 len)
+    {
+        if (Error) return;
+
+        // states have lots of tiny fields, so in-memory states are handled
+        // right here, everything else goes through Transfer()
+        if (Buffer && len <= BufferLength - BufferOffset)
+        {
+            u8* ptr = &Buffer[BufferOffset];
+            if (!Saving)
+                memcpy(data, ptr, len);
+            else if (!UndoLog)
+                memcpy(ptr, data, len);
+            else if (len >= 256 || memcmp(ptr, data, len))
+                WriteDiff(data, len);
+
+            BufferOffset += len;
+            if (BufferOffset > BufferEnd) BufferEnd = BufferOffset;
+            return;
+        }
+
+        Transfer(data, len);
+    }
 
     bool IsAtleastVersion(u32 major, u32 minor)
     {
@@ -65,19 +89,45 @@ public:
         return false;
     }
 
-#ifdef __LIBRETRO__
-    uint64_t GetOffset()
+    u64 GetOffset()
     {
-        return memstream_pos(file);
+        if (Measuring) return MeasuredLength;
+        return Tell();
     }
-#endif
+
+    // only for in-memory saves, into a buffer that still holds an older state
+    // of the same layout: only the bytes that changed get written, and their
+    // previous contents are appended to the log so the old state can be
+    // restored with ApplyUndoLog()
+    // log records: u32 offset, u32 length, <length> bytes
+    void SetUndoLog(std::vector<u8>* log);
+    static void ApplyUndoLog(u8* data, u32 size, const std::vector<u8>& log);
 
 private:
-#ifdef __LIBRETRO__
-    memstream_t* file;
-#else
+#ifndef __LIBRETRO__
     FILE* file;
 #endif
+
+    u8* Buffer;
+    u32 BufferLength;
+    u32 BufferOffset;
+    u32 BufferEnd;
+
+    bool Measuring;
+    u32 MeasuredLength;
+
+    std::vector<u8>* UndoLog;
+    u32 UndoLastRecord;
+    u32 UndoLastEnd;
+
+    void Begin(bool save);
+    void Transfer(void* data, u32 len);
+
+    void Write(const void* data, u32 len);
+    void WriteDiff(const void* data, u32 len);
+    void Read(void* data, u32 len);
+    void Seek(s32 offset, int origin);
+    u32 Tell();
 };
 
 #endif // SAVESTATE_H
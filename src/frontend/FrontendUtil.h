@@ -21,6 +21,8 @@
 
 #include "types.h"
 
+#include <stdio.h>
+#include <functional>
 #include <vector>
 
 namespace Frontend
@@ -103,11 +105,24 @@ bool SavestateExists(int slot);
 bool LoadState(const char* filename);
 
 // save the current emulator state to the given file
-bool SaveState(const char* filename);
+// the file is written in the background, see FinishSaveState()
+// returns false if saving failed right away, otherwise onDone is called
+// from the background thread once the file is written (or failed to be)
+bool SaveState(const char* filename, std::function<void(bool)> onDone = nullptr);
+
+// wait until the last saved state is completely written to disk
+void FinishSaveState();
 
 // undo the latest savestate load
 void UndoStateLoad();
 
+// read a savestate file into memory, decompressing it if needed
+bool ReadStateFile(const char* filename, std::vector<u8>& data);
+
+// compress the given savestate, write it to f (opened on tmpname), then
+// move it over filename. f is closed in any case
+bool WriteStateFile(FILE* f, const char* tmpname, const char* filename, std::vector<u8>& data);
+
 // imports savedata from an external file. Returns the difference between the filesize and the SRAM size
 int ImportSRAM(const char* filename);
 
@@ -23,7 +23,9 @@
 #include <strings.h>
 #endif
 
+#include <string>
 #include <utility>
+#include <vector>
 
 #ifdef ARCHIVE_SUPPORT_ENABLED
 #include "ArchiveUtil.h"
@@ -54,6 +56,14 @@ bool SavestateLoaded;
 ARCodeFile* CheatFile;
 bool CheatsOn;
 
+#ifndef __LIBRETRO__
+// state from before the last savestate load, for 'undo load'
+std::vector<u8> BackupState;
+
+// savestates are compressed and written to disk on this thread
+Platform::Thread* SaveStateThread = nullptr;
+#endif
+
 
 void Init_ROM()
 {
@@ -72,6 +82,8 @@ void Init_ROM()
 
 void DeInit_ROM()
 {
+    FinishSaveState();
+
     if (CheatFile)
     {
         delete CheatFile;
@@ -728,33 +740,68 @@ bool SavestateExists(int slot)
     return Platform::FileExists(ssfile);
 }
 
+#ifndef __LIBRETRO__
+bool SerializeState(std::vector<u8>& data)
+{
+    Savestate* dry = new Savestate();
+    NDS::DoSavestate(dry);
+    u32 len = (u32)dry->GetOffset();
+    delete dry;
+
+    data.resize(len);
+
+    Savestate* state = new Savestate(data.data(), len, true);
+    bool ok = NDS::DoSavestate(state) && !state->Error;
+    delete state;
+
+    return ok;
+}
+
+bool DeserializeState(std::vector<u8>& data)
+{
+    Savestate* state = new Savestate(data.data(), data.size(), false);
+    bool ok = !state->Error;
+    if (ok) ok = NDS::DoSavestate(state) && !state->Error;
+    delete state;
+
+    return ok;
+}
+#endif
+
+void FinishSaveState()
+{
+#ifndef __LIBRETRO__
+    if (!SaveStateThread) return;
+
+    Platform::Thread_Wait(SaveStateThread);
+    Platform::Thread_Free(SaveStateThread);
+    SaveStateThread = nullptr;
+#endif
+}
+
 bool LoadState(const char* filename)
 {
 #ifndef __LIBRETRO__
     u32 oldGBACartCRC = GBACart::CartCRC;
 
+    // the file might still be on its way to the disk
+    FinishSaveState();
+
     // backup
-    Savestate* backup = new Savestate("timewarp.mln", true);
-    NDS::DoSavestate(backup);
-    delete backup;
+    SerializeState(BackupState);
 
     bool failed = false;
 
-    Savestate* state = new Savestate(filename, false);
-    if (state->Error)
+    std::vector<u8> data;
+    if (!ReadStateFile(filename, data) || !DeserializeState(data))
     {
-        delete state;
-
         //uiMsgBoxError(MainWindow, "Error", "Could not load savestate file.");
 
         // current state might be crapoed, so restore from sane backup
-        state = new Savestate("timewarp.mln", false);
+        DeserializeState(BackupState);
         failed = true;
     }
 
-    NDS::DoSavestate(state);
-    delete state;
-
     if (!failed)
     {
         if (Config::SavestateRelocSRAM && ROMPath[ROMSlot_NDS][0]!='\0')
@@ -798,19 +845,32 @@ bool LoadState(const char* filename)
     return false;
 }
 
-bool SaveState(const char* filename)
+bool SaveState(const char* filename, std::function<void(bool)> onDone)
 {
 #ifndef __LIBRETRO__
-    Savestate* state = new Savestate(filename, true);
-    if (state->Error)
+    // only the state itself is captured here, compressing it and writing it
+    // out is left to a background thread so emulation doesn't stall
+    std::vector<u8> data;
+    if (!SerializeState(data))
+        return false;
+
+    FinishSaveState();
+
+    std::string tmpname = std::string(filename) + ".tmp";
+    FILE* f = Platform::OpenFile(tmpname.c_str(), "wb");
+    if (!f)
     {
-        delete state;
+        printf("savestate: file %s can't be created\n", tmpname.c_str());
         return false;
     }
     else
     {
-        NDS::DoSavestate(state);
-        delete state;
+        std::string path = filename;
+        SaveStateThread = Platform::Thread_Create([f, tmpname, path, data = std::move(data), onDone]() mutable
+        {
+            bool ok = WriteStateFile(f, tmpname.c_str(), path.c_str(), data);
+            if (onDone) onDone(ok);
+        });
 
         if (Config::SavestateRelocSRAM && ROMPath[ROMSlot_NDS][0]!='\0')
         {
@@ -834,9 +894,7 @@ void UndoStateLoad()
     // pray that this works
     // what do we do if it doesn't???
     // but it should work.
-    Savestate* backup = new Savestate("timewarp.mln", false);
-    NDS::DoSavestate(backup);
-    delete backup;
+    DeserializeState(BackupState);
 
     if (ROMPath[ROMSlot_NDS][0]!='\0')
     {
@@ -0,0 +1,122 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef LZ4_SUPPORT_ENABLED
+#include <lz4.h>
+#endif
+
+#include "FrontendUtil.h"
+#include "Platform.h"
+
+
+namespace Frontend
+{
+
+/*
+    Savestate files are stored compressed:
+
+    00 - magic MELZ
+    04 - uncompressed length
+    08 - compressed length
+    0C - reserved
+    10 - LZ4 block, holding the savestate itself
+
+    Uncompressed savestates (starting with MELN) still load fine. Builds
+    without LZ4 write those, and can't load compressed ones.
+*/
+
+bool ReadStateFile(const char* filename, std::vector<u8>& data)
+{
+    FILE* f = Platform::OpenFile(filename, "rb", true);
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    u32 filelen = (u32)ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    std::vector<u8> filedata(filelen);
+    bool ok = filelen > 0x10 && fread(filedata.data(), filelen, 1, f) == 1;
+    fclose(f);
+    if (!ok) return false;
+
+    if (memcmp(&filedata[0], "MELZ", 4))
+    {
+        data = std::move(filedata);
+        return true;
+    }
+
+#ifdef LZ4_SUPPORT_ENABLED
+    u32 len = *(u32*)&filedata[0x4];
+    u32 complen = *(u32*)&filedata[0x8];
+    if (complen > filelen - 0x10 || len > LZ4_MAX_INPUT_SIZE)
+    {
+        printf("savestate: bad compressed state %s\n", filename);
+        return false;
+    }
+
+    data.resize(len);
+    int ret = LZ4_decompress_safe((const char*)&filedata[0x10], (char*)data.data(), complen, len);
+    if (ret != (int)len)
+    {
+        printf("savestate: failed to decompress %s\n", filename);
+        return false;
+    }
+
+    return true;
+#else
+    printf("savestate: %s is compressed, but this build has no LZ4 support\n", filename);
+    return false;
+#endif
+}
+
+bool WriteStateFile(FILE* f, const char* tmpname, const char* filename, std::vector<u8>& data)
+{
+#ifdef LZ4_SUPPORT_ENABLED
+    u32 len = data.size();
+    std::vector<u8> filedata(0x10 + LZ4_compressBound(len));
+
+    int complen = LZ4_compress_default((const char*)data.data(), (char*)&filedata[0x10], len, filedata.size() - 0x10);
+
+    memcpy(&filedata[0], "MELZ", 4);
+    *(u32*)&filedata[0x4] = len;
+    *(u32*)&filedata[0x8] = complen;
+    *(u32*)&filedata[0xC] = 0;
+
+    bool ok = complen > 0;
+    if (ok) ok = fwrite(filedata.data(), 0x10 + complen, 1, f) == 1;
+#else
+    bool ok = fwrite(data.data(), data.size(), 1, f) == 1;
+#endif
+    if (fclose(f) != 0) ok = false;
+
+    // the old file is only replaced once the new one is completely written
+    if (ok) ok = Platform::RenameFile(tmpname, filename);
+
+    if (!ok)
+    {
+        printf("savestate: failed to write %s\n", filename);
+        remove(tmpname);
+    }
+
+    return ok;
+}
+
+}
@@ -0,0 +1,209 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// headless platform implementation for the benchmark runner
+// everything is local to the current directory, and there is no networking
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Platform.h"
+
+
+namespace Platform
+{
+
+void Init(int argc, char** argv)
+{
+}
+
+void DeInit()
+{
+}
+
+void StopEmu()
+{
+}
+
+
+FILE* OpenFile(const char* path, const char* mode, bool mustexist)
+{
+    if (mustexist)
+    {
+        FILE* f = fopen(path, "rb");
+        if (!f) return nullptr;
+        fclose(f);
+    }
+
+    return fopen(path, mode);
+}
+
+FILE* OpenLocalFile(const char* path, const char* mode)
+{
+    return OpenFile(path, mode, mode[0] != 'w');
+}
+
+bool RenameFile(const char* oldpath, const char* newpath)
+{
+    return rename(oldpath, newpath) == 0;
+}
+
+bool RenameLocalFile(const char* oldpath, const char* newpath)
+{
+    return RenameFile(oldpath, newpath);
+}
+
+
+Thread* Thread_Create(std::function<void()> func)
+{
+    return (Thread*) new std::thread(func);
+}
+
+void Thread_Free(Thread* thread)
+{
+    std::thread* t = (std::thread*) thread;
+    if (t->joinable()) t->detach();
+    delete t;
+}
+
+void Thread_Wait(Thread* thread)
+{
+    std::thread* t = (std::thread*) thread;
+    if (t->joinable()) t->join();
+}
+
+struct BenchSemaphore
+{
+    std::mutex Lock;
+    std::condition_variable Cond;
+    int Count = 0;
+};
+
+Semaphore* Semaphore_Create()
+{
+    return (Semaphore*) new BenchSemaphore();
+}
+
+void Semaphore_Free(Semaphore* sema)
+{
+    delete (BenchSemaphore*) sema;
+}
+
+void Semaphore_Reset(Semaphore* sema)
+{
+    BenchSemaphore* s = (BenchSemaphore*) sema;
+
+    std::lock_guard<std::mutex> lock(s->Lock);
+    s->Count = 0;
+}
+
+void Semaphore_Wait(Semaphore* sema)
+{
+    BenchSemaphore* s = (BenchSemaphore*) sema;
+
+    std::unique_lock<std::mutex> lock(s->Lock);
+    s->Cond.wait(lock, [s] { return s->Count > 0; });
+    s->Count--;
+}
+
+void Semaphore_Post(Semaphore* sema, int count)
+{
+    BenchSemaphore* s = (BenchSemaphore*) sema;
+
+    {
+        std::lock_guard<std::mutex> lock(s->Lock);
+        s->Count += count;
+    }
+    s->Cond.notify_all();
+}
+
+Mutex* Mutex_Create()
+{
+    return (Mutex*) new std::mutex();
+}
+
+void Mutex_Free(Mutex* mutex)
+{
+    delete (std::mutex*) mutex;
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+    ((std::mutex*) mutex)->lock();
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+    ((std::mutex*) mutex)->unlock();
+}
+
+bool Mutex_TryLock(Mutex* mutex)
+{
+    return ((std::mutex*) mutex)->try_lock();
+}
+
+
+bool MP_Init()
+{
+    return false;
+}
+
+void MP_DeInit()
+{
+}
+
+int MP_SendPacket(u8* data, int len)
+{
+    return 0;
+}
+
+int MP_RecvPacket(u8* data, bool block)
+{
+    return 0;
+}
+
+bool LAN_Init()
+{
+    return false;
+}
+
+void LAN_DeInit()
+{
+}
+
+int LAN_SendPacket(u8* data, int len)
+{
+    return 0;
+}
+
+int LAN_RecvPacket(u8* data)
+{
+    return 0;
+}
+
+void Sleep(u64 usecs)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+}
+
+}
@@ -0,0 +1,599 @@
+/*
+    Copyright 2016-2021 Arisotura
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// melonDS-bench
+// runs a ROM headless for a fixed number of frames and reports throughput,
+// along with a per-subsystem breakdown of where the time went.
+//
+// input movie format: plain text, one line per frame
+//   <keymask> [<touchX> <touchY>]
+// keymask is hex, in the same format as NDS::SetKeyMask() (bit set = released)
+// if the touch coordinates are given the screen is held at that position
+// for that frame, otherwise it is released.
+// once the movie runs out, the last line keeps being applied.
+//
+// --sched-bench doesn't need a ROM: it only drives the event scheduler
+// the way RunFrame() does, with the periodic events a running game keeps
+// scheduled (wifi's microsecond timer, the SPU and the LCD), for as many
+// emulated cycles as the frame count amounts to. the same events also go
+// through a copy of the previous scheduler, which scanned every slot on
+// each iteration, so both rates come out of the same run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "Config.h"
+#include "NDS.h"
+#include "GPU.h"
+#include "Platform.h"
+#include "Profiler.h"
+#include "Rewind.h"
+#include "Savestate.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+#include "frontend/FrontendUtil.h"
+#ifdef JIT_ENABLED
+#include "ARMJIT.h"
+#endif
+
+
+namespace Config
+{
+
+ConfigEntry PlatformConfigFile[] =
+{
+    {"", -1, NULL, 0, NULL, 0}
+};
+
+}
+
+
+struct MovieFrame
+{
+    u32 KeyMask;
+    bool Touching;
+    u16 TouchX, TouchY;
+};
+
+bool LoadMovie(const char* path, std::vector<MovieFrame>& movie)
+{
+    FILE* f = Platform::OpenFile(path, "r", true);
+    if (!f) return false;
+
+    char linebuf[256];
+    while (fgets(linebuf, sizeof(linebuf), f))
+    {
+        MovieFrame frame;
+        unsigned int mask, x, y;
+
+        int ret = sscanf(linebuf, "%x %u %u", &mask, &x, &y);
+        if (ret < 1) continue;
+
+        frame.KeyMask = mask & 0xFFF;
+        frame.Touching = (ret == 3);
+        frame.TouchX = frame.Touching ? (u16)x : 0;
+        frame.TouchY = frame.Touching ? (u16)y : 0;
+        movie.push_back(frame);
+    }
+
+    fclose(f);
+    return true;
+}
+
+const u32 SchedBenchEvents[3] = {NDS::Event_LCD, NDS::Event_SPU, NDS::Event_Wifi};
+const s32 SchedBenchPeriods[3] = {2130, 1024, 33};
+u64 SchedBenchCount;
+
+void SchedBenchEvent(u32 param)
+{
+    SchedBenchCount++;
+    NDS::ScheduleEvent(SchedBenchEvents[param], true, SchedBenchPeriods[param], SchedBenchEvent, param);
+}
+
+// the scheduler as it was before NDS kept the next deadline cached
+namespace ScanSched
+{
+
+NDS::SchedEvent List[NDS::Event_MAX];
+u32 Mask;
+u64 SysTimestamp;
+// stands in for the CPU target Reschedule() lowers
+u64 Target;
+
+// noinline: the functions it's compared against live in another file
+__attribute__((noinline)) void ScheduleEvent(u32 id, s32 delay, void (*func)(u32), u32 param)
+{
+    if (Mask & (1<<id))
+    {
+        printf("!! EVENT %d ALREADY SCHEDULED\n", id);
+        return;
+    }
+
+    List[id].Timestamp += delay;
+    List[id].Func = func;
+    List[id].Param = param;
+    Mask |= (1<<id);
+
+    if (List[id].Timestamp < Target)
+        Target = List[id].Timestamp;
+}
+
+__attribute__((noinline)) u64 NextTarget()
+{
+    u64 ret = SysTimestamp + 64;
+
+    u32 mask = Mask;
+    for (int i = 0; i < NDS::Event_MAX; i++)
+    {
+        if (!mask) break;
+        if (mask & 0x1)
+        {
+            if (List[i].Timestamp < ret)
+                ret = List[i].Timestamp;
+        }
+
+        mask >>= 1;
+    }
+
+    return ret;
+}
+
+__attribute__((noinline)) void RunSystem(u64 timestamp)
+{
+    SysTimestamp = timestamp;
+
+    u32 mask = Mask;
+    for (int i = 0; i < NDS::Event_MAX; i++)
+    {
+        if (!mask) break;
+        if (mask & 0x1)
+        {
+            if (List[i].Timestamp <= SysTimestamp)
+            {
+                Mask &= ~(1<<i);
+                List[i].Func(List[i].Param);
+            }
+        }
+
+        mask >>= 1;
+    }
+}
+
+void Event(u32 param)
+{
+    SchedBenchCount++;
+    ScheduleEvent(SchedBenchEvents[param], SchedBenchPeriods[param], Event, param);
+}
+
+}
+
+struct SchedBenchResult
+{
+    u64 Events, Iterations;
+    u64 Time;
+};
+
+SchedBenchResult SchedBenchRun(u32 numevents, u64 cycles, bool scan)
+{
+    NDS::Reset();
+    for (u32 i = 0; i < NDS::Event_MAX; i++)
+        NDS::CancelEvent(i);
+    memset(ScanSched::List, 0, sizeof(ScanSched::List));
+    ScanSched::Mask = 0;
+    ScanSched::SysTimestamp = 0;
+
+    for (u32 i = 0; i < numevents; i++)
+    {
+        if (scan)
+            ScanSched::ScheduleEvent(SchedBenchEvents[i], SchedBenchPeriods[i], ScanSched::Event, i);
+        else
+            NDS::ScheduleEvent(SchedBenchEvents[i], false, SchedBenchPeriods[i], SchedBenchEvent, i);
+    }
+
+    u64 iterations = 0;
+    SchedBenchCount = 0;
+    u64 start = Profiler::Now();
+    if (scan)
+    {
+        u64 target = ScanSched::NextTarget();
+        for (u64 end = target + cycles; target < end; iterations++)
+        {
+            ScanSched::RunSystem(target);
+            target = ScanSched::NextTarget();
+        }
+    }
+    else
+    {
+        u64 target = NDS::NextTarget();
+        for (u64 end = target + cycles; target < end; iterations++)
+        {
+            NDS::RunSystem(target);
+            target = NDS::NextTarget();
+        }
+    }
+
+    return {SchedBenchCount, iterations, Profiler::Now() - start};
+}
+
+void SchedBench(int numframes)
+{
+    // 263 lines of 2130 cycles
+    u64 cycles = (u64)numframes * 263 * 2130;
+
+    // with wifi off most iterations end on the 64 cycle limit with nothing
+    // due, wifi's timer on the other hand fires on nearly every one of them
+    SchedBenchResult res[2][2];
+    for (int wifi = 0; wifi < 2; wifi++)
+    {
+        res[wifi][0] = SchedBenchRun(2 + wifi, cycles, false);
+        res[wifi][1] = SchedBenchRun(2 + wifi, cycles, true);
+    }
+
+    printf("\nscheduler, %llu emulated cycles\n", (unsigned long long)cycles);
+    for (int wifi = 0; wifi < 2; wifi++)
+    {
+        printf("%s:\n", wifi ? "LCD, SPU and wifi" : "LCD and SPU");
+        for (int scan = 0; scan < 2; scan++)
+        {
+            SchedBenchResult& r = res[wifi][scan];
+            printf("  %-16s %llu events, %llu iterations in %.1f ms: %.1f M events/s, %.1f M iterations/s\n",
+                   scan ? "full scan:" : "cached deadline:",
+                   (unsigned long long)r.Events, (unsigned long long)r.Iterations, r.Time / 1000000.0,
+                   r.Events * 1000.0 / r.Time, r.Iterations * 1000.0 / r.Time);
+        }
+    }
+}
+
+void PrintUsage(const char* argv0)
+{
+    printf("usage: %s [options] <rom.nds>\n", argv0);
+    printf("\n");
+    printf("  -n, --frames <count>    frames to measure (default 3600)\n");
+    printf("  -w, --warmup <count>    frames to run before measuring (default 0)\n");
+    printf("  -s, --state <file>      savestate to load after boot\n");
+    printf("  -m, --movie <file>      input movie to play back\n");
+    printf("  -t, --threaded-3d       rasterize 3D on a separate thread\n");
+    printf("      --3d-bands <n>      split 3D frames into n bands rasterized in parallel\n");
+    printf("      --threaded-2d       draw 2D engine B on a separate thread\n");
+    printf("      --deferred-2d       draw the 2D engines on a worker thread, behind emulation\n");
+    printf("      --check-3d-factors  run the frames again with the scalar perspective divide\n");
+    printf("                          and check that every frame comes out the same\n");
+    printf("  -r, --rewind <MB>       record rewind history every frame, with the given budget\n");
+    printf("      --uncached          don't cache decoded code in the interpreter\n");
+#ifdef JIT_ENABLED
+    printf("  -j, --jit               enable the JIT recompiler\n");
+    printf("      --jit-cache         keep the JIT's compiled code on disk between runs\n");
+    printf("      --jit-perf-map      write /tmp/perf-<pid>.map so perf can name JIT code\n");
+    printf("      --jit-profile <n>   count cycles per JIT block and list the n hottest ones\n");
+    printf("      --jit-background    compile JIT blocks on a separate thread\n");
+#endif
+    printf("      --firmware-boot     boot through the firmware instead of directly\n");
+    printf("      --sched-bench       measure event scheduler throughput instead, no ROM needed\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* rompath = nullptr;
+    const char* statepath = nullptr;
+    const char* moviepath = nullptr;
+    int numframes = 3600;
+    int warmupframes = 0;
+    bool threaded3d = false;
+    int bands3d = 1;
+    bool threaded2d = false;
+    bool deferred2d = false;
+    bool checkfactors = false;
+    int rewindbudget = 0;
+    bool jit = false;
+    bool jitcache = false;
+    bool jitperfmap = false;
+    int jitprofile = 0;
+    bool jitbackground = false;
+    bool directboot = true;
+    bool uncached = false;
+    bool schedbench = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasval = (i+1) < argc;
+
+        if ((!strcmp(arg, "-n") || !strcmp(arg, "--frames")) && hasval)
+            numframes = atoi(argv[++i]);
+        else if ((!strcmp(arg, "-w") || !strcmp(arg, "--warmup")) && hasval)
+            warmupframes = atoi(argv[++i]);
+        else if ((!strcmp(arg, "-s") || !strcmp(arg, "--state")) && hasval)
+            statepath = argv[++i];
+        else if ((!strcmp(arg, "-m") || !strcmp(arg, "--movie")) && hasval)
+            moviepath = argv[++i];
+        else if ((!strcmp(arg, "-r") || !strcmp(arg, "--rewind")) && hasval)
+            rewindbudget = atoi(argv[++i]);
+        else if (!strcmp(arg, "-t") || !strcmp(arg, "--threaded-3d"))
+            threaded3d = true;
+        else if (!strcmp(arg, "--3d-bands") && hasval)
+            bands3d = atoi(argv[++i]);
+        else if (!strcmp(arg, "--threaded-2d"))
+            threaded2d = true;
+        else if (!strcmp(arg, "--deferred-2d"))
+            deferred2d = true;
+        else if (!strcmp(arg, "--check-3d-factors"))
+            checkfactors = true;
+        else if (!strcmp(arg, "-j") || !strcmp(arg, "--jit"))
+            jit = true;
+        else if (!strcmp(arg, "--jit-cache"))
+            jitcache = true;
+        else if (!strcmp(arg, "--jit-perf-map"))
+            jitperfmap = true;
+        else if (!strcmp(arg, "--jit-profile") && hasval)
+            jitprofile = atoi(argv[++i]);
+        else if (!strcmp(arg, "--jit-background"))
+            jitbackground = true;
+        else if (!strcmp(arg, "--firmware-boot"))
+            directboot = false;
+        else if (!strcmp(arg, "--uncached"))
+            uncached = true;
+        else if (!strcmp(arg, "--sched-bench"))
+            schedbench = true;
+        else if (arg[0] != '-' && !rompath)
+            rompath = arg;
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((!rompath && !schedbench) || numframes <= 0 || warmupframes < 0 || rewindbudget < 0 || rewindbudget > 4095 || jitprofile < 0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+#ifndef JIT_ENABLED
+    if (jit || jitcache || jitperfmap || jitprofile || jitbackground)
+    {
+        printf("this build has no JIT support\n");
+        return 1;
+    }
+#endif
+
+    std::vector<MovieFrame> movie;
+    if (moviepath && !LoadMovie(moviepath, movie))
+    {
+        printf("failed to open input movie %s\n", moviepath);
+        return 1;
+    }
+
+    Platform::Init(argc, argv);
+    Config::Load();
+    Config::CachedInterpreter = !uncached;
+#ifdef JIT_ENABLED
+    Config::JIT_Enable = jit;
+    Config::JIT_DiskCache = jitcache;
+    Config::JIT_PerfMap = jitperfmap;
+    Config::JIT_ProfileBlocks = jitprofile > 0;
+    Config::JIT_BackgroundCompile = jitbackground;
+#endif
+
+    if (!NDS::Init())
+    {
+        printf("failed to initialize the emulator core\n");
+        return 1;
+    }
+
+    GPU::RenderSettings videoSettings;
+    videoSettings.Soft_Threaded = threaded3d;
+    videoSettings.Soft_Threads = bands3d;
+    videoSettings.Soft_ScalarFactors = false;
+    videoSettings.Threaded2D = threaded2d;
+    videoSettings.Deferred2D = deferred2d;
+    videoSettings.GL_ScaleFactor = 1;
+    videoSettings.GL_BetterPolygons = false;
+
+    GPU::InitRenderer(0);
+    GPU::SetRenderSettings(0, videoSettings);
+
+    if (schedbench)
+    {
+        SchedBench(numframes);
+        NDS::DeInit();
+        Platform::DeInit();
+        return 0;
+    }
+
+    NDS::SetConsoleType(0);
+    // no SRAM path, the benchmark shouldn't touch the game's save file
+    if (!NDS::LoadROM(rompath, "", directboot))
+    {
+        NDS::DeInit();
+        return 1;
+    }
+
+    if (statepath)
+    {
+        // same path as the frontend, so compressed states load too
+        std::vector<u8> data;
+        bool ok = Frontend::ReadStateFile(statepath, data);
+        if (ok)
+        {
+            Savestate* state = new Savestate(data.data(), data.size(), false);
+            ok = !state->Error && NDS::DoSavestate(state) && !state->Error;
+            delete state;
+        }
+
+        if (!ok)
+        {
+            printf("failed to load savestate %s\n", statepath);
+            NDS::DeInit();
+            return 1;
+        }
+    }
+
+    if (rewindbudget)
+        Rewind::SetBudget((u32)rewindbudget * 1024 * 1024);
+
+    u32 frame = 0;
+    auto applyInput = [&]()
+    {
+        if (movie.empty())
+        {
+            NDS::SetKeyMask(0xFFF);
+            return;
+        }
+
+        const MovieFrame& f = movie[frame < movie.size() ? frame : movie.size()-1];
+        NDS::SetKeyMask(f.KeyMask);
+        if (f.Touching)
+            NDS::TouchScreen(f.TouchX, f.TouchY);
+        else
+            NDS::ReleaseScreen();
+    };
+
+    for (int i = 0; i < warmupframes; i++, frame++)
+    {
+        applyInput();
+        NDS::RunFrame();
+    }
+
+    // for --check-3d-factors: the second run starts from the same point
+    // and has to produce the same frames
+    std::vector<u8> startstate;
+    std::vector<u64> framehashes;
+    u32 startframe = frame;
+    if (checkfactors)
+    {
+        Savestate* dry = new Savestate();
+        NDS::DoSavestate(dry);
+        startstate.resize(dry->GetOffset());
+        delete dry;
+
+        Savestate* state = new Savestate(startstate.data(), startstate.size(), true);
+        NDS::DoSavestate(state);
+        delete state;
+    }
+    auto hashFrame = [&]()
+    {
+        if (GPU::Deferred2DPending) GPU::Sync2D();
+
+        u64 hash = XXH3_64bits(GPU::Framebuffer[GPU::FrontBuffer][0], 256*192*4);
+        return XXH3_64bits_withSeed(GPU::Framebuffer[GPU::FrontBuffer][1], 256*192*4, hash);
+    };
+
+    Profiler::Reset();
+    Profiler::Enabled = true;
+#ifdef JIT_ENABLED
+    ARMJIT::ResetBlockProfile();
+#endif
+
+    u64 start = Profiler::Now();
+    for (int i = 0; i < numframes; i++, frame++)
+    {
+        applyInput();
+        NDS::RunFrame();
+        if (rewindbudget) Rewind::Capture();
+        if (checkfactors) framehashes.push_back(hashFrame());
+    }
+    // the last deferred scanlines are still being drawn
+    if (GPU::Deferred2DPending) GPU::Sync2D();
+    u64 total = Profiler::Now() - start;
+
+    Profiler::Enabled = false;
+
+    double totalms = total / 1000000.0;
+    printf("\n");
+    printf("%d frames in %.1f ms: %.2f FPS (%.1f%% of full speed)\n",
+        numframes, totalms,
+        numframes * 1000.0 / totalms,
+        numframes * 1000.0 / totalms / 59.8261 * 100.0);
+    printf("\n");
+    printf("%-16s %12s %12s %8s\n", "section", "total ms", "ms/frame", "share");
+
+    for (int i = 0; i < Profiler::Prof_MAX; i++)
+    {
+        double ms = Profiler::Time[i] / 1000000.0;
+        printf("%-16s %12.1f %12.3f %7.1f%%\n",
+            Profiler::SectionNames[i], ms, ms / numframes, ms * 100.0 / totalms);
+    }
+
+    if (rewindbudget)
+        printf("\nrewind history: %u frames, %.1f MB\n",
+            Rewind::NumFrames(), Rewind::MemoryUsage() / (1024.0 * 1024.0));
+
+#ifdef JIT_ENABLED
+    if (jit)
+        printf("\nJIT code buffer: %u evictions, %u blocks evicted, %u of them recompiled\n",
+            ARMJIT::NumCodeEvictions, ARMJIT::NumEvictedBlocks, ARMJIT::NumRecompiledBlocks);
+
+    if (jit && jitprofile)
+    {
+        printf("\n");
+        ARMJIT::DumpBlockProfile(jitprofile);
+    }
+#endif
+
+    if (threaded3d)
+        printf("\n(3D rasterizer time is spent on its own thread and overlaps the other sections)\n");
+    if (deferred2d)
+        printf("\n(2D scanline time includes the deferred drawing thread, it overlaps the other sections)\n");
+
+    int ret = 0;
+    if (checkfactors)
+    {
+        double rastms = Profiler::Time[Profiler::Prof_Rasterizer] / 1000000.0;
+
+        videoSettings.Soft_ScalarFactors = true;
+        GPU::SetRenderSettings(0, videoSettings);
+
+        Savestate* state = new Savestate(startstate.data(), startstate.size(), false);
+        NDS::DoSavestate(state);
+        delete state;
+        frame = startframe;
+
+        Profiler::Reset();
+        Profiler::Enabled = true;
+
+        int mismatch = -1;
+        for (int i = 0; i < numframes; i++, frame++)
+        {
+            applyInput();
+            NDS::RunFrame();
+            if (mismatch < 0 && hashFrame() != framehashes[i])
+                mismatch = i;
+        }
+
+        Profiler::Enabled = false;
+        double scalarms = Profiler::Time[Profiler::Prof_Rasterizer] / 1000000.0;
+
+        printf("\nperspective divide: rasterizer %.1f ms vectorized, %.1f ms scalar\n", rastms, scalarms);
+        if (mismatch < 0)
+            printf("all %d frames match\n", numframes);
+        else
+        {
+            printf("frame %d differs between the vectorized and the scalar path\n", mismatch);
+            ret = 1;
+        }
+    }
+
+    NDS::DeInit();
+    Platform::DeInit();
+
+    return ret;
+}
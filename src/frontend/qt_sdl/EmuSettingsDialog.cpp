@@ -71,12 +71,14 @@ EmuSettingsDialog::EmuSettingsDialog(QWidget* parent) : QDialog(parent), ui(new
         ui->chkJITFastMemory->setDisabled(true);
     #endif
     ui->spnJITMaximumBlockSize->setValue(Config::JIT_MaxBlockSize);
+    ui->chkJITDiskCache->setChecked(Config::JIT_DiskCache != 0);
 #else
     ui->chkEnableJIT->setDisabled(true);
     ui->chkJITBranchOptimisations->setDisabled(true);
     ui->chkJITLiteralOptimisations->setDisabled(true);
     ui->chkJITFastMemory->setDisabled(true);
     ui->spnJITMaximumBlockSize->setDisabled(true);
+    ui->chkJITDiskCache->setDisabled(true);
 #endif
 
     on_chkEnableJIT_toggled();
@@ -146,6 +148,7 @@ void EmuSettingsDialog::done(int r)
         int jitBranchOptimisations = ui->chkJITBranchOptimisations->isChecked() ? 1:0;
         int jitLiteralOptimisations = ui->chkJITLiteralOptimisations->isChecked() ? 1:0;
         int jitFastMemory = ui->chkJITFastMemory->isChecked() ? 1:0;
+        int jitDiskCache = ui->chkJITDiskCache->isChecked() ? 1:0;
 
         std::string bios9Path = ui->txtBIOS9Path->text().toStdString();
         std::string bios7Path = ui->txtBIOS7Path->text().toStdString();
@@ -167,6 +170,7 @@ void EmuSettingsDialog::done(int r)
             || jitBranchOptimisations != Config::JIT_BranchOptimisations
             || jitLiteralOptimisations != Config::JIT_LiteralOptimisations
             || jitFastMemory != Config::JIT_FastMemory
+            || jitDiskCache != Config::JIT_DiskCache
 #endif
             || strcmp(Config::BIOS9Path, bios9Path.c_str()) != 0
             || strcmp(Config::BIOS7Path, bios7Path.c_str()) != 0
@@ -205,6 +209,7 @@ void EmuSettingsDialog::done(int r)
             Config::JIT_BranchOptimisations = jitBranchOptimisations;
             Config::JIT_LiteralOptimisations = jitLiteralOptimisations;
             Config::JIT_FastMemory = jitFastMemory;
+            Config::JIT_DiskCache = jitDiskCache;
     #endif
 
             Config::ConsoleType = consoleType;
@@ -338,4 +343,5 @@ void EmuSettingsDialog::on_chkEnableJIT_toggled()
         ui->chkJITFastMemory->setDisabled(disabled);
     #endif
     ui->spnJITMaximumBlockSize->setDisabled(disabled);
+    ui->chkJITDiskCache->setDisabled(disabled);
 }
@@ -161,7 +161,7 @@ FILE* OpenFile(const char* path, const char* mode, bool mustexist)
     return file;
 }
 
-FILE* OpenLocalFile(const char* path, const char* mode)
+QString GetLocalFilePath(const char* path)
 {
 	QDir dir(path);
     QString fullpath;
@@ -184,7 +184,28 @@ FILE* OpenLocalFile(const char* path, const char* mode)
 #endif
     }
 
-    return OpenFile(fullpath.toUtf8(), mode, mode[0] != 'w');
+    return fullpath;
+}
+
+FILE* OpenLocalFile(const char* path, const char* mode)
+{
+    return OpenFile(GetLocalFilePath(path).toUtf8(), mode, mode[0] != 'w');
+}
+
+bool RenameFile(const char* oldpath, const char* newpath)
+{
+#ifdef __WIN32__
+    std::wstring oldw = QString::fromUtf8(oldpath).toStdWString();
+    std::wstring neww = QString::fromUtf8(newpath).toStdWString();
+    return MoveFileExW(oldw.c_str(), neww.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(oldpath, newpath) == 0;
+#endif
+}
+
+bool RenameLocalFile(const char* oldpath, const char* newpath)
+{
+    return RenameFile(GetLocalFilePath(oldpath).toUtf8(), GetLocalFilePath(newpath).toUtf8());
 }
 
 Thread* Thread_Create(std::function<void()> func)
@@ -52,6 +52,9 @@ int ScreenVSyncInterval;
 
 int _3DRenderer;
 int Threaded3D;
+int Threads3D;
+int Threaded2D;
+int Deferred2D;
 
 int GL_ScaleFactor;
 int GL_BetterPolygons;
@@ -69,6 +72,9 @@ int DirectLAN;
 
 int SavestateRelocSRAM;
 
+int RewindEnable;
+int RewindBudget;
+
 int AudioInterp;
 int AudioVolume;
 int MicInputType;
@@ -126,6 +132,7 @@ ConfigEntry PlatformConfigFile[] =
     {"HKKey_SolarSensorDecrease", 0, &HKKeyMapping[HK_SolarSensorDecrease], -1, NULL, 0},
     {"HKKey_SolarSensorIncrease", 0, &HKKeyMapping[HK_SolarSensorIncrease], -1, NULL, 0},
     {"HKKey_FrameStep",           0, &HKKeyMapping[HK_FrameStep],           -1, NULL, 0},
+    {"HKKey_Rewind",              0, &HKKeyMapping[HK_Rewind],              -1, NULL, 0},
 
     {"HKJoy_Lid",                 0, &HKJoyMapping[HK_Lid],                 -1, NULL, 0},
     {"HKJoy_Mic",                 0, &HKJoyMapping[HK_Mic],                 -1, NULL, 0},
@@ -138,6 +145,7 @@ ConfigEntry PlatformConfigFile[] =
     {"HKJoy_SolarSensorDecrease", 0, &HKJoyMapping[HK_SolarSensorDecrease], -1, NULL, 0},
     {"HKJoy_SolarSensorIncrease", 0, &HKJoyMapping[HK_SolarSensorIncrease], -1, NULL, 0},
     {"HKJoy_FrameStep",           0, &HKJoyMapping[HK_FrameStep],           -1, NULL, 0},
+    {"HKJoy_Rewind",              0, &HKJoyMapping[HK_Rewind],              -1, NULL, 0},
 
     {"JoystickID", 0, &JoystickID, 0, NULL, 0},
 
@@ -161,6 +169,9 @@ ConfigEntry PlatformConfigFile[] =
 
     {"3DRenderer", 0, &_3DRenderer, 0, NULL, 0},
     {"Threaded3D", 0, &Threaded3D, 1, NULL, 0},
+    {"Threads3D", 0, &Threads3D, 1, NULL, 0},
+    {"Threaded2D", 0, &Threaded2D, 0, NULL, 0},
+    {"Deferred2D", 0, &Deferred2D, 0, NULL, 0},
 
     {"GL_ScaleFactor", 0, &GL_ScaleFactor, 1, NULL, 0},
     {"GL_BetterPolygons", 0, &GL_BetterPolygons, 0, NULL, 0},
@@ -178,6 +189,9 @@ ConfigEntry PlatformConfigFile[] =
 
     {"SavStaRelocSRAM", 0, &SavestateRelocSRAM, 0, NULL, 0},
 
+    {"RewindEnable", 0, &RewindEnable, 0, NULL, 0},
+    {"RewindBudget", 0, &RewindBudget, 64, NULL, 0}, // in MB
+
     {"AudioInterp", 0, &AudioInterp, 0, NULL, 0},
     {"AudioVolume", 0, &AudioVolume, 256, NULL, 0},
     {"MicInputType", 0, &MicInputType, 1, NULL, 0},
@@ -34,6 +34,7 @@ enum
     HK_SolarSensorDecrease,
     HK_SolarSensorIncrease,
     HK_FrameStep,
+    HK_Rewind,
     HK_MAX
 };
 
@@ -68,6 +69,9 @@ extern int ScreenVSyncInterval;
 
 extern int _3DRenderer;
 extern int Threaded3D;
+extern int Threads3D;
+extern int Threaded2D;
+extern int Deferred2D;
 
 extern int GL_ScaleFactor;
 extern int GL_BetterPolygons;
@@ -85,6 +89,9 @@ extern int DirectLAN;
 
 extern int SavestateRelocSRAM;
 
+extern int RewindEnable;
+extern int RewindBudget;
+
 extern int AudioInterp;
 extern int AudioVolume;
 extern int MicInputType;
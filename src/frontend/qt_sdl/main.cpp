@@ -78,6 +78,7 @@
 #include "PlatformConfig.h"
 
 #include "Savestate.h"
+#include "Rewind.h"
 
 #include "main_shaders.h"
 
@@ -386,6 +387,10 @@ void EmuThread::run()
 
     videoSettingsDirty = false;
     videoSettings.Soft_Threaded = Config::Threaded3D != 0;
+    videoSettings.Soft_Threads = Config::Threads3D;
+    videoSettings.Threaded2D = Config::Threaded2D != 0;
+    videoSettings.Deferred2D = Config::Deferred2D != 0;
+    videoSettings.Soft_ScalarFactors = false;
     videoSettings.GL_ScaleFactor = Config::GL_ScaleFactor;
     videoSettings.GL_BetterPolygons = Config::GL_BetterPolygons;
 
@@ -406,6 +411,8 @@ void EmuThread::run()
 
     SPU::SetInterpolation(Config::AudioInterp);
 
+    Rewind::SetBudget(Config::RewindBudget * 1024 * 1024);
+
     Input::Init();
 
     u32 nframes = 0;
@@ -480,6 +487,9 @@ void EmuThread::run()
                 videoSettingsDirty = false;
 
                 videoSettings.Soft_Threaded = Config::Threaded3D != 0;
+                videoSettings.Soft_Threads = Config::Threads3D;
+                videoSettings.Threaded2D = Config::Threaded2D != 0;
+                videoSettings.Deferred2D = Config::Deferred2D != 0;
                 videoSettings.GL_ScaleFactor = Config::GL_ScaleFactor;
                 videoSettings.GL_BetterPolygons = Config::GL_BetterPolygons;
 
@@ -539,9 +549,23 @@ void EmuThread::run()
             }
 #endif
 
+            // while the rewind hotkey is held, go back one frame before running
+            // the frame, so there is something to show
+            bool rewinding = false;
+            if (Config::RewindEnable)
+            {
+                if (Input::HotkeyDown(HK_Rewind))
+                    rewinding = Rewind::Step();
+            }
+            else if (Rewind::MemoryUsage() > 0)
+                Rewind::Reset();
+
             // emulate
             u32 nlines = NDS::RunFrame();
 
+            if (Config::RewindEnable && !rewinding)
+                Rewind::Capture();
+
             FrontBufferLock.lock();
             FrontBuffer = GPU::FrontBuffer;
 #ifdef OGLRENDERER_ENABLED
@@ -1322,6 +1346,9 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
             actSaveState[0]->setShortcut(QKeySequence(Qt::ShiftModifier | Qt::Key_F9));
             actSaveState[0]->setData(QVariant(0));
             connect(actSaveState[0], &QAction::triggered, this, &MainWindow::onSaveState);
+
+            // the state is written in the background, report back once it's done
+            connect(this, &MainWindow::stateSaved, this, &MainWindow::onStateSaved, Qt::QueuedConnection);
         }
         {
             QMenu* submenu = menu->addMenu("Load state");
@@ -1421,6 +1448,10 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
             actSavestateSRAMReloc = submenu->addAction("Separate savefiles");
             actSavestateSRAMReloc->setCheckable(true);
             connect(actSavestateSRAMReloc, &QAction::triggered, this, &MainWindow::onChangeSavestateSRAMReloc);
+
+            actRewindEnable = submenu->addAction("Enable rewind");
+            actRewindEnable->setCheckable(true);
+            connect(actRewindEnable, &QAction::triggered, this, &MainWindow::onChangeRewindEnable);
         }
 
         menu->addSeparator();
@@ -1595,6 +1626,7 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     actROMInfo->setEnabled(false);
 
     actSavestateSRAMReloc->setChecked(Config::SavestateRelocSRAM != 0);
+    actRewindEnable->setChecked(Config::RewindEnable != 0);
 
     actScreenRotation[Config::ScreenRotation]->setChecked(true);
 
@@ -2195,21 +2227,28 @@ void MainWindow::onSaveState()
         strncpy(filename, qfilename.toStdString().c_str(), 1023); filename[1023] = '\0';
     }
 
-    if (Frontend::SaveState(filename))
+    if (!Frontend::SaveState(filename, [this, slot](bool ok) { emit stateSaved(slot, ok); }))
     {
-        char msg[64];
-        if (slot > 0) sprintf(msg, "State saved to slot %d", slot);
-        else          sprintf(msg, "State saved to file");
-        OSD::AddMessage(0, msg);
-
-        actLoadState[slot]->setEnabled(true);
+        OSD::AddMessage(0xFFA0A0, "State save failed");
     }
-    else
+
+    emuThread->emuUnpause();
+}
+
+void MainWindow::onStateSaved(int slot, bool ok)
+{
+    if (!ok)
     {
         OSD::AddMessage(0xFFA0A0, "State save failed");
+        return;
     }
 
-    emuThread->emuUnpause();
+    char msg[64];
+    if (slot > 0) sprintf(msg, "State saved to slot %d", slot);
+    else          sprintf(msg, "State saved to file");
+    OSD::AddMessage(0, msg);
+
+    actLoadState[slot]->setEnabled(true);
 }
 
 void MainWindow::onLoadState()
@@ -2239,6 +2278,9 @@ void MainWindow::onLoadState()
         strncpy(filename, qfilename.toStdString().c_str(), 1023); filename[1023] = '\0';
     }
 
+    // a state that was just saved might not have hit the disk yet
+    Frontend::FinishSaveState();
+
     if (!Platform::FileExists(filename))
     {
         char msg[64];
@@ -2544,6 +2586,11 @@ void MainWindow::onChangeSavestateSRAMReloc(bool checked)
     Config::SavestateRelocSRAM = checked?1:0;
 }
 
+void MainWindow::onChangeRewindEnable(bool checked)
+{
+    Config::RewindEnable = checked?1:0;
+}
+
 void MainWindow::onChangeScreenSize()
 {
     int factor = ((QAction*)sender())->data().toInt();
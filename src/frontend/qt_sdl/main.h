@@ -227,6 +227,7 @@ protected:
 
 signals:
     void screenLayoutChange();
+    void stateSaved(int slot, bool ok);
 
 private slots:
     void onOpenFile();
@@ -235,6 +236,7 @@ private slots:
     void onClearRecentFiles();
     void onBootFirmware();
     void onSaveState();
+    void onStateSaved(int slot, bool ok);
     void onLoadState();
     void onUndoStateLoad();
     void onImportSavefile();
@@ -266,6 +268,7 @@ private slots:
     void onInterfaceSettingsFinished(int res);
     void onUpdateMouseTimer();
     void onChangeSavestateSRAMReloc(bool checked);
+    void onChangeRewindEnable(bool checked);
     void onChangeScreenSize();
     void onChangeScreenRotation(QAction* act);
     void onChangeScreenGap(QAction* act);
@@ -336,6 +339,7 @@ public:
     QAction* actFirmwareSettings;
     QAction* actInterfaceSettings;
     QAction* actSavestateSRAMReloc;
+    QAction* actRewindEnable;
     QAction* actScreenSize[4];
     QActionGroup* grpScreenRotation;
     QAction* actScreenRotation[4];
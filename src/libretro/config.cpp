@@ -47,6 +47,7 @@ namespace Config
     char DSiSDPath[1024];
 
     int RandomizeMAC;
+    int CachedInterpreter = true;
 
 #ifdef JIT_ENABLED
     int JIT_Enable = true;
@@ -54,6 +55,11 @@ namespace Config
     int JIT_BranchOptimisations = true;
     int JIT_LiteralOptimisations = true;
     int JIT_FastMemory = false;
+    int JIT_DiskCache = false;
+    int JIT_PerfMap = false;
+    int JIT_ProfileBlocks = false;
+    int JIT_BackgroundCompile = false;
+    int JIT_DSP = true;
 #else
     // Needed for savestate
     int JIT_Enable = false;
@@ -43,6 +43,7 @@ retro_game_info* cached_info;
 GPU::RenderSettings video_settings;
 
 bool libretro_supports_bitmasks = false;
+bool libretro_supports_dupe = false;
 bool enable_opengl = false;
 bool using_opengl = false;
 bool opengl_linear_filtering = false;
@@ -74,6 +75,16 @@ enum CurrentRenderer
 
 static CurrentRenderer current_renderer = CurrentRenderer::None;
 
+// The savestate size only depends on the loaded game (SRAM size, cart type)
+// and the console configuration, so it's computed once with a dry run and
+// cached until one of those changes. 0 means it needs to be recomputed.
+static size_t serialize_size = 0;
+
+static void invalidate_serialize_size(void)
+{
+   serialize_size = 0;
+}
+
 static void fallback_log(enum retro_log_level level, const char *fmt, ...)
 {
    (void)level;
@@ -100,6 +111,7 @@ void retro_init(void)
 void retro_deinit(void)
 {
    libretro_supports_bitmasks = false;
+   libretro_supports_dupe = false;
    libretro_supports_option_categories = false;
 }
 
@@ -211,6 +223,12 @@ static bool update_option_visibility(void)
       option_display.key = "melonds_jit_fast_memory";
       environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
+      option_display.key = "melonds_jit_disk_cache";
+      environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+
+      option_display.key = "melonds_jit_background_compile";
+      environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+
       updated = true;
    }
 #endif
@@ -260,6 +278,9 @@ void retro_set_environment(retro_environment_t cb)
    if (environ_cb(RETRO_ENVIRONMENT_GET_INPUT_BITMASKS, NULL))
       libretro_supports_bitmasks = true;
 
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &libretro_supports_dupe))
+      libretro_supports_dupe = false;
+
    static const struct retro_subsystem_memory_info gba_memory[] = {
       { "srm", 0x101 },
 	};
@@ -318,6 +339,7 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
 
 void retro_reset(void)
 {
+   invalidate_serialize_size();
    NDS::Reset();
    NDS::LoadROM((u8*)cached_info->data, cached_info->size, save_path.c_str(), Config::DirectBoot);
 }
@@ -428,6 +450,28 @@ static void check_variables(bool init)
       else
          video_settings.Soft_Threaded = false;
    }
+
+   var.key = "melonds_render_threads";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      video_settings.Soft_Threads = atoi(var.value);
+
+   var.key = "melonds_threaded_2d";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         video_settings.Threaded2D = true;
+      else
+         video_settings.Threaded2D = false;
+   }
+
+   var.key = "melonds_deferred_2d";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         video_settings.Deferred2D = true;
+      else
+         video_settings.Deferred2D = false;
+   }
 #endif
 
    TouchMode new_touch_mode = TouchMode::Disabled;
@@ -502,6 +546,15 @@ static void check_variables(bool init)
       refresh_opengl = true;
 #endif
 
+   var.key = "melonds_cached_interpreter";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::CachedInterpreter = true;
+      else
+         Config::CachedInterpreter = false;
+   }
+
 #ifdef JIT_ENABLED
    var.key = "melonds_jit_enable";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -544,6 +597,33 @@ static void check_variables(bool init)
       else
          Config::JIT_FastMemory = false;
    }
+
+   var.key = "melonds_jit_disk_cache";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_DiskCache = true;
+      else
+         Config::JIT_DiskCache = false;
+   }
+
+   var.key = "melonds_jit_background_compile";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_BackgroundCompile = true;
+      else
+         Config::JIT_BackgroundCompile = false;
+   }
+
+   var.key = "melonds_jit_dsp";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "enabled"))
+         Config::JIT_DSP = true;
+      else
+         Config::JIT_DSP = false;
+   }
 #endif
 
    var.key = "melonds_dsi_sdcard";
@@ -632,6 +712,27 @@ static void audio_callback(void)
    audio_cb(buffer, size);
 }
 
+// whether the frontend can simply show the last frame again:
+// neither the emulated screens, the layout nor the cursor changed since then
+static bool frame_unchanged(void)
+{
+   static bool last_cursor = false;
+   static int last_touch_x = -1, last_touch_y = -1;
+
+   bool cursor = cursor_enabled(&input_state);
+   bool cursor_moved = cursor != last_cursor
+      || (cursor && (input_state.touch_x != last_touch_x || input_state.touch_y != last_touch_y));
+
+   last_cursor = cursor;
+   last_touch_x = input_state.touch_x;
+   last_touch_y = input_state.touch_y;
+
+   bool unchanged = libretro_supports_dupe && !GPU::FrontBufferChanged && !cursor_moved && !screen_layout_data.buffer_dirty;
+   screen_layout_data.buffer_dirty = false;
+
+   return unchanged;
+}
+
 static void render_frame(void)
 {
    if (current_renderer == CurrentRenderer::None)
@@ -667,7 +768,11 @@ static void render_frame(void)
    #endif
       int frontbuf = GPU::FrontBuffer;
 
-      if(screen_layout_data.hybrid)
+      if(frame_unchanged())
+      {
+         video_cb(NULL, screen_layout_data.buffer_width, screen_layout_data.buffer_height, screen_layout_data.buffer_width * sizeof(uint32_t));
+      }
+      else if(screen_layout_data.hybrid)
       {
          unsigned primary = screen_layout_data.displayed_layout == ScreenLayout::HybridTop ? 0 : 1;
 
@@ -795,6 +900,7 @@ static bool _handle_load_game(unsigned type, const struct retro_game_info *info)
    * here.
    */
    cached_info = const_cast<retro_game_info*>(info);
+   invalidate_serialize_size();
 
    std::vector <std::string> required_roms = {"bios7.bin", "bios9.bin", "firmware.bin"};
    std::vector <std::string> missing_roms;
@@ -927,6 +1033,7 @@ bool retro_load_game(const struct retro_game_info *info)
 
 void retro_unload_game(void)
 {
+   invalidate_serialize_size();
    NDS::DeInit();
 }
 
@@ -940,23 +1047,19 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info *info,
    return _handle_load_game(type, info);
 }
 
-#define MAX_SERIALIZE_TEST_SIZE 16 * 1024 * 1024 // The current savestate is around 7MiB so 16MiB should be enough for now
-
 size_t retro_serialize_size(void)
 {
    if (NDS::ConsoleType == 0)
    {
-      // Create the dummy savestate
-      void* data = malloc(MAX_SERIALIZE_TEST_SIZE);
-      Savestate* savestate = new Savestate(data, MAX_SERIALIZE_TEST_SIZE, true);
-      NDS::DoSavestate(savestate);
-      // Find the offset to find the current static filesize
-      size_t size = savestate->GetOffset();
-      // Free
-      delete savestate;
-      free(data);
+      if (!serialize_size)
+      {
+         Savestate* savestate = new Savestate();
+         NDS::DoSavestate(savestate);
+         serialize_size = savestate->GetOffset();
+         delete savestate;
+      }
 
-      return size;
+      return serialize_size;
    }
    else
    {
@@ -991,6 +1094,9 @@ bool retro_unserialize(const void *data, size_t size)
       NDS::DoSavestate(savestate);
       delete savestate;
 
+      // loading a state can resize the cart SRAM
+      invalidate_serialize_size();
+
       return true;
    }
    else
@@ -70,13 +70,11 @@ struct retro_core_option_v2_category option_cats_us[] = {
       "Screen",
       "Change screen settings."
    },
-#ifdef JIT_ENABLED
    {
       "cpu",
       "CPU Emulation",
       "Change CPU emulation settings."
    },
-#endif
    { NULL, NULL, NULL },
 };
 
@@ -184,6 +182,52 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "disabled"
    },
+   {
+      "melonds_render_threads",
+      "Software Renderer Threads",
+      NULL,
+      NULL,
+      NULL,
+      "video",
+      {
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { "4", NULL },
+         { "6", NULL },
+         { "8", NULL },
+         { NULL, NULL },
+      },
+      "1"
+   },
+   {
+      "melonds_threaded_2d",
+      "Threaded 2D Rendering",
+      NULL,
+      NULL,
+      NULL,
+      "video",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "melonds_deferred_2d",
+      "Deferred 2D Rendering",
+      NULL,
+      NULL,
+      NULL,
+      "video",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
 #endif
 #ifdef HAVE_OPENGL
    {
@@ -514,6 +558,20 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       "2"
    },
 #endif
+   {
+      "melonds_cached_interpreter",
+      "Cached Interpreter",
+      NULL,
+      "Decode the emulated code once and keep it around instead of decoding every instruction as it runs. Only used when the JIT is disabled or unavailable.",
+      NULL,
+      "cpu",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "enabled"
+   },
 #ifdef JIT_ENABLED
    {
       "melonds_jit_enable",
@@ -615,6 +673,48 @@ struct retro_core_option_v2_definition option_defs_us[] = {
       },
       "enabled"
    },
+   {
+      "melonds_jit_disk_cache",
+      "JIT Disk Cache",
+      NULL,
+      "Keep the compiled code on disk, so it doesn't have to be compiled again the next time the same game is started.",
+      NULL,
+      "cpu",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "melonds_jit_background_compile",
+      "JIT Background Compilation",
+      NULL,
+      "Compile code on a separate thread. Code which isn't compiled yet is interpreted in the meantime, which avoids stutter when a lot of new code runs at once. Only available on x86-64.",
+      NULL,
+      "cpu",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "melonds_jit_dsp",
+      "DSP Block Cache",
+      NULL,
+      "Run the code on the DSi's audio DSP from compiled blocks instead of interpreting it one instruction at a time. Timing stays the same. Only used in DSi mode and independent of the JIT above. Only available on x86-64.",
+      NULL,
+      "cpu",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "enabled"
+   },
 #endif
    { NULL, NULL, NULL, NULL, NULL, NULL, {{0}}, NULL },
 };
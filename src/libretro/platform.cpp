@@ -100,6 +100,21 @@ namespace Platform
       return OpenLocalFile(path, "rb");
    }
 
+   bool RenameFile(const char* oldpath, const char* newpath)
+   {
+   #ifdef _WIN32
+      // rename() doesn't replace existing files there
+      filestream_delete(newpath);
+   #endif
+      return filestream_rename(oldpath, newpath) == 0;
+   }
+
+   bool RenameLocalFile(const char* oldpath, const char* newpath)
+   {
+      std::string base = std::string(retro_base_directory) + std::string(1, PLATFORM_DIR_SEPERATOR);
+      return RenameFile((base + oldpath).c_str(), (base + newpath).c_str());
+   }
+
    void StopEmu()
    {
        return;
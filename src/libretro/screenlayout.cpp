@@ -9,6 +9,7 @@ ScreenLayoutData screen_layout_data;
 void initialize_screnlayout_data(ScreenLayoutData *data)
 {
     data->buffer_ptr = nullptr;
+    data->buffer_dirty = true;
     data->hybrid_ratio = 2;
 }
 
@@ -193,6 +194,7 @@ void update_screenlayout(ScreenLayout layout, ScreenLayoutData *data, bool openg
     }
 
     data->displayed_layout = layout;
+    data->buffer_dirty = true;
 
     if (opengl && data->buffer_ptr != nullptr) {
         // not needed anymore :)
@@ -219,4 +221,5 @@ void clean_screenlayout_buffer(ScreenLayoutData *data)
 
     unsigned size = data->buffer_stride * data->buffer_height;
     memset(data->buffer_ptr, 0, size);
+    data->buffer_dirty = true;
 }
@@ -66,6 +66,7 @@ struct ScreenLayoutData
     unsigned buffer_stride;
     size_t buffer_len;
     uint16_t* buffer_ptr;
+    bool buffer_dirty; // the buffer has to be redrawn even if the screens didn't change
     ScreenLayout displayed_layout;
 };
 
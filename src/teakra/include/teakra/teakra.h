@@ -7,6 +7,8 @@
 
 namespace Teakra {
 
+class Interpreter;
+
 struct AHBMCallback {
     std::function<std::uint8_t(std::uint32_t address)> read8;
     std::function<void(std::uint32_t address, std::uint8_t value)> write8;
@@ -70,6 +72,13 @@ public:
     // core
     void Run(unsigned cycle);
 
+    // for driving the core from somewhere else than Run(), e.g. a recompiler
+    Interpreter& GetInterpreter();
+    // called with the address after every write to program memory through ProgramWrite()
+    void SetProgramWriteHandler(std::function<void(std::uint32_t address)> handler);
+    // called before the DSP itself reads or writes MMIO
+    void SetMMIOAccessHandler(std::function<void()> handler);
+
     void SetAHBMCallback(const AHBMCallback& callback);
 
     void SetAudioCallback(std::function<void(std::array<std::int16_t, 2>)> callback);
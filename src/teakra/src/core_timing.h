@@ -25,11 +25,17 @@ public:
         }
     }
 
-    u64 Skip(u64 maximum) {
-        u64 ticks = maximum;
+    // How many ticks can be skipped before anything happens
+    u64 GetMaxSkip() const {
+        u64 ticks = Callbacks::Infinity;
         for (const auto& callbacks : registered_callbacks) {
             ticks = std::min(ticks, callbacks->GetMaxSkip());
         }
+        return ticks;
+    }
+
+    u64 Skip(u64 maximum) {
+        u64 ticks = std::min(maximum, GetMaxSkip());
         for (const auto& callbacks : registered_callbacks) {
             callbacks->Skip(ticks);
         }
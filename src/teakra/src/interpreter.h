@@ -73,78 +73,118 @@ public:
                 }
             }
 
-            for (std::size_t i = 0; i < 3; ++i) {
-                if (interrupt_pending[i].exchange(false)) {
-                    regs.ip[i] = 1;
-                }
-            }
+            PollInterrupts();
+            Step();
+            core_timing.Tick();
+        }
+    }
 
-            if (vinterrupt_pending.exchange(false)) {
-                regs.ipv = 1;
+    // The pieces Run() is made of, so that something else (e.g. a recompiler) can drive the
+    // core and still fall back to the interpreter for single instructions.
+    void PollInterrupts() {
+        // plain loads first, the exchanges are expensive and there's rarely anything pending
+        for (std::size_t i = 0; i < 3; ++i) {
+            if (interrupt_pending[i].load(std::memory_order_relaxed) &&
+                interrupt_pending[i].exchange(false)) {
+                regs.ip[i] = 1;
             }
+        }
 
-            u16 opcode = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
-            auto& decoder = decoders[opcode];
-            u16 expand_value = 0;
-            if (decoder.NeedExpansion()) {
-                expand_value = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
-            }
+        if (vinterrupt_pending.load(std::memory_order_relaxed) &&
+            vinterrupt_pending.exchange(false)) {
+            regs.ipv = 1;
+        }
+    }
 
-            if (regs.rep) {
-                if (regs.repc == 0) {
-                    regs.rep = false;
-                } else {
-                    --regs.repc;
-                    --regs.pc;
-                }
+    void Step() {
+        u16 opcode = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
+        auto& decoder = decoders[opcode];
+        u16 expand_value = 0;
+        if (decoder.NeedExpansion()) {
+            expand_value = mem.ProgramRead((regs.pc++) | (regs.prpage << 18));
+        }
+
+        if (regs.rep) {
+            if (regs.repc == 0) {
+                regs.rep = false;
+            } else {
+                --regs.repc;
+                --regs.pc;
             }
+        }
 
-            if (regs.lp && regs.bkrep_stack[regs.bcn - 1].end + 1 == regs.pc) {
-                if (regs.bkrep_stack[regs.bcn - 1].lc == 0) {
-                    --regs.bcn;
-                    regs.lp = regs.bcn != 0;
-                } else {
-                    --regs.bkrep_stack[regs.bcn - 1].lc;
-                    regs.pc = regs.bkrep_stack[regs.bcn - 1].start;
-                }
+        CheckLoopEnd();
+
+        decoder.call(*this, opcode, expand_value);
+
+        HandleInterrupts();
+    }
+
+    // To be called with pc pointing past the instruction about to be executed
+    void CheckLoopEnd() {
+        if (regs.lp && regs.bkrep_stack[regs.bcn - 1].end + 1 == regs.pc) {
+            if (regs.bkrep_stack[regs.bcn - 1].lc == 0) {
+                --regs.bcn;
+                regs.lp = regs.bcn != 0;
+            } else {
+                --regs.bkrep_stack[regs.bcn - 1].lc;
+                regs.pc = regs.bkrep_stack[regs.bcn - 1].start;
             }
+        }
+    }
 
-            decoder.call(*this, opcode, expand_value);
-
-            // I am not sure if a single-instruction loop is interruptable and how it is handled,
-            // so just disable interrupt for it for now.
-            if (regs.ie && !regs.rep) {
-                bool interrupt_handled = false;
-                for (u32 i = 0; i < regs.im.size(); ++i) {
-                    if (regs.im[i] && regs.ip[i]) {
-                        regs.ip[i] = 0;
-                        regs.ie = 0;
-                        PushPC();
-                        regs.pc = 0x0006 + i * 8;
-                        idle = false;
-                        interrupt_handled = true;
-                        if (regs.ic[i]) {
-                            ContextStore();
-                        }
-                        break;
-                    }
-                }
-                if (!interrupt_handled && regs.imv && regs.ipv) {
-                    regs.ipv = 0;
+    void HandleInterrupts() {
+        // I am not sure if a single-instruction loop is interruptable and how it is handled,
+        // so just disable interrupt for it for now.
+        if (regs.ie && !regs.rep) {
+            bool interrupt_handled = false;
+            for (u32 i = 0; i < regs.im.size(); ++i) {
+                if (regs.im[i] && regs.ip[i]) {
+                    regs.ip[i] = 0;
                     regs.ie = 0;
                     PushPC();
-                    regs.pc = vinterrupt_address;
+                    regs.pc = 0x0006 + i * 8;
                     idle = false;
-                    if (vinterrupt_context_switch) {
+                    interrupt_handled = true;
+                    if (regs.ic[i]) {
                         ContextStore();
                     }
+                    break;
+                }
+            }
+            if (!interrupt_handled && regs.imv && regs.ipv) {
+                regs.ipv = 0;
+                regs.ie = 0;
+                PushPC();
+                regs.pc = vinterrupt_address;
+                idle = false;
+                if (vinterrupt_context_switch) {
+                    ContextStore();
                 }
             }
-
-            core_timing.Tick();
         }
     }
 
+    bool IsIdle() const {
+        return idle;
+    }
+    void SetIdle(bool value) {
+        idle = value;
+    }
+
+    RegisterState& GetRegs() {
+        return regs;
+    }
+    CoreTiming& GetCoreTiming() {
+        return core_timing;
+    }
+    MemoryInterface& GetMemory() {
+        return mem;
+    }
+    const Matcher<Interpreter>& GetDecoder(u16 opcode) const {
+        return decoders[opcode];
+    }
+
     void SignalInterrupt(u32 i) {
         interrupt_pending[i] = true;
     }
@@ -11,15 +11,27 @@ void MemoryInterface::SetMMIO(MMIORegion& mmio) {
     this->mmio = &mmio;
 }
 
+void MemoryInterface::SetProgramWriteHandler(std::function<void(u32 address)> handler) {
+    program_write_handler = std::move(handler);
+}
+
+void MemoryInterface::SetMMIOAccessHandler(std::function<void()> handler) {
+    mmio_access_handler = std::move(handler);
+}
+
 u16 MemoryInterface::ProgramRead(u32 address) const {
     return shared_memory.ReadWord(address);
 }
 void MemoryInterface::ProgramWrite(u32 address, u16 value) {
     shared_memory.WriteWord(address, value);
+    if (program_write_handler)
+        program_write_handler(address);
 }
 u16 MemoryInterface::DataRead(u16 address, bool bypass_mmio) {
     if (memory_interface_unit.InMMIO(address) && !bypass_mmio) {
         ASSERT(mmio != nullptr);
+        if (mmio_access_handler)
+            mmio_access_handler();
         return mmio->Read(memory_interface_unit.ToMMIO(address));
     }
     u32 converted = memory_interface_unit.ConvertDataAddress(address);
@@ -29,6 +41,8 @@ u16 MemoryInterface::DataRead(u16 address, bool bypass_mmio) {
 void MemoryInterface::DataWrite(u16 address, u16 value, bool bypass_mmio) {
     if (memory_interface_unit.InMMIO(address) && !bypass_mmio) {
         ASSERT(mmio != nullptr);
+        if (mmio_access_handler)
+            mmio_access_handler();
         return mmio->Write(memory_interface_unit.ToMMIO(address), value);
     }
     u32 converted = memory_interface_unit.ConvertDataAddress(address);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include "common_types.h"
 #include "crash.h"
 
@@ -55,6 +56,8 @@ class MemoryInterface {
 public:
     MemoryInterface(SharedMemory& shared_memory, MemoryInterfaceUnit& memory_interface_unit);
     void SetMMIO(MMIORegion& mmio);
+    void SetProgramWriteHandler(std::function<void(u32 address)> handler);
+    void SetMMIOAccessHandler(std::function<void()> handler);
     u16 ProgramRead(u32 address) const;
     void ProgramWrite(u32 address, u16 value);
     u16 DataRead(u16 address, bool bypass_mmio = false); // not const because it can be a FIFO register
@@ -68,6 +71,8 @@ private:
     SharedMemory& shared_memory;
     MemoryInterfaceUnit& memory_interface_unit;
     MMIORegion* mmio;
+    std::function<void(u32 address)> program_write_handler;
+    std::function<void()> mmio_access_handler;
 };
 
 } // namespace Teakra
@@ -31,4 +31,8 @@ void Processor::SignalVectoredInterrupt(u32 address, bool context_switch) {
     impl->interpreter.SignalVectoredInterrupt(address, context_switch);
 }
 
+Interpreter& Processor::GetInterpreter() {
+    return impl->interpreter;
+}
+
 } // namespace Teakra
@@ -7,6 +7,7 @@
 namespace Teakra {
 
 class MemoryInterface;
+class Interpreter;
 
 class Processor {
 public:
@@ -16,6 +17,7 @@ public:
     void Run(unsigned cycles);
     void SignalInterrupt(u32 i);
     void SignalVectoredInterrupt(u32 address, bool context_switch);
+    Interpreter& GetInterpreter();
 
 private:
     struct Impl;
@@ -83,6 +83,17 @@ void Teakra::Run(unsigned cycle) {
     impl->processor.Run(cycle);
 }
 
+Interpreter& Teakra::GetInterpreter() {
+    return impl->processor.GetInterpreter();
+}
+
+void Teakra::SetProgramWriteHandler(std::function<void(std::uint32_t address)> handler) {
+    impl->memory_interface.SetProgramWriteHandler(std::move(handler));
+}
+void Teakra::SetMMIOAccessHandler(std::function<void()> handler) {
+    impl->memory_interface.SetMMIOAccessHandler(std::move(handler));
+}
+
 bool Teakra::SendDataIsEmpty(std::uint8_t index) const {
     return !impl->apbp_from_cpu.IsDataReady(index);
 }